@@ -0,0 +1,604 @@
+//
+// 2D convolution kernels on raw row-major images: border handling, direct, separable,
+// im2col + gemm and FFT.
+//
+
+#ifndef CPP_PROJECT_MATRIXCONV_H
+#define CPP_PROJECT_MATRIXCONV_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "MatrixFFT.h"
+#include "MatrixGemm.h"
+#include "MatrixLU.h"
+
+namespace kernel {
+    /*!
+     * @brief How the image is extended past its border.
+     * @note Reflect mirrors around the edge element without repeating it: dcb|abcd|cba.
+     */
+    enum class Padding {
+        Zero, Replicate, Reflect
+    };
+
+    /*!
+     * @brief Which part of the full convolution is returned.
+     * @note Full has every output touched by the kernel, Same is centred and as large as the
+     *       input, Valid only has outputs whose kernel lies inside the image.
+     */
+    enum class ConvShape {
+        Full, Same, Valid
+    };
+
+    /*!
+     * @brief How the convolution is computed.
+     * @note Auto runs rank-1 kernels as two 1D passes, and picks Fft for floating-point
+     *       images when the cost model says it is cheaper. Direct sums every tap.
+     */
+    enum class ConvMethod {
+        Auto, Direct, Fft
+    };
+
+    /*!
+     * @brief Options of a 2D convolution.
+     */
+    struct ConvOptions {
+        Padding padding = Padding::Zero;
+        ConvShape shape = ConvShape::Same;
+        long long strideRow = 1, strideCol = 1;
+        long long dilationRow = 1, dilationCol = 1;
+        ConvMethod method = ConvMethod::Auto;
+        /// Largest error, relative to the largest tap, of a rank-1 split of a kernel; 0 means
+        /// 16 epsilons of the element type (exact for integers), negative never splits.
+        double separableTolerance = 0;
+    };
+
+    /*!
+     * @brief The geometry of a convolution along one axis.
+     * @note Output o reads the padded input from o * stride on, one tap every dilation
+     *       elements; padded element t is input element t - pad.
+     */
+    struct ConvAxis {
+        long long in, taps, stride, dilation;
+        long long span; ///< (taps - 1) * dilation + 1
+        long long pad;  ///< padding before the first input element
+        long long out;  ///< number of outputs
+        long long padded() const { return (out - 1) * stride + span; }
+    };
+
+    /*!
+     * @brief Work out one axis of a convolution.
+     * @exception invalid_argument : stride or dilation is not positive
+     * @exception out_of_range : a valid convolution with the kernel larger than the input
+     */
+    inline ConvAxis conv_axis(long long in, long long taps, long long stride, long long dilation, ConvShape shape) {
+        if (stride <= 0 || dilation <= 0) throw std::invalid_argument("Stride and dilation must be positive!");
+        ConvAxis a{in, taps, stride, dilation, (taps - 1) * dilation + 1, 0, 0};
+        switch (shape) {
+            case ConvShape::Full:
+                a.pad = a.span - 1;
+                a.out = (in + a.span - 2) / stride + 1;
+                break;
+            case ConvShape::Same:
+                a.pad = a.span - 1 - a.span / 2;
+                a.out = (in - 1) / stride + 1;
+                break;
+            case ConvShape::Valid:
+                if (a.span > in) throw std::out_of_range("the core is too large!");
+                a.out = (in - a.span) / stride + 1;
+                break;
+        }
+        return a;
+    }
+
+    /*!
+     * @brief The input index that stands for index u of an axis of length n, -1 for a zero.
+     */
+    inline long long border_index(long long u, long long n, Padding padding) {
+        if (u >= 0 && u < n) return u;
+        switch (padding) {
+            case Padding::Zero:
+                return -1;
+            case Padding::Replicate:
+                return u < 0 ? 0 : n - 1;
+            case Padding::Reflect: {
+                if (n == 1) return 0;
+                long long period = 2 * (n - 1);
+                u %= period;
+                if (u < 0) u += period;
+                return u < n ? u : period - u;
+            }
+        }
+        return -1;
+    }
+
+    /*!
+     * @brief Copy the h x w image x into the padded image of two axes, extending its border.
+     * @param[out] xp : rows.padded() x cols.padded(), leading dimension cols.padded()
+     */
+    template<class T>
+    void pad_image(const T *x, long long ldx, const ConvAxis &rows, const ConvAxis &cols, Padding padding, T *xp) {
+        long long pw = cols.padded();
+        std::vector<long long> map(pw);
+        for (long long c = 0; c < pw; c++) map[c] = border_index(c - cols.pad, cols.in, padding);
+        for (long long t = 0; t < rows.padded(); t++) {
+            T *dst = xp + t * pw;
+            long long r = border_index(t - rows.pad, rows.in, padding);
+            if (r < 0) {
+                std::fill(dst, dst + pw, T());
+                continue;
+            }
+            const T *src = x + r * ldx;
+            for (long long c = 0; c < pw; c++) dst[c] = map[c] < 0 ? T() : src[map[c]];
+        }
+    }
+
+    /*!
+     * @brief y = y + a * x over n contiguous elements.
+     */
+    template<class T>
+    inline void axpy(long long n, T a, const T *x, T *y) {
+        for (long long j = 0; j < n; j++) y[j] = y[j] + a * x[j];
+    }
+
+#ifdef MATRIX_USE_AVX2
+    template<>
+    inline void axpy<double>(long long n, double a, const double *x, double *y) {
+        __m256d av = _mm256_set1_pd(a);
+        long long j = 0;
+        for (; j + 8 <= n; j += 8) {
+            _mm256_storeu_pd(y + j, _mm256_fmadd_pd(av, _mm256_loadu_pd(x + j), _mm256_loadu_pd(y + j)));
+            _mm256_storeu_pd(y + j + 4, _mm256_fmadd_pd(av, _mm256_loadu_pd(x + j + 4), _mm256_loadu_pd(y + j + 4)));
+        }
+        for (; j < n; j++) y[j] += a * x[j];
+    }
+
+    template<>
+    inline void axpy<float>(long long n, float a, const float *x, float *y) {
+        __m256 av = _mm256_set1_ps(a);
+        long long j = 0;
+        for (; j + 16 <= n; j += 16) {
+            _mm256_storeu_ps(y + j, _mm256_fmadd_ps(av, _mm256_loadu_ps(x + j), _mm256_loadu_ps(y + j)));
+            _mm256_storeu_ps(y + j + 8, _mm256_fmadd_ps(av, _mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(y + j + 8)));
+        }
+        for (; j < n; j++) y[j] += a * x[j];
+    }
+#endif
+
+    /*!
+     * @brief Correlate the padded image with one kernel k, rows [r0, r1) of the output.
+     * @note Every tap adds a scaled, shifted row of the padded image to an output row, so
+     *       with unit column stride the inner loop is a contiguous axpy.
+     */
+    template<class T>
+    void conv_direct(const T *xp, const ConvAxis &rows, const ConvAxis &cols, const T *k,
+                     T *y, long long r0, long long r1) {
+        long long pw = cols.padded(), ow = cols.out, sc = cols.stride;
+        for (long long i = r0; i < r1; i++) {
+            T *yr = y + i * ow;
+            std::fill(yr, yr + ow, T());
+            for (long long a = 0; a < rows.taps; a++) {
+                const T *src = xp + (i * rows.stride + a * rows.dilation) * pw;
+                for (long long b = 0; b < cols.taps; b++) {
+                    T kv = k[a * cols.taps + b];
+                    if (kv == T()) continue;
+                    const T *s = src + b * cols.dilation;
+                    if (sc == 1) axpy(ow, kv, s, yr);
+                    else for (long long j = 0; j < ow; j++) yr[j] = yr[j] + kv * s[j * sc];
+                }
+            }
+        }
+    }
+
+    /*!
+     * @brief Split the kh x kw kernel k into the column kc and the row kr with k = kc * kr.
+     * @return whether every tap is within tol * max |k| of the product
+     * @note The row and column through the largest tap are the factors, scaled by it. For
+     *       integers the row is divided by the gcd g of the pivot row instead and the column
+     *       scaled by g / pivot, so exact splits such as [1 2 1]' [1 2 1] are found.
+     */
+    template<class T>
+    bool separate(long long kh, long long kw, const T *k, double tol, T *kc, T *kr) {
+        long long p = 0;
+        for (long long t = 1; t < kh * kw; t++)
+            if (magnitude(k[t]) > magnitude(k[p])) p = t;
+        double top = magnitude(k[p]);
+        if (top == 0) {
+            std::fill(kc, kc + kh, T());
+            std::fill(kr, kr + kw, T());
+            return true;
+        }
+        long long pr = p / kw, pc = p % kw;
+        if constexpr (std::is_integral<T>::value) {
+            T g = T();
+            for (long long b = 0; b < kw; b++) g = std::gcd(g, k[pr * kw + b]);
+            for (long long b = 0; b < kw; b++) kr[b] = T(k[pr * kw + b] / g);
+            for (long long a = 0; a < kh; a++) kc[a] = T(k[a * kw + pc] * g / k[p]);
+        } else {
+            for (long long a = 0; a < kh; a++) kc[a] = k[a * kw + pc];
+            for (long long b = 0; b < kw; b++) kr[b] = b == pc ? T(1) : T(k[pr * kw + b] / k[p]);
+        }
+        for (long long a = 0; a < kh; a++)
+            for (long long b = 0; b < kw; b++) {
+                T prod = kc[a] * kr[b], v = k[a * kw + b];
+                if (!(v == prod) && magnitude(T(v - prod)) > tol * top) return false;
+            }
+        return true;
+    }
+
+    /*!
+     * @brief Convolve the image x with the separable kernel kc * kr.
+     * @param[in] cf : kc flipped, rows.taps of them
+     * @param[in] rf : kr flipped, cols.taps of them
+     * @note Bands of output rows run on the thread pool. A band walks down the image,
+     *       filtering each source row it needs along the columns into a ring of span rows,
+     *       and sums kh ring rows into every output row; only one row at a time is padded.
+     */
+    template<class T>
+    void conv_separable(const T *x, long long ldx, const ConvAxis &rows, const ConvAxis &cols, Padding padding,
+                        const T *cf, const T *rf, T *y) {
+        long long kh = rows.taps, kw = cols.taps, oh = rows.out, ow = cols.out, pw = cols.padded();
+        long long sr = rows.stride, sc = cols.stride;
+        std::vector<long long> map(pw);
+        for (long long c = 0; c < pw; c++) map[c] = border_index(c - cols.pad, cols.in, padding);
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long tasks = std::min<long long>(oh, 4LL * pool.threads());
+        pool.parallel_for(tasks, 2 * (kh + kw) * oh * ow, [&](long long t) {
+            long long i0 = oh * t / tasks, i1 = oh * (t + 1) / tasks, next = i0 * sr;
+            thread_local std::vector<T> line, ring;
+            line.resize(pw), ring.resize(rows.span * ow);
+            for (long long i = i0; i < i1; i++) {
+                for (; next < i * sr + rows.span; next++) {
+                    long long u = next;
+                    bool used = false;
+                    for (long long a = 0; a < kh && !used; a++) {
+                        long long v = u - a * rows.dilation;
+                        used = v >= i0 * sr && v < i1 * sr && v % sr == 0;
+                    }
+                    if (!used) continue;
+                    T *hr = ring.data() + u % rows.span * ow;
+                    std::fill(hr, hr + ow, T());
+                    long long r = border_index(u - rows.pad, rows.in, padding);
+                    if (r < 0) continue;
+                    const T *src = x + r * ldx;
+                    for (long long c = 0; c < pw; c++) line[c] = map[c] < 0 ? T() : src[map[c]];
+                    for (long long b = 0; b < kw; b++) {
+                        T kv = rf[b];
+                        if (kv == T()) continue;
+                        const T *s = line.data() + b * cols.dilation;
+                        if (sc == 1) axpy(ow, kv, s, hr);
+                        else for (long long j = 0; j < ow; j++) hr[j] = hr[j] + kv * s[j * sc];
+                    }
+                }
+                T *yr = y + i * ow;
+                std::fill(yr, yr + ow, T());
+                for (long long a = 0; a < kh; a++) {
+                    long long u = i * sr + a * rows.dilation;
+                    if (!(cf[a] == T())) axpy(ow, cf[a], ring.data() + u % rows.span * ow, yr);
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief Whether n is even with no prime factor above 3, the lengths the FFT is fastest at.
+     */
+    inline bool fft_good(long long n) {
+        if (n % 2) return false;
+        for (long long p : {2, 3})
+            while (n % p == 0) n /= p;
+        return n == 1;
+    }
+
+    /*!
+     * @brief The overlap-save tiling of an FFT convolution.
+     * @note Tile (i, j) transforms the n1 x n2 block of the padded image at (i * b1, j * b2)
+     *       and keeps the last b1 x b2 values of the circular convolution, which equal the
+     *       linear ones. Tiles never write to the same output, so they run in parallel.
+     */
+    struct FftTiling {
+        long long n1 = 0, n2 = 0, b1 = 0, b2 = 0, t1 = 0, t2 = 0;
+        double cost = 0; ///< estimated flops
+    };
+
+    /*!
+     * @brief The cheapest tiling for len1 x len2 unit-stride outputs of a span1 x span2 kernel.
+     * @note Every pair of good lengths up to one tile for the whole image is tried, costing
+     *       one forward and nk inverse real 2D FFTs plus nk spectrum products per tile.
+     */
+    inline FftTiling fft_tiling(long long len1, long long span1, long long len2, long long span2, long long nk) {
+        auto lengths = [](long long span, long long len) {
+            std::vector<long long> v;
+            for (long long n = span + 1; v.empty() || v.back() < len + span - 1; n++)
+                if (fft_good(n)) v.push_back(n);
+            return v;
+        };
+        std::vector<long long> c1 = lengths(span1, len1), c2 = lengths(span2, len2);
+        FftTiling best;
+        for (long long n1 : c1)
+            for (long long n2 : c2) {
+                FftTiling t;
+                t.n1 = n1, t.n2 = n2, t.b1 = n1 - span1 + 1, t.b2 = n2 - span2 + 1;
+                t.t1 = (len1 + t.b1 - 1) / t.b1, t.t2 = (len2 + t.b2 - 1) / t.b2;
+                double size = (double) n1 * n2;
+                t.cost = (double) t.t1 * t.t2 * ((1 + nk) * 2.5 * size * std::log2(size) + nk * 3.0 * size);
+                if (best.n1 == 0 || t.cost < best.cost) best = t;
+            }
+        return best;
+    }
+
+    /*!
+     * @brief 2D real FFT of the n1 x n2 grid g into its n1 x (n2 / 2 + 1) half spectrum s.
+     */
+    inline void rfft2(const FftPlan &cp, const RfftPlan &rp, const double *g, std::complex<double> *s) {
+        long long n1 = cp.n, n2 = rp.n, w = n2 / 2 + 1;
+        for (long long r = 0; r < n1; r++) rfft(rp, g + r * n2, s + r * w);
+        thread_local std::vector<std::complex<double> > col;
+        col.resize(n1);
+        for (long long c = 0; c < w; c++) {
+            fft(cp, s + c, col.data(), w);
+            for (long long r = 0; r < n1; r++) s[r * w + c] = col[r];
+        }
+    }
+
+    /*!
+     * @brief g = n1 * n2 * the inverse of rfft2(), unnormalized.
+     * @param[in,out] s : the half spectrum, overwritten
+     */
+    inline void irfft2(const FftPlan &cp, const RfftPlan &rp, std::complex<double> *s, double *g) {
+        long long n1 = cp.n, n2 = rp.n, w = n2 / 2 + 1;
+        thread_local std::vector<std::complex<double> > col, out;
+        col.resize(n1), out.resize(n1);
+        for (long long c = 0; c < w; c++) {
+            for (long long r = 0; r < n1; r++) col[r] = s[r * w + c];
+            ifft(cp, col.data(), out.data());
+            for (long long r = 0; r < n1; r++) s[r * w + c] = out[r];
+        }
+        for (long long r = 0; r < n1; r++) irfft(rp, s + r * w, g + r * n2);
+    }
+
+    /*!
+     * @brief The half spectra of the nk kernels k, not flipped, dilated into tiles of the tiling.
+     * @return nk spectra of tl.n1 x (tl.n2 / 2 + 1), one after another
+     */
+    template<class T>
+    std::vector<std::complex<double> > fft_spectra(const ConvAxis &rows, const ConvAxis &cols, long long nk,
+                                                   const T *k, const FftTiling &tl) {
+        const FftPlan &cp = fft_plan_cached(tl.n1);
+        const RfftPlan &rp = rfft_plan_cached(tl.n2);
+        long long n1 = tl.n1, n2 = tl.n2, w = n2 / 2 + 1, taps = rows.taps * cols.taps;
+        std::vector<std::complex<double> > spectra(nk * n1 * w);
+        parallel::ThreadPool::instance().parallel_for(nk, (long long) (tl.cost / (tl.t1 * tl.t2)), [&](long long q) {
+            std::vector<double> g(n1 * n2, 0.0);
+            for (long long a = 0; a < rows.taps; a++)
+                for (long long b = 0; b < cols.taps; b++)
+                    g[a * rows.dilation * n2 + b * cols.dilation] = (double) k[q * taps + a * cols.taps + b];
+            rfft2(cp, rp, g.data(), spectra.data() + q * n1 * w);
+        });
+        return spectra;
+    }
+
+    /*!
+     * @brief Convolve the padded image with nk kernels by overlap-save FFT tiles, see FftTiling.
+     * @param[in] spectra : the kernel spectra from fft_spectra()
+     * @note Transforms run in double. Each tile is transformed once and multiplied by the
+     *       spectrum of every kernel; strided outputs are picked from the unit-stride result.
+     */
+    template<class T>
+    void conv_fft(const T *xp, const ConvAxis &rows, const ConvAxis &cols, long long nk,
+                  const std::vector<std::complex<double> > &spectra, const FftTiling &tl, T *y) {
+        typedef std::complex<double> C;
+        const FftPlan &cp = fft_plan_cached(tl.n1);
+        const RfftPlan &rp = rfft_plan_cached(tl.n2);
+        long long n1 = tl.n1, n2 = tl.n2, w = n2 / 2 + 1;
+        long long oh = rows.out, ow = cols.out, ph = rows.padded(), pw = cols.padded();
+        long long len1 = (oh - 1) * rows.stride + 1, len2 = (ow - 1) * cols.stride + 1;
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        double scale = 1.0 / ((double) n1 * n2);
+        pool.parallel_for(tl.t1 * tl.t2, (long long) tl.cost, [&](long long t) {
+            long long r0 = t / tl.t2 * tl.b1, c0 = t % tl.t2 * tl.b2;
+            thread_local std::vector<double> g;
+            thread_local std::vector<C> s, p;
+            g.resize(n1 * n2), s.resize(n1 * w), p.resize(n1 * w);
+            for (long long r = 0; r < n1; r++) {
+                double *gr = g.data() + r * n2;
+                const T *src = xp + (r0 + r) * pw;
+                long long cn = r0 + r < ph ? std::max(0LL, std::min(n2, pw - c0)) : 0;
+                for (long long c = 0; c < cn; c++) gr[c] = (double) src[c0 + c];
+                std::fill(gr + cn, gr + n2, 0.0);
+            }
+            rfft2(cp, rp, g.data(), s.data());
+            for (long long q = 0; q < nk; q++) {
+                const C *kq = spectra.data() + q * n1 * w;
+                for (long long i = 0; i < n1 * w; i++) p[i] = cmul(s[i], kq[i]);
+                irfft2(cp, rp, p.data(), g.data());
+                T *yq = y + q * oh * ow;
+                for (long long i = rows.span - 1; i < n1; i++) {
+                    long long o1 = r0 + i - (rows.span - 1);
+                    if (o1 >= len1) break;
+                    if (o1 % rows.stride) continue;
+                    T *yr = yq + o1 / rows.stride * ow;
+                    const double *gr = g.data() + i * n2;
+                    for (long long j = cols.span - 1; j < n2; j++) {
+                        long long o2 = c0 + j - (cols.span - 1);
+                        if (o2 >= len2) break;
+                        if (o2 % cols.stride == 0) yr[o2 / cols.stride] = (T) (gr[j] * scale);
+                    }
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief A convolution prepared once for any number of images of one size.
+     * @note conv_plan() does all the per-kernel work: flipping, rank-1 splitting, choosing
+     *       the method and transforming the kernels for the FFT path.
+     */
+    template<class T>
+    struct ConvPlan {
+        ConvAxis rows, cols;
+        Padding padding = Padding::Zero;
+        long long nk = 0;
+        bool separable = false;
+        bool fft = false;
+        std::vector<T> kf;  ///< flipped kernels, or all flipped column factors then all flipped row factors
+        FftTiling tiling;
+        std::vector<std::complex<double> > spectra;
+
+        long long out() const { return rows.out * cols.out; } ///< elements of one output image
+    };
+
+    /*!
+     * @brief Prepare the convolution of h x w images with nk kernels of kh x kw each.
+     * @param[in] k : the nk kernels one after another, row-major
+     * @note Kernels are flipped, so this is a true convolution. Under Auto, when every kernel
+     *       is rank 1 within opt.separableTolerance, the plan runs conv_separable(). Otherwise floating-point images go through conv_fft() when asked to, or under
+     *       Auto when its estimated cost is below that of the direct sum.
+     * @exception invalid_argument : a stride or dilation is not positive, or Fft asked for
+     *            with an element type that is not floating-point
+     * @exception out_of_range : a valid convolution with the kernel larger than the image
+     */
+    template<class T>
+    ConvPlan<T> conv_plan(long long h, long long w, long long nk, const T *k, long long kh, long long kw,
+                          const ConvOptions &opt) {
+        ConvPlan<T> plan;
+        plan.rows = conv_axis(h, kh, opt.strideRow, opt.dilationRow, opt.shape);
+        plan.cols = conv_axis(w, kw, opt.strideCol, opt.dilationCol, opt.shape);
+        if (opt.method == ConvMethod::Fft && !std::is_floating_point<T>::value)
+            throw std::invalid_argument("FFT convolution needs a floating-point element type!");
+        plan.padding = opt.padding;
+        plan.nk = nk;
+        const ConvAxis &rows = plan.rows, &cols = plan.cols;
+        long long taps = kh * kw, oh = rows.out, ow = cols.out;
+        if (opt.method == ConvMethod::Auto && opt.separableTolerance >= 0 && taps > 1) {
+            double tol = opt.separableTolerance > 0 ? opt.separableTolerance
+                       : 16 * (double) std::numeric_limits<typename real_of<T>::type>::epsilon();
+            plan.kf.resize(nk * (kh + kw));
+            T *kc = plan.kf.data(), *kr = kc + nk * kh;
+            plan.separable = true;
+            for (long long q = 0; q < nk && plan.separable; q++)
+                plan.separable = separate(kh, kw, k + q * taps, tol, kc + q * kh, kr + q * kw);
+            if (plan.separable) {
+                for (long long q = 0; q < nk; q++) {
+                    std::reverse(kc + q * kh, kc + (q + 1) * kh);
+                    std::reverse(kr + q * kw, kr + (q + 1) * kw);
+                }
+                return plan;
+            }
+        }
+        if (std::is_floating_point<T>::value && opt.method != ConvMethod::Direct) {
+            plan.tiling = fft_tiling((oh - 1) * rows.stride + 1, rows.span, (ow - 1) * cols.stride + 1, cols.span, nk);
+            // An FFT flop costs about FFT_WEIGHT flops of the vectorized direct sum.
+            const double FFT_WEIGHT = 8;
+            if (opt.method == ConvMethod::Fft || FFT_WEIGHT * plan.tiling.cost < 2.0 * taps * oh * ow * nk) {
+                plan.fft = true;
+                plan.kf.clear();
+                plan.spectra = fft_spectra(rows, cols, nk, k, plan.tiling);
+                return plan;
+            }
+        }
+        plan.kf.resize(nk * taps);
+        for (long long q = 0; q < nk; q++)
+            std::reverse_copy(k + q * taps, k + (q + 1) * taps, plan.kf.begin() + q * taps);
+        return plan;
+    }
+
+    /*!
+     * @brief Run a prepared convolution on the image x of the planned size.
+     * @param[out] y : nk outputs of plan.out() elements, one after another
+     * @param[in,out] scratch : the padded image and patch matrix, reused between calls
+     * @note The image is padded once, except on the separable path. One kernel runs the
+     *       direct kernel over rows of the output on the thread pool; several kernels lower
+     *       to im2col + gemm, one band of output rows at a time, with the kernels as the rows
+     *       of A and the patch matrix as B, so each output row of the gemm is a contiguous
+     *       strip of one output image.
+     */
+    template<class T>
+    void conv_run(const ConvPlan<T> &plan, const T *x, long long ldx, T *y, std::vector<T> &scratch) {
+        const ConvAxis &rows = plan.rows, &cols = plan.cols;
+        long long nk = plan.nk, kh = rows.taps, kw = cols.taps, taps = kh * kw;
+        long long oh = rows.out, ow = cols.out, pw = cols.padded(), size = rows.padded() * pw;
+        if (plan.separable) {
+            const T *kc = plan.kf.data(), *kr = kc + nk * kh;
+            for (long long q = 0; q < nk; q++)
+                conv_separable(x, ldx, rows, cols, plan.padding, kc + q * kh, kr + q * kw, y + q * oh * ow);
+            return;
+        }
+        bool lowered = !plan.fft && blocking<T>::packed && nk >= 4;
+        // Bands of output rows keep the patch matrix within a few MB.
+        long long band = std::max(1LL, std::min(oh, (1LL << 19) / std::max(1LL, taps * ow)));
+        scratch.resize(size + (lowered ? taps * band * ow : 0));
+        T *xp = scratch.data();
+        pad_image(x, ldx, rows, cols, plan.padding, xp);
+        if (plan.fft) {
+            conv_fft(xp, rows, cols, nk, plan.spectra, plan.tiling, y);
+            return;
+        }
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        if (!lowered) {
+            long long tasks = std::min<long long>(oh, 4LL * pool.threads());
+            for (long long q = 0; q < nk; q++)
+                pool.parallel_for(tasks, 2 * taps * oh * ow, [&](long long t) {
+                    conv_direct(xp, rows, cols, plan.kf.data() + q * taps, y + q * oh * ow,
+                                oh * t / tasks, oh * (t + 1) / tasks);
+                });
+            return;
+        }
+        T *patches = xp + size;
+        for (long long i0 = 0; i0 < oh; i0 += band) {
+            long long rb = std::min(band, oh - i0), pix = rb * ow;
+            pool.parallel_for(taps, taps * pix, [&](long long t) {
+                long long a = t / kw, b = t % kw;
+                T *dst = patches + t * pix;
+                for (long long i = 0; i < rb; i++) {
+                    const T *src = xp + ((i0 + i) * rows.stride + a * rows.dilation) * pw + b * cols.dilation;
+                    for (long long j = 0; j < ow; j++) dst[i * ow + j] = src[j * cols.stride];
+                }
+            });
+            gemm<T>(nk, pix, taps, T(1), plan.kf.data(), taps, patches, pix, T(), y + i0 * ow, oh * ow);
+        }
+    }
+
+    /*!
+     * @brief Convolve the h x w image x with nk kernels of kh x kw each.
+     * @param[in] k : the nk kernels one after another, row-major
+     * @param[out] y : nk outputs of the size given by conv_axis(), one after another
+     * @note See conv_plan() and conv_run().
+     */
+    template<class T>
+    void conv2d(long long h, long long w, const T *x, long long ldx, long long nk, const T *k,
+                long long kh, long long kw, const ConvOptions &opt, T *y) {
+        std::vector<T> scratch;
+        conv_run(conv_plan(h, w, nk, k, kh, kw, opt), x, ldx, y, scratch);
+    }
+
+    /*!
+     * @brief Convolve each of the n contiguous h x w images x with the same nk kernels.
+     * @param[out] y : for each image in turn, its nk outputs of the size given by conv_axis()
+     * @note The kernels are prepared once by conv_plan(). The images are split into chunks,
+     *       at least one per thread, that run on the thread pool with their own scratch
+     *       buffer, so nothing is allocated per image; a batch smaller than the pool still
+     *       spreads each image over the threads as conv2d() does.
+     */
+    template<class T>
+    void conv_batch(long long n, long long h, long long w, const T *x, long long nk, const T *k,
+                    long long kh, long long kw, const ConvOptions &opt, T *y) {
+        if (n <= 0) return;
+        ConvPlan<T> plan = conv_plan(h, w, nk, k, kh, kw, opt);
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long chunks = std::min<long long>(n, 4LL * pool.threads());
+        long long work = n * nk * plan.out() * 2 * (plan.separable ? kh + kw : kh * kw);
+        pool.parallel_for(chunks, work, [&](long long c) {
+            std::vector<T> scratch;
+            for (long long i = n * c / chunks; i < n * (c + 1) / chunks; i++)
+                conv_run(plan, x + i * h * w, w, y + i * nk * plan.out(), scratch);
+        });
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXCONV_H
@@ -0,0 +1,812 @@
+//
+// Eigenvalue kernels: balancing, Hessenberg reduction, Francis QR and inverse iteration for
+// general matrices; tridiagonalization, divide and conquer and bisection for Hermitian ones.
+//
+
+#ifndef CPP_PROJECT_MATRIXEIGEN_H
+#define CPP_PROJECT_MATRIXEIGEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "MatrixQR.h"
+#include "ThreadPool.h"
+
+namespace kernel {
+    /*!
+     * @brief How the shifted QR iteration converged.
+     */
+    struct EigenInfo {
+        long long iterations = 0;        ///< double-shift sweeps in total
+        std::vector<int> per_eigenvalue; ///< sweeps spent before each eigenvalue deflated
+    };
+
+    /*!
+     * @brief Scale rows and columns by powers of 2 so their norms are comparable.
+     * @param[out] scale : the n factors D of the similarity D^-1 A D
+     * @note Eigenvalues are unchanged and usually more accurate afterwards.
+     */
+    inline void balance(long long n, double *a, long long lda, double *scale) {
+        const double RADIX = 2, SQRDX = RADIX * RADIX;
+        for (long long i = 0; i < n; i++) scale[i] = 1;
+        bool done = false;
+        while (!done) {
+            done = true;
+            for (long long i = 0; i < n; i++) {
+                double r = 0, c = 0;
+                for (long long j = 0; j < n; j++)
+                    if (j != i) {
+                        c += std::fabs(a[j * lda + i]);
+                        r += std::fabs(a[i * lda + j]);
+                    }
+                if (c == 0 || r == 0) continue;
+                double g = r / RADIX, f = 1, s = c + r;
+                while (c < g) f *= RADIX, c *= SQRDX;
+                g = r * RADIX;
+                while (c > g) f /= RADIX, c /= SQRDX;
+                if ((c + r) / f >= 0.95 * s) continue;
+                done = false;
+                scale[i] *= f;
+                for (long long j = 0; j < n; j++) a[i * lda + j] /= f;
+                for (long long j = 0; j < n; j++) a[j * lda + i] *= f;
+            }
+        }
+    }
+
+    /*!
+     * @brief Reduce A to upper Hessenberg form H = Q^T A Q with Householder reflectors.
+     * @param[out] tau : n - 1 reflector factors
+     * @note Reflector k is stored below the subdiagonal of column k, with v(0) = 1.
+     */
+    inline void hessenberg(long long n, double *a, long long lda, double *tau) {
+        std::vector<double> w(n);
+        for (long long k = 0; k + 1 < n; k++) {
+            double *x = a + (k + 1) * lda + k;
+            double t = tau[k] = householder(n - k - 1, x, lda);
+            if (t == 0) continue;
+            auto v = [&](long long i) { return i == k + 1 ? 1.0 : a[i * lda + k]; };
+            // A(k+1:, k+1:) = H * A(k+1:, k+1:)
+            std::fill(w.begin(), w.end(), 0.0);
+            for (long long i = k + 1; i < n; i++) {
+                double vi = v(i);
+                const double *r = a + i * lda;
+                for (long long j = k + 1; j < n; j++) w[j] += vi * r[j];
+            }
+            for (long long i = k + 1; i < n; i++) {
+                double vi = t * v(i);
+                double *r = a + i * lda;
+                for (long long j = k + 1; j < n; j++) r[j] -= vi * w[j];
+            }
+            // A(:, k+1:) = A(:, k+1:) * H
+            for (long long i = 0; i < n; i++) {
+                double *r = a + i * lda, s = 0;
+                for (long long j = k + 1; j < n; j++) s += r[j] * v(j);
+                s *= t;
+                for (long long j = k + 1; j < n; j++) r[j] -= s * v(j);
+            }
+        }
+    }
+
+    /*!
+     * @brief Eigenvalues of an upper Hessenberg matrix by Francis double-shift implicit QR.
+     * @param[in,out] a : the Hessenberg matrix, zero below the subdiagonal; destroyed
+     * @param[out] w : the n eigenvalues, a complex pair as conjugates next to each other
+     * @note The active block shrinks whenever a subdiagonal element becomes negligible, so
+     *       the iteration stops as soon as everything has deflated. Exceptional shifts
+     *       are used after 10 and 20 sweeps without deflation.
+     * @exception domain_error : an eigenvalue needs more than 30 sweeps
+     */
+    inline void hqr(long long n, double *a, long long lda, std::complex<double> *w, EigenInfo &info) {
+        const double EPS = std::numeric_limits<double>::epsilon();
+        auto A = [a, lda](long long i, long long j) -> double & { return a[i * lda + j]; };
+        info.iterations = 0;
+        info.per_eigenvalue.assign(n, 0);
+        double anorm = 0;
+        for (long long i = 0; i < n; i++)
+            for (long long j = std::max(i - 1, 0LL); j < n; j++) anorm += std::fabs(A(i, j));
+        long long nn = n - 1, l = 0;
+        double t = 0;
+        int its = 0;
+        while (nn >= 0) {
+            do {
+                for (l = nn; l > 0; l--) {
+                    double s = std::fabs(A(l - 1, l - 1)) + std::fabs(A(l, l));
+                    if (s == 0) s = anorm;
+                    if (std::fabs(A(l, l - 1)) <= EPS * s) {
+                        A(l, l - 1) = 0;
+                        break;
+                    }
+                }
+                double x = A(nn, nn);
+                if (l == nn) {
+                    info.per_eigenvalue[nn] = its;
+                    w[nn--] = x + t;
+                    its = 0;
+                    continue;
+                }
+                double y = A(nn - 1, nn - 1), ww = A(nn, nn - 1) * A(nn - 1, nn);
+                if (l == nn - 1) {
+                    double p = 0.5 * (y - x), q = p * p + ww, z = std::sqrt(std::fabs(q));
+                    x += t;
+                    if (q >= 0) {
+                        z = p + std::copysign(z, p);
+                        w[nn - 1] = w[nn] = x + z;
+                        if (z != 0) w[nn] = x - ww / z;
+                    } else {
+                        w[nn - 1] = std::complex<double>(x + p, z);
+                        w[nn] = std::complex<double>(x + p, -z);
+                    }
+                    info.per_eigenvalue[nn] = info.per_eigenvalue[nn - 1] = its;
+                    nn -= 2;
+                    its = 0;
+                    continue;
+                }
+                if (its == 30) throw std::domain_error("Eigenvalues did not converge!");
+                if (its == 10 || its == 20) {
+                    t += x;
+                    for (long long i = 0; i <= nn; i++) A(i, i) -= x;
+                    double s = std::fabs(A(nn, nn - 1)) + std::fabs(A(nn - 1, nn - 2));
+                    y = x = 0.75 * s;
+                    ww = -0.4375 * s * s;
+                }
+                ++its;
+                info.iterations++;
+                // Find where the double-shift bulge can start.
+                long long m;
+                double p = 0, q = 0, r = 0, z;
+                for (m = nn - 2; m >= l; m--) {
+                    z = A(m, m);
+                    r = x - z;
+                    double s = y - z;
+                    p = (r * s - ww) / A(m + 1, m) + A(m, m + 1);
+                    q = A(m + 1, m + 1) - z - r - s;
+                    r = A(m + 2, m + 1);
+                    s = std::fabs(p) + std::fabs(q) + std::fabs(r);
+                    p /= s, q /= s, r /= s;
+                    if (m == l) break;
+                    double u = std::fabs(A(m, m - 1)) * (std::fabs(q) + std::fabs(r));
+                    double v = std::fabs(p) * (std::fabs(A(m - 1, m - 1)) + std::fabs(z) + std::fabs(A(m + 1, m + 1)));
+                    if (u <= EPS * v) break;
+                }
+                for (long long i = m; i < nn - 1; i++) {
+                    A(i + 2, i) = 0;
+                    if (i != m) A(i + 2, i - 1) = 0;
+                }
+                // Chase the bulge down the active block.
+                for (long long k = m; k < nn; k++) {
+                    if (k != m) {
+                        p = A(k, k - 1);
+                        q = A(k + 1, k - 1);
+                        r = k + 1 != nn ? A(k + 2, k - 1) : 0;
+                        if ((x = std::fabs(p) + std::fabs(q) + std::fabs(r)) != 0) p /= x, q /= x, r /= x;
+                    }
+                    double s = std::copysign(std::sqrt(p * p + q * q + r * r), p);
+                    if (s == 0) continue;
+                    if (k == m) {
+                        if (l != m) A(k, k - 1) = -A(k, k - 1);
+                    } else {
+                        A(k, k - 1) = -s * x;
+                    }
+                    p += s;
+                    x = p / s, y = q / s, z = r / s;
+                    q /= p, r /= p;
+                    for (long long j = k; j <= nn; j++) {
+                        p = A(k, j) + q * A(k + 1, j);
+                        if (k + 1 != nn) {
+                            p += r * A(k + 2, j);
+                            A(k + 2, j) -= p * z;
+                        }
+                        A(k + 1, j) -= p * y;
+                        A(k, j) -= p * x;
+                    }
+                    long long mmin = std::min(nn, k + 3);
+                    for (long long i = l; i <= mmin; i++) {
+                        p = x * A(i, k) + y * A(i, k + 1);
+                        if (k + 1 != nn) {
+                            p += z * A(i, k + 2);
+                            A(i, k + 2) -= p * r;
+                        }
+                        A(i, k + 1) -= p * q;
+                        A(i, k) -= p;
+                    }
+                }
+            } while (nn >= 0 && l + 1 < nn);
+        }
+    }
+
+    /*!
+     * @brief Right eigenvectors of A by inverse iteration on its Hessenberg form.
+     * @param[in] a : the output of balance() and hessenberg(), reflectors still below the subdiagonal
+     * @param[in] tau, scale : the reflector factors and balancing factors of that reduction
+     * @param[in] w : k eigenvalues of A
+     * @param[out] v : n x k column-major, column j is the eigenvector of w[j] with unit 2-norm
+     *                 and its largest element real and positive
+     * @note Each eigenvalue costs one pivoted LU of the shifted Hessenberg matrix, O(n^2), and
+     *       usually a single triangular solve. A zero pivot is replaced by eps * ||H|| and
+     *       equal eigenvalues are pulled apart by the same amount, so the solve never divides
+     *       by zero. The vector is then mapped back through the reflectors and the balancing.
+     *       Eigenvalues are independent tasks on the thread pool, each writing its own column.
+     */
+    inline void eigenvectors(long long n, const double *a, long long lda, const double *tau, const double *scale,
+                             const std::complex<double> *w, long long k, std::complex<double> *v, long long ldv) {
+        typedef std::complex<double> C;
+        if (n == 0 || k == 0) return;
+        double hnorm = 0;
+        for (long long i = 0; i < n; i++) {
+            double r = 0;
+            for (long long j = std::max(i - 1, 0LL); j < n; j++) r += std::fabs(a[i * lda + j]);
+            hnorm = std::max(hnorm, r);
+        }
+        const double eps3 = std::max(hnorm, 1.0) * std::numeric_limits<double>::epsilon();
+        const double rootn = std::sqrt((double) n), growto = 0.1 / rootn, big = 1e100;
+        auto run = [&](long long e) {
+            thread_local std::vector<C> U;
+            U.resize(n * n);
+            C lambda = w[e];
+            long long copies = 0;
+            for (long long p = 0; p < e; p++)
+                if (std::abs(w[p] - w[e]) < eps3) lambda += eps3, copies++;
+            // U = H - lambda * I, factorized in place; rows k and k + 1 swap when the subdiagonal wins.
+            for (long long i = 0; i < n; i++)
+                for (long long j = std::max(i - 1, 0LL); j < n; j++) U[i * n + j] = a[i * lda + j];
+            for (long long i = 0; i < n; i++) U[i * n + i] -= lambda;
+            for (long long c = 0; c + 1 < n; c++) {
+                C *r0 = U.data() + c * n, *r1 = r0 + n;
+                if (std::abs(r1[c]) > std::abs(r0[c])) std::swap_ranges(r0 + c, r0 + n, r1 + c);
+                if (r0[c] == C()) r0[c] = eps3;
+                C mult = r1[c] / r0[c];
+                if (mult == C()) continue;
+                for (long long j = c + 1; j < n; j++) r1[j] -= mult * r0[j];
+            }
+            if (U[n * n - 1] == C()) U[n * n - 1] = eps3;
+            // Solve U x = b, changing the start vector b until x has grown enough. Copies of
+            // an eigenvalue start from pseudo-random vectors that differ in every element, so
+            // they get independent eigenvectors wherever the eigenspace has room for them.
+            C *x = v + e * ldv;
+            for (long long t = 0; t < n; t++) {
+                if (copies > 0) {
+                    uint64_t z = (uint64_t) (copies * n + t) * 0x9E3779B97F4A7C15ULL;
+                    for (long long i = 0; i < n; i++) {
+                        z += 0x9E3779B97F4A7C15ULL;
+                        uint64_t r = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                        r = (r ^ (r >> 27)) * 0x94D049BB133111EBULL;
+                        x[i] = eps3 * ((double) ((r ^ (r >> 31)) >> 11) * 0x1.0p-52 - 1.0);
+                    }
+                } else {
+                    for (long long i = 0; i < n; i++) x[i] = t == 0 ? eps3 : eps3 / (rootn + 1);
+                    if (t > 0) x[n - t] -= eps3 * rootn;
+                }
+                for (long long i = n - 1; i >= 0; i--) {
+                    const C *r = U.data() + i * n;
+                    C s = x[i];
+                    for (long long j = i + 1; j < n; j++) s -= r[j] * x[j];
+                    x[i] = s / r[i];
+                    if (std::abs(x[i]) > big)
+                        for (long long j = 0; j < n; j++) x[j] /= big;
+                }
+                double vnorm = 0;
+                for (long long i = 0; i < n; i++) vnorm += std::abs(x[i]);
+                if (vnorm >= growto) break;
+            }
+            // x = D * Q * x
+            for (long long c = n - 2; c >= 0; c--) {
+                if (tau[c] == 0) continue;
+                C s = x[c + 1];
+                for (long long i = c + 2; i < n; i++) s += a[i * lda + c] * x[i];
+                s *= tau[c];
+                x[c + 1] -= s;
+                for (long long i = c + 2; i < n; i++) x[i] -= s * a[i * lda + c];
+            }
+            long long top = 0;
+            double norm = 0;
+            for (long long i = 0; i < n; i++) {
+                x[i] *= scale[i];
+                norm += std::norm(x[i]);
+                if (std::abs(x[i]) > std::abs(x[top])) top = i;
+            }
+            C unit = std::conj(x[top]) / (std::abs(x[top]) * std::sqrt(norm));
+            for (long long i = 0; i < n; i++) x[i] *= unit;
+            x[top] = x[top].real();
+        };
+        parallel::ThreadPool::instance().parallel_for(k, 8 * k * n * n, run);
+    }
+
+    inline double conjugate(double x) {
+        return x;
+    }
+
+    template<class P>
+    std::complex<P> conjugate(const std::complex<P> &x) {
+        return std::conj(x);
+    }
+
+    /*!
+     * @brief Reduce a Hermitian matrix to real symmetric tridiagonal form T = Q^H A Q.
+     * @param[in,out] a : only the lower triangle is read; reflector k is left below the
+     *                    subdiagonal of column k, with v(0) = 1
+     * @param[out] d, e : the n diagonal and n - 1 subdiagonal elements of T
+     * @param[out] tau : n - 1 reflector factors
+     * @note Each step is one Hermitian matrix-vector product and one rank-2 update of the
+     *       trailing lower triangle, both walking the rows of a.
+     */
+    template<class S>
+    void tridiagonalize(long long n, S *a, long long lda, double *d, double *e, S *tau) {
+        // The rank-2 update of step i is applied lazily, row by row, in the same sweep that
+        // forms the matrix-vector product of step i + 1, so each step reads a only once.
+        std::vector<S> v(n), p(n), pv(n), pp(n);
+        bool pending = false;
+        for (long long i = 0; i + 1 < n; i++) {
+            if (pending)
+                for (long long r = i; r < n; r++) a[r * lda + i] -= pv[r] * conjugate(pp[i]) + pp[r] * conjugate(pv[i]);
+            d[i] = std::real(a[i * lda + i]);
+            for (long long r = i + 1; r < n; r++) v[r] = a[r * lda + i];
+            S t = tau[i] = householder(n - i - 1, v.data() + i + 1, 1LL);
+            e[i] = std::real(v[i + 1]);
+            v[i + 1] = 1;
+            for (long long r = i + 2; r < n; r++) a[r * lda + i] = v[r];
+            // p = tau * A22 * v, from the lower triangle only
+            std::fill(p.begin() + i + 1, p.end(), S());
+            for (long long r = i + 1; r < n; r++) {
+                S *row = a + r * lda;
+                if (pending) {
+                    S vr = pv[r], pr = pp[r];
+                    for (long long c = i + 1; c <= r; c++) row[c] -= vr * conjugate(pp[c]) + pr * conjugate(pv[c]);
+                }
+                if (t == S()) continue;
+                // Four partial sums keep the dot product from serializing on one accumulator.
+                S vr = v[r], sum[4] = {};
+                long long c = i + 1;
+                for (; c + 4 <= r; c += 4)
+                    for (int q = 0; q < 4; q++) {
+                        sum[q] += row[c + q] * v[c + q];
+                        p[c + q] += conjugate(row[c + q]) * vr;
+                    }
+                for (; c < r; c++) {
+                    sum[0] += row[c] * v[c];
+                    p[c] += conjugate(row[c]) * vr;
+                }
+                p[r] += (sum[0] + sum[1]) + (sum[2] + sum[3]) + std::real(row[r]) * vr;
+            }
+            pending = t != S();
+            if (!pending) continue;
+            S dot = S();
+            for (long long r = i + 1; r < n; r++) {
+                p[r] *= t;
+                dot += conjugate(p[r]) * v[r];
+            }
+            S alpha = -0.5 * t * dot;
+            for (long long r = i + 1; r < n; r++) p[r] += alpha * v[r];
+            // A22 -= v * p^H + p * v^H is left pending.
+            std::swap(pv, v);
+            std::swap(pp, p);
+        }
+        if (n == 0) return;
+        if (pending) a[(n - 1) * lda + n - 1] -= 2 * std::real(pv[n - 1] * conjugate(pp[n - 1]));
+        d[n - 1] = std::real(a[(n - 1) * lda + n - 1]);
+    }
+
+    /*!
+     * @brief Z = Q * Z for the Q of tridiagonalize(), Z being n x m.
+     */
+    template<class S>
+    void tridiagonal_back(long long n, const S *a, long long lda, const S *tau, S *z, long long m, long long ldz) {
+        std::vector<S> w(m);
+        for (long long c = n - 2; c >= 0; c--) {
+            if (tau[c] == S()) continue;
+            // w = tau * v^H * Z(c+1:, :), then Z(c+1:, :) -= v * w
+            S *z0 = z + (c + 1) * ldz;
+            std::copy(z0, z0 + m, w.begin());
+            for (long long i = c + 2; i < n; i++) {
+                S vi = conjugate(a[i * lda + c]);
+                const S *r = z + i * ldz;
+                for (long long j = 0; j < m; j++) w[j] += vi * r[j];
+            }
+            for (long long j = 0; j < m; j++) w[j] *= tau[c];
+            for (long long j = 0; j < m; j++) z0[j] -= w[j];
+            for (long long i = c + 2; i < n; i++) {
+                S vi = a[i * lda + c];
+                S *r = z + i * ldz;
+                for (long long j = 0; j < m; j++) r[j] -= vi * w[j];
+            }
+        }
+    }
+
+    /*!
+     * @brief Z = Q * Z for real matrices, with the reflectors applied blockwise as in qr_apply().
+     * @note The reflectors sit one row below the diagonal, so they form the QR factors of
+     *       the (n - 1) x (n - 1) matrix starting at row 1.
+     */
+    inline void tridiagonal_back(long long n, const double *a, long long lda, const double *tau,
+                                 double *z, long long m, long long ldz) {
+        if (n > 1) qr_apply<double>(n - 1, n - 1, a + lda, lda, tau, false, z + ldz, m, ldz);
+    }
+
+    /*!
+     * @brief Eigenpairs of a symmetric tridiagonal matrix by implicit QL with Wilkinson shifts.
+     * @param[in,out] d : the n diagonal elements, replaced by the eigenvalues in ascending order
+     * @param[in] e : the n - 1 subdiagonal elements
+     * @param[in,out] z : n x n, multiplied by the eigenvectors from the right
+     * @exception domain_error : an eigenvalue needs more than 30 sweeps
+     */
+    inline void tridiagonal_ql(long long n, double *d, const double *e, double *z, long long ldz) {
+        const double EPS = std::numeric_limits<double>::epsilon();
+        std::vector<double> f(e, e + std::max(n - 1, 0LL));
+        f.push_back(0);
+        for (long long l = 0; l < n; l++) {
+            int its = 0;
+            long long m;
+            do {
+                for (m = l; m + 1 < n; m++)
+                    if (std::fabs(f[m]) <= EPS * (std::fabs(d[m]) + std::fabs(d[m + 1]))) break;
+                if (m == l) break;
+                if (its++ == 30) throw std::domain_error("Eigenvalues did not converge!");
+                double g = (d[l + 1] - d[l]) / (2 * f[l]);
+                double r = std::hypot(g, 1.0);
+                g = d[m] - d[l] + f[l] / (g + std::copysign(r, g));
+                double s = 1, c = 1, p = 0;
+                long long i;
+                for (i = m - 1; i >= l; i--) {
+                    double ff = s * f[i], b = c * f[i];
+                    f[i + 1] = r = std::hypot(ff, g);
+                    if (r == 0) {
+                        d[i + 1] -= p;
+                        f[m] = 0;
+                        break;
+                    }
+                    s = ff / r, c = g / r;
+                    g = d[i + 1] - p;
+                    r = (d[i] - g) * s + 2 * c * b;
+                    d[i + 1] = g + (p = s * r);
+                    g = c * r - b;
+                    for (long long k = 0; k < n; k++) {
+                        double *zk = z + k * ldz;
+                        ff = zk[i + 1];
+                        zk[i + 1] = s * zk[i] + c * ff;
+                        zk[i] = c * zk[i] - s * ff;
+                    }
+                }
+                if (r == 0 && i >= l) continue;
+                d[l] -= p;
+                f[l] = g;
+                f[m] = 0;
+            } while (m != l);
+        }
+        for (long long i = 0; i + 1 < n; i++) {
+            long long j = std::min_element(d + i, d + n) - d;
+            if (j == i) continue;
+            std::swap(d[i], d[j]);
+            for (long long k = 0; k < n; k++) std::swap(z[k * ldz + i], z[k * ldz + j]);
+        }
+    }
+
+    /*!
+     * @brief Eigenpairs of D + rho * z * z^T, D diagonal with entries strictly increasing.
+     * @param[out] lambda : the k eigenvalues, lambda[j] between dl[j] and dl[j + 1]
+     * @param[out] u : k x k, column j the unit eigenvector of lambda[j]
+     * @note Each root of the secular equation 1 + rho * sum z_i^2 / (d_i - lambda) = 0 is found
+     *       by safeguarded Newton steps, as an offset from its nearer pole so that the
+     *       differences d_i - lambda are exact to working precision. z is then recomputed from
+     *       the roots (Gu and Eisenstat), which keeps the eigenvectors orthogonal even when
+     *       roots crowd together.
+     */
+    inline void secular_solve(long long k, const double *dl, const double *zl, double rho, double *lambda, double *u) {
+        const double EPS = std::numeric_limits<double>::epsilon();
+        double zz = 0;
+        for (long long i = 0; i < k; i++) zz += zl[i] * zl[i];
+        std::vector<double> delta(k * k);
+        auto root = [&](long long j) {
+            double *dj = delta.data() + j * k;
+            double origin = dl[j], lo = 0, hi = rho * zz;
+            if (j + 1 < k) {
+                double mid = (dl[j + 1] - dl[j]) / 2, f = 1;
+                for (long long i = 0; i < k; i++) f += rho * zl[i] * zl[i] / ((dl[i] - dl[j]) - mid);
+                if (f >= 0) hi = mid;
+                else origin = dl[j + 1], lo = -mid, hi = 0;
+            }
+            for (long long i = 0; i < k; i++) dj[i] = dl[i] - origin;
+            double tau = (lo + hi) / 2;
+            for (int its = 0; its < 400; its++) {
+                double f = 1, df = 0;
+                for (long long i = 0; i < k; i++) {
+                    double t = zl[i] / (dj[i] - tau);
+                    f += rho * zl[i] * t;
+                    df += rho * t * t;
+                }
+                if (f == 0) break;
+                if (f > 0) hi = tau;
+                else lo = tau;
+                double next = tau - f / df;
+                if (its % 4 == 3 || !(next > lo && next < hi)) next = lo + (hi - lo) / 2;
+                if (next == tau || hi - lo <= 2 * EPS * std::max(std::fabs(lo), std::fabs(hi))) break;
+                tau = next;
+            }
+            lambda[j] = origin + tau;
+            for (long long i = 0; i < k; i++) dj[i] -= tau;
+        };
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        pool.parallel_for(k, 40 * k * k, root);
+        std::vector<double> zh(k);
+        for (long long i = 0; i < k; i++) {
+            double w = delta[i * k + i];
+            for (long long j = 0; j < k; j++)
+                if (j != i) w *= delta[j * k + i] / (dl[i] - dl[j]);
+            zh[i] = std::copysign(std::sqrt(std::max(-w, 0.0)), zl[i]);
+        }
+        pool.parallel_for(k, 3 * k * k, [&](long long j) {
+            const double *dj = delta.data() + j * k;
+            double norm = 0;
+            for (long long i = 0; i < k; i++) norm += (zh[i] / dj[i]) * (zh[i] / dj[i]);
+            norm = std::sqrt(norm);
+            for (long long i = 0; i < k; i++) u[i * k + j] = zh[i] / dj[i] / norm;
+        });
+    }
+
+    /*!
+     * @brief Merge two solved halves of a symmetric tridiagonal matrix split by the coupling b.
+     * @param[in,out] d : eigenvalues of the halves, d[0:m) and d[m:n), both ascending
+     * @param[in,out] z : block diagonal eigenvectors of the halves, off-diagonal blocks zero
+     * @note The halves plus the coupling are D + rho * z * z^T in their eigenbasis. Entries of
+     *       z that are negligible, and pairs of nearly equal eigenvalues after a rotation,
+     *       are deflated: they keep their eigenpair. The rest go through secular_solve() and
+     *       one gemm rotates the eigenvectors into place.
+     */
+    inline void tridiagonal_merge(long long n, long long m, double b, double *d, double *z, long long ldz) {
+        const double EPS = std::numeric_limits<double>::epsilon();
+        double rho = 2 * std::fabs(b), h = std::sqrt(0.5);
+        std::vector<double> zv(n);
+        for (long long j = 0; j < m; j++) zv[j] = h * z[(m - 1) * ldz + j];
+        for (long long j = m; j < n; j++) zv[j] = std::copysign(h, b) * z[m * ldz + j];
+        std::vector<long long> order(n);
+        std::iota(order.begin(), order.end(), 0LL);
+        std::stable_sort(order.begin(), order.end(), [&](long long x, long long y) { return d[x] < d[y]; });
+        double dmax = 0, zmax = 0;
+        for (long long i = 0; i < n; i++) dmax = std::max(dmax, std::fabs(d[i])), zmax = std::max(zmax, std::fabs(zv[i]));
+        double tol = 8 * EPS * std::max(dmax, zmax);
+        std::vector<long long> keep, gone;
+        long long pj = -1;
+        for (long long nj : order) {
+            if (rho * std::fabs(zv[nj]) <= tol) {
+                gone.push_back(nj);
+                continue;
+            }
+            if (pj >= 0) {
+                double s = zv[pj], c = zv[nj], t = std::hypot(c, s);
+                c /= t, s = -s / t;
+                if (std::fabs((d[nj] - d[pj]) * c * s) <= tol) {
+                    // Rotate z(pj) into z(nj); pj keeps an eigenpair of its own.
+                    zv[nj] = t, zv[pj] = 0;
+                    for (long long i = 0; i < n; i++) {
+                        double x = z[i * ldz + pj], y = z[i * ldz + nj];
+                        z[i * ldz + pj] = c * x + s * y;
+                        z[i * ldz + nj] = c * y - s * x;
+                    }
+                    double dp = d[pj] * c * c + d[nj] * s * s;
+                    d[nj] = d[pj] * s * s + d[nj] * c * c;
+                    d[pj] = dp;
+                    gone.push_back(pj);
+                } else {
+                    keep.push_back(pj);
+                }
+            }
+            pj = nj;
+        }
+        if (pj >= 0) keep.push_back(pj);
+        std::stable_sort(keep.begin(), keep.end(), [&](long long x, long long y) { return d[x] < d[y]; });
+        long long k = (long long) keep.size();
+        std::vector<double> dl(k), zl(k), lambda(k), u(k * k), g(n * k), q(n * k);
+        for (long long j = 0; j < k; j++) dl[j] = d[keep[j]], zl[j] = zv[keep[j]];
+        secular_solve(k, dl.data(), zl.data(), rho, lambda.data(), u.data());
+        for (long long i = 0; i < n; i++)
+            for (long long j = 0; j < k; j++) g[i * k + j] = z[i * ldz + keep[j]];
+        gemm<double>(n, k, k, 1, g.data(), k, u.data(), k, 0, q.data(), k);
+        // Lay all n eigenpairs out in ascending order.
+        std::vector<std::pair<double, long long> > all;
+        for (long long j = 0; j < k; j++) all.emplace_back(lambda[j], j);
+        for (long long j : gone) all.emplace_back(d[j], -1 - j);
+        std::stable_sort(all.begin(), all.end(),
+                         [](const std::pair<double, long long> &x, const std::pair<double, long long> &y) {
+                             return x.first < y.first;
+                         });
+        std::vector<double> out(n * n);
+        for (long long c = 0; c < n; c++) {
+            long long src = all[c].second;
+            for (long long i = 0; i < n; i++)
+                out[i * n + c] = src >= 0 ? q[i * k + src] : z[i * ldz - 1 - src];
+            d[c] = all[c].first;
+        }
+        for (long long i = 0; i < n; i++) std::copy(out.begin() + i * n, out.begin() + (i + 1) * n, z + i * ldz);
+    }
+
+    /*!
+     * @brief Eigenpairs of a symmetric tridiagonal matrix by divide and conquer.
+     * @param[in,out] d : the n diagonal elements, replaced by the eigenvalues in ascending order
+     * @param[in] e : the n - 1 subdiagonal elements
+     * @param[out] z : n x n, column j the eigenvector of d[j]
+     * @note Small blocks go to tridiagonal_ql(); the two halves of a split run in parallel.
+     */
+    inline void tridiagonal_dc(long long n, double *d, const double *e, double *z, long long ldz) {
+        const long long SMALL = 32;
+        if (n <= SMALL) {
+            for (long long i = 0; i < n; i++) {
+                std::fill(z + i * ldz, z + i * ldz + n, 0.0);
+                z[i * ldz + i] = 1;
+            }
+            tridiagonal_ql(n, d, e, z, ldz);
+            return;
+        }
+        long long m = n / 2;
+        double b = e[m - 1];
+        d[m - 1] -= std::fabs(b);
+        d[m] -= std::fabs(b);
+        for (long long i = 0; i < m; i++) std::fill(z + i * ldz + m, z + i * ldz + n, 0.0);
+        for (long long i = m; i < n; i++) std::fill(z + i * ldz, z + i * ldz + m, 0.0);
+        parallel::ThreadPool::instance().parallel_for(2, n * n * n, [&](long long t) {
+            if (t == 0) tridiagonal_dc(m, d, e, z, ldz);
+            else tridiagonal_dc(n - m, d + m, e + m, z + m * ldz + m, ldz);
+        });
+        tridiagonal_merge(n, m, b, d, z, ldz);
+    }
+
+    /*!
+     * @brief Eigenvalues lo .. hi - 1 (in ascending order) of a symmetric tridiagonal matrix by bisection.
+     * @note Each one is bracketed with Sturm counts inside the Gershgorin interval.
+     */
+    inline void tridiagonal_bisect(long long n, const double *d, const double *e, long long lo, long long hi, double *w) {
+        const double EPS = std::numeric_limits<double>::epsilon();
+        double gl = d[0], gu = d[0], emax = 0;
+        for (long long i = 0; i < n; i++) {
+            double r = (i > 0 ? std::fabs(e[i - 1]) : 0) + (i + 1 < n ? std::fabs(e[i]) : 0);
+            gl = std::min(gl, d[i] - r), gu = std::max(gu, d[i] + r);
+            if (i + 1 < n) emax = std::max(emax, e[i] * e[i]);
+        }
+        double pivmin = std::numeric_limits<double>::min() * std::max(1.0, emax);
+        double pad = 2 * EPS * std::max(std::fabs(gl), std::fabs(gu)) * n + pivmin;
+        gl -= pad, gu += pad;
+        auto below = [&](double x) {
+            long long cnt = 0;
+            double q = 1;
+            for (long long i = 0; i < n; i++) {
+                q = d[i] - x - (i > 0 ? e[i - 1] * e[i - 1] / q : 0);
+                if (std::fabs(q) < pivmin) q = -pivmin;
+                if (q < 0) cnt++;
+            }
+            return cnt;
+        };
+        parallel::ThreadPool::instance().parallel_for(hi - lo, 120 * n * (hi - lo), [&](long long t) {
+            long long idx = lo + t;
+            double a = gl, b = gu;
+            while (b - a > 2 * EPS * std::max(std::fabs(a), std::fabs(b)) + pivmin) {
+                double mid = a + (b - a) / 2;
+                if (mid <= a || mid >= b) break;
+                if (below(mid) > idx) b = mid;
+                else a = mid;
+            }
+            w[t] = a + (b - a) / 2;
+        });
+    }
+
+    /*!
+     * @brief Eigenvectors of a symmetric tridiagonal matrix by inverse iteration.
+     * @param[in] w : k eigenvalues in ascending order
+     * @param[out] z : n x k, column j the unit eigenvector of w[j]
+     * @note T - w[j] * I is factorized once with partial pivoting in O(n). Eigenvalues closer
+     *       than 1e-3 * ||T|| form a cluster; its vectors are orthogonalized against each
+     *       other at every step, and equal eigenvalues are pulled apart slightly first.
+     */
+    inline void tridiagonal_inverse(long long n, const double *d, const double *e, const double *w, long long k,
+                                    double *z, long long ldz) {
+        const double EPS = std::numeric_limits<double>::epsilon();
+        double tnorm = 0;
+        for (long long i = 0; i < n; i++)
+            tnorm = std::max(tnorm, std::fabs(d[i]) + (i > 0 ? std::fabs(e[i - 1]) : 0) + (i + 1 < n ? std::fabs(e[i]) : 0));
+        double eps3 = std::max(tnorm, std::numeric_limits<double>::min()) * EPS, ortol = 1e-3 * tnorm;
+        std::vector<double> D(n), E1(n), E2(n), L(n), V(k * n);
+        std::vector<char> P(n);
+        double prev = 0;
+        long long first = 0;
+        unsigned seed = 1;
+        for (long long j = 0; j < k; j++) {
+            double lambda = w[j];
+            if (j > 0 && lambda - w[j - 1] > ortol) first = j;
+            if (j > 0 && lambda - prev < 10 * eps3) lambda = prev + 10 * eps3;
+            prev = lambda;
+            for (long long i = 0; i < n; i++) D[i] = d[i] - lambda, E1[i] = i + 1 < n ? e[i] : 0, E2[i] = 0;
+            for (long long i = 0; i + 1 < n; i++) {
+                double sub = e[i];
+                if (std::fabs(D[i]) >= std::fabs(sub)) {
+                    P[i] = 0;
+                    if (D[i] == 0) D[i] = eps3;
+                    L[i] = sub / D[i];
+                    D[i + 1] -= L[i] * E1[i];
+                } else {
+                    P[i] = 1;
+                    L[i] = D[i] / sub;
+                    double e1 = E1[i];
+                    D[i] = sub, E1[i] = D[i + 1], E2[i] = E1[i + 1];
+                    D[i + 1] = e1 - L[i] * E1[i];
+                    E1[i + 1] = -L[i] * E2[i];
+                }
+            }
+            if (D[n - 1] == 0) D[n - 1] = eps3;
+            double *x = V.data() + j * n;
+            for (long long i = 0; i < n; i++) {
+                seed = seed * 1103515245u + 12345u;
+                x[i] = (double) (seed >> 8) / (1 << 24) - 0.5;
+            }
+            for (int its = 0; its < 3; its++) {
+                if (its > 0)
+                    for (long long i = 0; i + 1 < n; i++) {
+                        if (P[i]) std::swap(x[i], x[i + 1]);
+                        x[i + 1] -= L[i] * x[i];
+                    }
+                for (long long i = n - 1; i >= 0; i--) {
+                    double s = x[i];
+                    if (i + 1 < n) s -= E1[i] * x[i + 1];
+                    if (i + 2 < n) s -= E2[i] * x[i + 2];
+                    x[i] = s / D[i];
+                }
+                for (long long p = first; p < j; p++) {
+                    const double *y = V.data() + p * n;
+                    double s = 0;
+                    for (long long i = 0; i < n; i++) s += x[i] * y[i];
+                    for (long long i = 0; i < n; i++) x[i] -= s * y[i];
+                }
+                double norm = 0;
+                for (long long i = 0; i < n; i++) norm += x[i] * x[i];
+                norm = std::sqrt(norm);
+                for (long long i = 0; i < n; i++) x[i] /= norm;
+            }
+        }
+        for (long long i = 0; i < n; i++)
+            for (long long j = 0; j < k; j++) z[i * ldz + j] = V[j * n + i];
+    }
+
+    /*!
+     * @brief The k largest eigenpairs of a Hermitian matrix.
+     * @param[in,out] a : n x n, only the lower triangle is read; destroyed
+     * @param[out] w : the k eigenvalues in descending order
+     * @param[out] z : n x k, column j the unit eigenvector of w[j] with its largest element
+     *                 real and positive
+     * @note After tridiagonalize(), all n pairs come from tridiagonal_dc(); fewer come from
+     *       bisection and inverse iteration, which only pay for the k vectors asked for.
+     */
+    template<class S>
+    void symmetric_eigen(long long n, S *a, long long lda, long long k, double *w, S *z, long long ldz) {
+        if (n == 0 || k == 0) return;
+        std::vector<double> d(n), e(n);
+        std::vector<S> tau(n);
+        tridiagonalize(n, a, lda, d.data(), e.data(), tau.data());
+        // Scale T to norm 1 so that the Sturm sequences and secular equations cannot overflow.
+        double anorm = 0;
+        for (long long i = 0; i < n; i++) anorm = std::max(anorm, std::fabs(d[i]) + (i + 1 < n ? std::fabs(e[i]) : 0));
+        if (anorm == 0) anorm = 1;
+        for (long long i = 0; i < n; i++) d[i] /= anorm, e[i] /= anorm;
+        std::vector<double> q(n * k), lambda(k);
+        if (k == n) {
+            tridiagonal_dc(n, d.data(), e.data(), q.data(), n);
+            std::copy(d.begin(), d.end(), lambda.begin());
+        } else {
+            tridiagonal_bisect(n, d.data(), e.data(), n - k, n, lambda.data());
+            tridiagonal_inverse(n, d.data(), e.data(), lambda.data(), k, q.data(), k);
+        }
+        for (long long j = 0; j < k; j++) w[j] = lambda[k - 1 - j] * anorm;
+        for (long long i = 0; i < n; i++)
+            for (long long j = 0; j < k; j++) z[i * ldz + j] = q[i * k + k - 1 - j];
+        tridiagonal_back(n, a, lda, tau.data(), z, k, ldz);
+        for (long long j = 0; j < k; j++) {
+            long long top = 0;
+            for (long long i = 1; i < n; i++)
+                if (std::abs(z[i * ldz + j]) > std::abs(z[top * ldz + j])) top = i;
+            S unit = conjugate(z[top * ldz + j]) / std::abs(z[top * ldz + j]);
+            for (long long i = 0; i < n; i++) z[i * ldz + j] *= unit;
+            z[top * ldz + j] = std::real(z[top * ldz + j]);
+        }
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXEIGEN_H
@@ -0,0 +1,510 @@
+//
+// Lazy expression templates for DenseMat arithmetic.
+//
+
+#ifndef CPP_PROJECT_MATRIXEXPR_H
+#define CPP_PROJECT_MATRIXEXPR_H
+
+#include <algorithm>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include "MatrixGemm.h"
+
+namespace dense {
+    template<class T>
+    class DenseMat;
+
+    template<class T>
+    class DenseView;
+}
+
+/*!
+ * @brief A namespace storing the lazy expressions built by DenseMat operators. \n
+ * An expression only records its operands; it is evaluated in one pass when it is
+ * assigned to a DenseMat or DenseView. Like every expression template library, an
+ * expression refers to its operands and must be consumed within the full expression
+ * that created it (do not keep it in an `auto` variable past temporaries it refers to).
+ */
+namespace expr {
+    /*!
+     * @brief CRTP base of every matrix expression, DenseMat included.
+     * @note A node E provides value_type, row(), col(), prepare(), elem(i, j), the
+     *       0-based element (i, j), and aliases(w), see Window.
+     */
+    template<class E>
+    struct Expr {
+        const E &self() const { return static_cast<const E &>(*this); }
+    };
+
+    /*!
+     * @brief The bytes spanned by a strided destination and its element layout.
+     */
+    struct Window {
+        const char *lo, *hi;
+        const void *ptr;
+        long long rows, cols, rs, cs, size;
+    };
+
+    /*!
+     * @brief The window of a rows x cols region with non-negative strides rs and cs.
+     */
+    template<class T>
+    Window window(const T *ptr, long long rows, long long cols, long long rs, long long cs) {
+        const T *last = ptr + (rows - 1) * rs + (cols - 1) * cs;
+        return {(const char *) ptr, (const char *) (last + 1), ptr, rows, cols, rs, cs, (long long) sizeof(T)};
+    }
+
+    inline bool overlap(const Window &a, const Window &b) {
+        return a.lo < b.hi && b.lo < a.hi;
+    }
+
+    inline bool same(const Window &a, const Window &b) {
+        return a.ptr == b.ptr && a.rows == b.rows && a.cols == b.cols && a.rs == b.rs && a.cs == b.cs &&
+               a.size == b.size;
+    }
+
+    /*!
+     * @brief Whether writing dst element by element may overwrite src before it is read.
+     * @note Reading and writing the same layout is safe, since element (i, j) is only
+     *       read by the pass that writes it.
+     */
+    inline bool hazard(const Window &src, const Window &dst) {
+        return !same(src, dst) && overlap(src, dst);
+    }
+
+    /*!
+     * @brief Sub-expressions are held by value, matrices by reference.
+     * @note Views are small handles, so they are held by value as well.
+     */
+    template<class E>
+    struct stored {
+        typedef const E type;
+    };
+
+    template<class T>
+    struct stored<dense::DenseMat<T> > {
+        typedef const dense::DenseMat<T> &type;
+    };
+
+    struct Add {
+        template<class A, class B>
+        static auto apply(const A &a, const B &b) { return a + b; }
+    };
+
+    struct Sub {
+        template<class A, class B>
+        static auto apply(const A &a, const B &b) { return a - b; }
+    };
+
+    struct Mul {
+        template<class A, class B>
+        static auto apply(const A &a, const B &b) { return a * b; }
+    };
+
+    /*!
+     * @brief An element-wise binary expression of two equally sized operands.
+     */
+    template<class Op, class L, class R>
+    class Binary : public Expr<Binary<Op, L, R> > {
+    public:
+        typedef typename L::value_type value_type;
+        typename stored<L>::type l;
+        typename stored<R>::type r;
+
+        Binary(const L &l, const R &r) : l(l), r(r) {
+            if (l.row() != r.row() || l.col() != r.col()) throw std::out_of_range("Row or column must be same!");
+        }
+
+        long long row() const { return l.row(); }
+
+        long long col() const { return l.col(); }
+
+        void prepare() const {
+            l.prepare();
+            r.prepare();
+        }
+
+        bool aliases(const Window &w) const { return l.aliases(w) || r.aliases(w); }
+
+        value_type elem(long long i, long long j) const { return value_type(Op::apply(l.elem(i, j), r.elem(i, j))); }
+    };
+
+    /*!
+     * @brief Multiplication or division of every element by a scalar.
+     * @note The scalar is kept as double, so integer elements are truncated the same
+     *       way as DenseMat<int> * 2.5 always did.
+     */
+    template<class E>
+    class Scale : public Expr<Scale<E> > {
+    public:
+        typedef typename E::value_type value_type;
+        typename stored<E>::type e;
+        double s;
+        bool div;
+
+        Scale(const E &e, double s, bool div) : e(e), s(s), div(div) {
+            if (div && s == 0) throw std::domain_error("0 cannot exist as a divisor!");
+        }
+
+        long long row() const { return e.row(); }
+
+        long long col() const { return e.col(); }
+
+        void prepare() const { e.prepare(); }
+
+        bool aliases(const Window &w) const { return e.aliases(w); }
+
+        value_type elem(long long i, long long j) const {
+            return div ? value_type(e.elem(i, j) / s) : value_type(e.elem(i, j) * s);
+        }
+    };
+
+    /*!
+     * @brief Element-wise negation.
+     */
+    template<class E>
+    class Neg : public Expr<Neg<E> > {
+    public:
+        typedef typename E::value_type value_type;
+        typename stored<E>::type e;
+
+        explicit Neg(const E &e) : e(e) {}
+
+        long long row() const { return e.row(); }
+
+        long long col() const { return e.col(); }
+
+        void prepare() const { e.prepare(); }
+
+        bool aliases(const Window &w) const { return e.aliases(w); }
+
+        value_type elem(long long i, long long j) const { return value_type(-e.elem(i, j)); }
+    };
+
+    /*!
+     * @brief A row-major block of a matrix: rows x cols elements, ld apart from row to row.
+     */
+    template<class T>
+    struct Panel {
+        const T *ptr = nullptr;
+        long long rows = 0, cols = 0, ld = 0;
+    };
+
+    template<class T>
+    Window window(const Panel<T> &p) {
+        return window(p.ptr, p.rows, p.cols, p.ld, 1);
+    }
+
+    /*!
+     * @brief The matrix product alpha * A * B.
+     * @note Operands that are not row-major blocks are materialized once when the
+     *       product is built. The product itself is computed by prepare(), or
+     *       directly into the destination when the whole expression is a gemm.
+     */
+    template<class T>
+    class Prod : public Expr<Prod<T> > {
+    public:
+        typedef T value_type;
+        Panel<T> A, B;
+        std::shared_ptr<const dense::DenseMat<T> > ownA, ownB;
+        double alpha = 1;
+        mutable std::shared_ptr<dense::DenseMat<T> > cache;
+
+        Prod(const Panel<T> &A, std::shared_ptr<const dense::DenseMat<T> > ownA,
+             const Panel<T> &B, std::shared_ptr<const dense::DenseMat<T> > ownB)
+                : A(A), B(B), ownA(std::move(ownA)), ownB(std::move(ownB)) {
+            if (A.cols != B.rows) throw std::domain_error("Row of right is not equal to column of left");
+        }
+
+        long long row() const { return A.rows; }
+
+        long long col() const { return B.cols; }
+
+        void prepare() const;
+
+        /*!
+         * @brief The product is complete after prepare(), before any element is written.
+         */
+        bool aliases(const Window &) const { return false; }
+
+        value_type elem(long long i, long long j) const {
+            const T &v = cache->buffer()[i * B.cols + j];
+            return alpha == 1 ? v : value_type(v * alpha);
+        }
+    };
+
+    template<class T>
+    void Prod<T>::prepare() const {
+        if (cache) return;
+        cache = std::make_shared<dense::DenseMat<T> >(A.rows, B.cols);
+        kernel::multiply<T>(A.rows, B.cols, A.cols, A.ptr, A.ld, B.ptr, B.ld, cache->buffer(), B.cols);
+    }
+
+    /*!
+     * @brief A matrix as a row-major block.
+     */
+    template<class T>
+    bool panel(const dense::DenseMat<T> &m, Panel<T> &p) {
+        p.ptr = m.buffer(), p.rows = m.row(), p.cols = m.col(), p.ld = m.col();
+        return true;
+    }
+
+    /*!
+     * @brief A view as a row-major block, possible when its columns are contiguous.
+     */
+    template<class T>
+    bool panel(const dense::DenseView<T> &v, Panel<T> &p) {
+        if (v.col_stride() != 1) return false;
+        p.ptr = v.buffer(), p.rows = v.row(), p.cols = v.col(), p.ld = v.row_stride();
+        return true;
+    }
+
+    template<class E, class T>
+    bool panel(const E &, Panel<T> &) {
+        return false;
+    }
+
+    /*!
+     * @brief Whether scaling by s inside gemm gives the same result as scaling every element.
+     * @note Integer elements truncate s * x, so only integral coefficients may be folded.
+     */
+    template<class T>
+    bool representable(double s) {
+        if constexpr (std::is_integral<T>::value) return (double) (T) s == s;
+        else return true;
+    }
+
+    /*!
+     * @brief An operand of a product: coef times a block of existing storage, or of a
+     *        materialized expression.
+     */
+    template<class T>
+    struct Operand {
+        Panel<T> p;
+        std::shared_ptr<const dense::DenseMat<T> > own;
+        double coef = 1;
+    };
+
+    template<class E>
+    Operand<typename E::value_type> materialized(const E &e) {
+        typedef typename E::value_type T;
+        Operand<T> res;
+        res.own = std::make_shared<const dense::DenseMat<T> >(e);
+        panel(*res.own, res.p);
+        return res;
+    }
+
+    template<class E>
+    Operand<typename E::value_type> operand(const E &e) {
+        Operand<typename E::value_type> res;
+        if (panel(e, res.p)) return res;
+        return materialized(e);
+    }
+
+    /*!
+     * @brief A scaled operand keeps its factor as a coefficient, folded into Prod::alpha, so
+     *        alpha * A * B, grouped as (alpha * A) * B, does not copy A.
+     * @note Division, and factors the element type cannot hold exactly, are evaluated instead.
+     */
+    template<class E>
+    Operand<typename E::value_type> operand(const Scale<E> &s) {
+        if (s.div || !representable<typename E::value_type>(s.s)) return materialized(s);
+        auto res = operand(s.e);
+        res.coef *= s.s;
+        return res;
+    }
+
+    template<class E>
+    Operand<typename E::value_type> operand(const Neg<E> &n) {
+        if (!representable<typename E::value_type>(-1)) return materialized(n);
+        auto res = operand(n.e);
+        res.coef = -res.coef;
+        return res;
+    }
+
+    /*!
+     * @brief Write e into the strided destination dst in one element-wise pass.
+     * @note Rows are split over the thread pool for large matrices of arithmetic types.
+     */
+    template<class T, class E>
+    void evaluate(const E &e, T *dst, long long rs, long long cs) {
+        long long r = e.row(), c = e.col();
+        auto rows = [&](long long lo, long long hi) {
+            for (long long i = lo; i < hi; i++) {
+                T *d = dst + i * rs;
+                if (cs == 1) for (long long j = 0; j < c; j++) d[j] = e.elem(i, j);
+                else for (long long j = 0; j < c; j++) d[j * cs] = e.elem(i, j);
+            }
+        };
+        if constexpr (kernel::blocking<T>::packed) {
+            long long step = std::max(1LL, (1LL << 16) / c);
+            parallel::ThreadPool::instance().parallel_for((r + step - 1) / step, r * c, [&](long long t) {
+                rows(t * step, std::min(r, (t + 1) * step));
+            });
+        } else {
+            rows(0, r);
+        }
+    }
+
+    template<class E, class F>
+    Binary<Add, E, F> operator+(const Expr<E> &a, const Expr<F> &b) {
+        return Binary<Add, E, F>(a.self(), b.self());
+    }
+
+    template<class E, class F>
+    Binary<Sub, E, F> operator-(const Expr<E> &a, const Expr<F> &b) {
+        return Binary<Sub, E, F>(a.self(), b.self());
+    }
+
+    template<class E>
+    Neg<E> operator-(const Expr<E> &a) {
+        return Neg<E>(a.self());
+    }
+
+    template<class E, class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+    Scale<E> operator*(const Expr<E> &a, S num) {
+        return Scale<E>(a.self(), (double) num, false);
+    }
+
+    template<class E, class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+    Scale<E> operator*(S num, const Expr<E> &a) {
+        return Scale<E>(a.self(), (double) num, false);
+    }
+
+    /*!
+     * @exception domain_error : divide the matrix by 0
+     */
+    template<class E, class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+    Scale<E> operator/(const Expr<E> &a, S num) {
+        return Scale<E>(a.self(), (double) num, true);
+    }
+
+    /*!
+     * @brief A scalar multiple of a product stays a product, so it can still map onto gemm.
+     */
+    template<class T, class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+    Prod<T> operator*(const Prod<T> &p, S num) {
+        Prod<T> res = p;
+        res.alpha *= (double) num;
+        return res;
+    }
+
+    template<class T, class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+    Prod<T> operator*(S num, const Prod<T> &p) {
+        return p * num;
+    }
+
+    /*!
+     * @brief Matrix multiplication.
+     * @note It can be used in all multiplication operation, for dot product and cross product, etc.
+     * @exception domain_error : row of right is not equal to col of left
+     */
+    template<class E, class F>
+    Prod<typename E::value_type> operator*(const Expr<E> &a, const Expr<F> &b) {
+        auto l = operand(a.self());
+        auto r = operand(b.self());
+        Prod<typename E::value_type> res(l.p, l.own, r.p, r.own);
+        res.alpha = l.coef * r.coef;
+        return res;
+    }
+
+    /*!
+     * @brief Output an expression by evaluating it first.
+     */
+    template<class E>
+    std::ostream &operator<<(std::ostream &os, const Expr<E> &e) {
+        return os << dense::DenseMat<typename E::value_type>(e.self());
+    }
+
+    /*!
+     * @brief An expression recognized as alpha * A * B + beta * C (C.ptr is null when absent).
+     */
+    template<class T>
+    struct GemmForm {
+        Panel<T> A, B, C;
+        double alpha = 1, beta = 0;
+    };
+
+    template<class E, class T>
+    bool leaf_form(const E &e, Panel<T> &C, double &coef) {
+        coef = 1;
+        return panel(e, C);
+    }
+
+    template<class E, class T>
+    bool leaf_form(const Scale<E> &s, Panel<T> &C, double &coef) {
+        coef = s.s;
+        return !s.div && panel(s.e, C);
+    }
+
+    template<class E, class T>
+    bool leaf_form(const Neg<E> &n, Panel<T> &C, double &coef) {
+        coef = -1;
+        return panel(n.e, C);
+    }
+
+    template<class E, class T>
+    bool gemm_form(const E &, GemmForm<T> &) {
+        return false;
+    }
+
+    template<class T>
+    bool gemm_form(const Prod<T> &p, GemmForm<T> &g) {
+        g = GemmForm<T>();
+        g.A = p.A, g.B = p.B, g.alpha = p.alpha;
+        return true;
+    }
+
+    template<class E, class T>
+    bool gemm_form(const Scale<E> &s, GemmForm<T> &g) {
+        if (s.div || !gemm_form(s.e, g)) return false;
+        g.alpha *= s.s, g.beta *= s.s;
+        return true;
+    }
+
+    template<class E, class T>
+    bool gemm_form(const Neg<E> &n, GemmForm<T> &g) {
+        if (!gemm_form(n.e, g)) return false;
+        g.alpha = -g.alpha, g.beta = -g.beta;
+        return true;
+    }
+
+    template<class L, class R, class T>
+    bool gemm_form(const Binary<Add, L, R> &b, GemmForm<T> &g) {
+        if (gemm_form(b.l, g) && !g.C.ptr && leaf_form(b.r, g.C, g.beta)) return true;
+        return gemm_form(b.r, g) && !g.C.ptr && leaf_form(b.l, g.C, g.beta);
+    }
+
+    template<class L, class R, class T>
+    bool gemm_form(const Binary<Sub, L, R> &b, GemmForm<T> &g) {
+        if (!gemm_form(b.l, g) || g.C.ptr || !leaf_form(b.r, g.C, g.beta)) return false;
+        g.beta = -g.beta;
+        return true;
+    }
+
+    /*!
+     * @brief Whether gemm can write straight into dst: A and B must not share its
+     *       storage, C may only be dst itself.
+     */
+    template<class T>
+    bool gemm_safe(const GemmForm<T> &g, const Window &dst) {
+        if (overlap(window(g.A), dst) || overlap(window(g.B), dst)) return false;
+        return !g.C.ptr || !hazard(window(g.C), dst);
+    }
+
+    /*!
+     * @brief Run a recognized gemm into the row-major destination dst.
+     */
+    template<class T>
+    void gemm_into(const GemmForm<T> &g, T *dst, long long ld) {
+        long long m = g.A.rows, n = g.B.cols;
+        if (g.C.ptr && !(g.C.ptr == dst && g.C.ld == ld))
+            for (long long i = 0; i < m; i++) std::copy(g.C.ptr + i * g.C.ld, g.C.ptr + i * g.C.ld + n, dst + i * ld);
+        kernel::gemm<T>(m, n, g.A.cols, (T) g.alpha, g.A.ptr, g.A.ld, g.B.ptr, g.B.ld,
+                        g.C.ptr ? (T) g.beta : T(), dst, ld);
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXEXPR_H
@@ -0,0 +1,222 @@
+//
+// Mixed-radix complex and real fast Fourier transforms with cached plans.
+//
+
+#ifndef CPP_PROJECT_MATRIXFFT_H
+#define CPP_PROJECT_MATRIXFFT_H
+
+#include <cmath>
+#include <complex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kernel {
+    /*!
+     * @brief The twiddle factors and radix factorization of a complex FFT of length n.
+     * @note n is split into radices 4, 2, 3, 5, 7, ... in that order; 4, 2 and 3 have their
+     *       own butterflies and the others share a generic O(p^2) one, so lengths made of
+     *       2s and 3s are fastest.
+     */
+    struct FftPlan {
+        long long n = 0;
+        std::vector<std::complex<double> > twiddle; ///< exp(-2 pi i k / n)
+        std::vector<long long> factors;             ///< radix p and remaining length m, pairwise
+    };
+
+    /*!
+     * @brief A real FFT of even length n, done as a complex FFT of length n / 2.
+     */
+    struct RfftPlan {
+        long long n = 0;
+        FftPlan half;
+        std::vector<std::complex<double> > super; ///< exp(-pi i ((k + 1) / (n / 2) + 1 / 2))
+    };
+
+    /*!
+     * @brief Build the plan of a complex FFT of length n.
+     */
+    inline FftPlan fft_plan(long long n) {
+        FftPlan plan;
+        plan.n = n;
+        plan.twiddle.resize(n);
+        const double PI = std::acos(-1.0);
+        for (long long k = 0; k < n; k++) plan.twiddle[k] = std::polar(1.0, -2 * PI * k / n);
+        long long p = 4, rest = n;
+        double root = std::floor(std::sqrt((double) n));
+        while (rest > 1) {
+            while (rest % p) {
+                p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+                if (p > root) p = rest;
+            }
+            rest /= p;
+            plan.factors.push_back(p);
+            plan.factors.push_back(rest);
+        }
+        return plan;
+    }
+
+    /*!
+     * @brief Build the plan of a real FFT of even length n.
+     */
+    inline RfftPlan rfft_plan(long long n) {
+        RfftPlan plan;
+        plan.n = n;
+        plan.half = fft_plan(n / 2);
+        const double PI = std::acos(-1.0);
+        for (long long k = 0; k < n / 4; k++) plan.super.push_back(std::polar(1.0, -PI * ((double) (k + 1) / (n / 2) + 0.5)));
+        return plan;
+    }
+
+    /*!
+     * @brief The shared plan of length n, built on first use and kept for the whole run.
+     * @note Safe to call from several threads; the returned reference stays valid.
+     */
+    template<class Plan, Plan (*build)(long long)>
+    const Plan &cached_plan(long long n) {
+        static std::mutex lock;
+        static std::map<long long, std::unique_ptr<Plan> > cache;
+        std::lock_guard<std::mutex> guard(lock);
+        std::unique_ptr<Plan> &slot = cache[n];
+        if (!slot) slot.reset(new Plan(build(n)));
+        return *slot;
+    }
+
+    inline const FftPlan &fft_plan_cached(long long n) {
+        return cached_plan<FftPlan, fft_plan>(n);
+    }
+
+    inline const RfftPlan &rfft_plan_cached(long long n) {
+        return cached_plan<RfftPlan, rfft_plan>(n);
+    }
+
+    /*!
+     * @brief a * b without the inf / nan recovery of operator*, which is an out-of-line call.
+     */
+    inline std::complex<double> cmul(const std::complex<double> &a, const std::complex<double> &b) {
+        return std::complex<double>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+    }
+
+    /*!
+     * @brief One decimation-in-time stage: transform the p sub-sequences, then combine them.
+     * @param[in] fstride : distance between used twiddles, and between inputs of a sub-sequence
+     */
+    inline void fft_work(const FftPlan &plan, std::complex<double> *out, const std::complex<double> *in,
+                         long long fstride, long long istride, const long long *f) {
+        typedef std::complex<double> C;
+        long long p = f[0], m = f[1];
+        C *beg = out, *end = out + p * m;
+        if (m == 1) {
+            for (; out != end; out++, in += fstride * istride) *out = *in;
+        } else {
+            for (; out != end; out += m, in += fstride * istride) fft_work(plan, out, in, fstride * p, istride, f + 2);
+        }
+        out = beg;
+        const C *tw = plan.twiddle.data();
+        if (p == 2) {
+            for (long long k = 0; k < m; k++) {
+                C t = cmul(out[m + k], tw[k * fstride]);
+                out[m + k] = out[k] - t;
+                out[k] += t;
+            }
+        } else if (p == 3) {
+            const double H = std::sqrt(0.75);
+            for (long long k = 0; k < m; k++) {
+                C t1 = cmul(out[k + m], tw[k * fstride]), t2 = cmul(out[k + 2 * m], tw[2 * k * fstride]);
+                C sum = t1 + t2, dif = t1 - t2;
+                C mid = out[k] - 0.5 * sum, rot(H * dif.imag(), -H * dif.real());
+                out[k] += sum;
+                out[k + m] = mid + rot;
+                out[k + 2 * m] = mid - rot;
+            }
+        } else if (p == 4) {
+            for (long long k = 0; k < m; k++) {
+                C s0 = cmul(out[k + m], tw[k * fstride]), s1 = cmul(out[k + 2 * m], tw[2 * k * fstride]);
+                C s2 = cmul(out[k + 3 * m], tw[3 * k * fstride]);
+                C s5 = out[k] - s1, s3 = s0 + s2, s4 = s0 - s2;
+                out[k] += s1;
+                out[k + 2 * m] = out[k] - s3;
+                out[k] += s3;
+                out[k + m] = C(s5.real() + s4.imag(), s5.imag() - s4.real());
+                out[k + 3 * m] = C(s5.real() - s4.imag(), s5.imag() + s4.real());
+            }
+        } else {
+            thread_local std::vector<C> scratch;
+            scratch.resize(p);
+            for (long long u = 0; u < m; u++) {
+                for (long long q = 0, k = u; q < p; q++, k += m) scratch[q] = out[k];
+                for (long long q1 = 0, k = u; q1 < p; q1++, k += m) {
+                    long long idx = 0;
+                    C sum = scratch[0];
+                    for (long long q = 1; q < p; q++) {
+                        idx += fstride * k;
+                        if (idx >= plan.n) idx -= plan.n;
+                        sum += cmul(scratch[q], tw[idx]);
+                    }
+                    out[k] = sum;
+                }
+            }
+        }
+    }
+
+    /*!
+     * @brief out = DFT(in), out[k] = sum in[j] * exp(-2 pi i j k / n).
+     * @param[in] istride : distance between consecutive inputs
+     * @note in and out must not overlap.
+     */
+    inline void fft(const FftPlan &plan, const std::complex<double> *in, std::complex<double> *out, long long istride = 1) {
+        if (plan.n == 1) out[0] = in[0];
+        else if (plan.n > 1) fft_work(plan, out, in, 1, istride, plan.factors.data());
+    }
+
+    /*!
+     * @brief out = n * IDFT(in), the unnormalized inverse, computed as conj(DFT(conj(in))).
+     * @param[in,out] in : conjugated on the way, so its content is lost
+     */
+    inline void ifft(const FftPlan &plan, std::complex<double> *in, std::complex<double> *out) {
+        for (long long k = 0; k < plan.n; k++) in[k] = std::conj(in[k]);
+        fft(plan, in, out);
+        for (long long k = 0; k < plan.n; k++) out[k] = std::conj(out[k]);
+    }
+
+    /*!
+     * @brief The first n / 2 + 1 DFT coefficients of the n real values x; the others are conjugates.
+     */
+    inline void rfft(const RfftPlan &plan, const double *x, std::complex<double> *X) {
+        typedef std::complex<double> C;
+        long long h = plan.n / 2;
+        thread_local std::vector<C> z;
+        z.resize(h);
+        // x seen as h complex values x[2j] + i x[2j+1]
+        fft(plan.half, reinterpret_cast<const C *>(x), z.data());
+        X[0] = z[0].real() + z[0].imag();
+        X[h] = z[0].real() - z[0].imag();
+        for (long long k = 1; k <= h / 2; k++) {
+            C fpk = z[k], fpnk = std::conj(z[h - k]);
+            C f1k = fpk + fpnk, t = cmul(fpk - fpnk, plan.super[k - 1]);
+            X[k] = 0.5 * (f1k + t);
+            X[h - k] = 0.5 * std::conj(f1k - t);
+        }
+    }
+
+    /*!
+     * @brief x = n * IDFT(X) for the n / 2 + 1 coefficients of a real sequence, unnormalized.
+     */
+    inline void irfft(const RfftPlan &plan, const std::complex<double> *X, double *x) {
+        typedef std::complex<double> C;
+        long long h = plan.n / 2;
+        thread_local std::vector<C> z;
+        z.resize(h);
+        z[0] = C(X[0].real() + X[h].real(), X[0].real() - X[h].real());
+        for (long long k = 1; k <= h / 2; k++) {
+            C fk = X[k], fnkc = std::conj(X[h - k]);
+            C fek = fk + fnkc, fok = cmul(fk - fnkc, std::conj(plan.super[k - 1]));
+            z[k] = fek + fok;
+            z[h - k] = std::conj(fek - fok);
+        }
+        ifft(plan.half, z.data(), reinterpret_cast<C *>(x));
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXFFT_H
@@ -0,0 +1,390 @@
+//
+// Fixed-size small matrices with inline storage and unrolled arithmetic.
+//
+
+#ifndef CPP_PROJECT_MATRIXFIXED_H
+#define CPP_PROJECT_MATRIXFIXED_H
+
+#include <complex>
+#include <cstddef>
+#include <initializer_list>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "MatrixGemm.h"
+
+namespace kernel {
+    /*!
+     * @brief f(std::integral_constant<std::size_t, I>()) for I = 0 ... N - 1, expanded at compile time.
+     */
+    template<class F, std::size_t... I>
+    constexpr void unroll(F &&f, std::index_sequence<I...>) {
+        (f(std::integral_constant<std::size_t, I>()), ...);
+    }
+
+    template<std::size_t N, class F>
+    constexpr void unroll(F &&f) {
+        unroll(f, std::make_index_sequence<N>());
+    }
+
+    /*!
+     * @brief Pivot magnitude usable in constant expressions, |re| + |im| for complex values.
+     */
+    template<class S>
+    constexpr S fixed_magnitude(const S &x) {
+        return x < S() ? -x : x;
+    }
+
+    template<class P>
+    constexpr P fixed_magnitude(const std::complex<P> &x) {
+        return fixed_magnitude(x.real()) + fixed_magnitude(x.imag());
+    }
+
+#ifdef MATRIX_USE_AVX2
+    /*!
+     * @brief c = a * b for row-major 4 x 4 floats: each row of c is a combination of the rows of b.
+     */
+    inline void fixed_mul4(const float *a, const float *b, float *c) {
+        __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8), b3 = _mm_loadu_ps(b + 12);
+        for (int i = 0; i < 4; i++) {
+            __m128 r = _mm_mul_ps(_mm_set1_ps(a[4 * i]), b0);
+            r = _mm_fmadd_ps(_mm_set1_ps(a[4 * i + 1]), b1, r);
+            r = _mm_fmadd_ps(_mm_set1_ps(a[4 * i + 2]), b2, r);
+            r = _mm_fmadd_ps(_mm_set1_ps(a[4 * i + 3]), b3, r);
+            _mm_storeu_ps(c + 4 * i, r);
+        }
+    }
+#endif
+}
+
+namespace dense {
+    /*!
+     * @brief An R x C matrix stored inline, row by row, for small sizes known at compile time.
+     * @note No heap, no virtual functions and no size checks at run time: element-wise
+     *       operations and products are unrolled over the fixed sizes, and everything but
+     *       get() / set() and the throwing paths can run in constant expressions.
+     *       DenseMat converts from it, and from() converts back.
+     */
+    template<class T, int R, int C>
+    class FixedMat {
+        static_assert(R > 0 && C > 0, "A fixed matrix needs positive sizes!");
+
+    private:
+        alignas(sizeof(T) * R * C % 16 == 0 ? 16 : alignof(T)) T a[R * C];
+
+    public:
+        typedef T value_type;
+
+        /*!
+         * @brief A zero matrix.
+         */
+        constexpr FixedMat() : a() {}
+
+        /*!
+         * @brief Fill the matrix row by row; missing values are 0.
+         * @exception length_error : more than R * C values
+         */
+        constexpr FixedMat(std::initializer_list<T> v) : a() {
+            if (v.size() > (std::size_t) (R * C)) throw std::length_error("Too many values for the matrix!");
+            int k = 0;
+            for (const T &x : v) a[k++] = x;
+        }
+
+        /*!
+         * @brief Fill every element with num; FixedMat{num} is a list of one value instead.
+         */
+        constexpr explicit FixedMat(T num) : a() {
+            kernel::unroll<R * C>([&](auto k) { a[k] = num; });
+        }
+
+        static constexpr FixedMat identity() {
+            FixedMat r;
+            kernel::unroll<(R < C ? R : C)>([&](auto i) { r.a[i * C + i] = T(1); });
+            return r;
+        }
+
+        /*!
+         * @brief Copy a DenseMat, DenseView or other matrix with row(), col() and a 0-based elem().
+         * @exception out_of_range : the sizes are not R x C
+         */
+        template<class M>
+        static FixedMat from(const M &m) {
+            if (m.row() != R || m.col() != C) throw std::out_of_range("Row or column must be same!");
+            FixedMat r;
+            for (int i = 0; i < R; i++)
+                for (int j = 0; j < C; j++) r.a[i * C + j] = m.elem(i, j);
+            return r;
+        }
+
+        static constexpr long long row() { return R; }
+
+        static constexpr long long col() { return C; }
+
+        /*!
+         * @brief The 0-based element (i, j), unchecked.
+         */
+        constexpr T &operator()(int i, int j) { return a[i * C + j]; }
+
+        constexpr const T &operator()(int i, int j) const { return a[i * C + j]; }
+
+        constexpr const T &elem(long long i, long long j) const { return a[i * C + j]; }
+
+        T *buffer() { return a; }
+
+        const T *buffer() const { return a; }
+
+        /*!
+         * @brief The same as DenseMat::get(), 1-based and checked.
+         * @exception out_of_range : row or col be too small or too large
+         */
+        T get(long long i, long long j) const {
+            if (i <= 0 || j <= 0 || i > R || j > C) throw std::out_of_range("Row or column be out of range!");
+            return a[(i - 1) * C + j - 1];
+        }
+
+        void set(long long i, long long j, T v) {
+            if (i <= 0 || j <= 0 || i > R || j > C) throw std::out_of_range("Row or column be out of range!");
+            a[(i - 1) * C + j - 1] = v;
+        }
+
+        constexpr FixedMat &operator+=(const FixedMat &p) {
+            kernel::unroll<R * C>([&](auto k) { a[k] += p.a[k]; });
+            return *this;
+        }
+
+        constexpr FixedMat &operator-=(const FixedMat &p) {
+            kernel::unroll<R * C>([&](auto k) { a[k] -= p.a[k]; });
+            return *this;
+        }
+
+        constexpr FixedMat &operator*=(T num) {
+            kernel::unroll<R * C>([&](auto k) { a[k] *= num; });
+            return *this;
+        }
+
+        /*!
+         * @exception domain_error : divide the matrix by 0
+         */
+        constexpr FixedMat &operator/=(T num) {
+            if (num == T()) throw std::domain_error("0 cannot exist as a divisor!");
+            kernel::unroll<R * C>([&](auto k) { a[k] /= num; });
+            return *this;
+        }
+
+        constexpr FixedMat operator+(const FixedMat &p) const { return FixedMat(*this) += p; }
+
+        constexpr FixedMat operator-(const FixedMat &p) const { return FixedMat(*this) -= p; }
+
+        constexpr FixedMat operator-() const {
+            FixedMat r;
+            kernel::unroll<R * C>([&](auto k) { r.a[k] = -a[k]; });
+            return r;
+        }
+
+        constexpr FixedMat operator*(T num) const { return FixedMat(*this) *= num; }
+
+        friend constexpr FixedMat operator*(T num, const FixedMat &p) { return p * num; }
+
+        constexpr FixedMat operator/(T num) const { return FixedMat(*this) /= num; }
+
+        constexpr FixedMat element_wise_multi(const FixedMat &p) const {
+            FixedMat r;
+            kernel::unroll<R * C>([&](auto k) { r.a[k] = a[k] * p.a[k]; });
+            return r;
+        }
+
+        constexpr bool operator==(const FixedMat &p) const {
+            for (int k = 0; k < R * C; k++)
+                if (!(a[k] == p.a[k])) return false;
+            return true;
+        }
+
+        constexpr bool operator!=(const FixedMat &p) const { return !(*this == p); }
+
+        constexpr FixedMat<T, C, R> trans() const {
+            FixedMat<T, C, R> r;
+            kernel::unroll<R * C>([&](auto k) { r(k % C, k / C) = a[k]; });
+            return r;
+        }
+
+        constexpr T trace() const {
+            static_assert(R == C, "Row and column must be same!");
+            T s = T();
+            kernel::unroll<R>([&](auto i) { s += a[i * C + i]; });
+            return s;
+        }
+
+        constexpr T det() const;
+
+        constexpr FixedMat inverse() const;
+
+        friend std::ostream &operator<<(std::ostream &os, const FixedMat &c) {
+            for (int i = 0; i < R; i++) {
+                os << "(";
+                for (int j = 0; j < C; j++) {
+                    os << std::setw(10) << c.a[i * C + j];
+                    if (j != C - 1) os << ",";
+                }
+                os << ")\n";
+            }
+            return os;
+        }
+    };
+
+    /*!
+     * @brief The matrix product, unrolled over all R * K * C terms.
+     * @note 4 x 4 floats use an FMA kernel outside constant evaluation.
+     */
+    template<class T, int R, int K, int C>
+    constexpr FixedMat<T, R, C> operator*(const FixedMat<T, R, K> &a, const FixedMat<T, K, C> &b) {
+        FixedMat<T, R, C> r;
+#ifdef MATRIX_USE_AVX2
+        if constexpr (std::is_same<T, float>::value && R == 4 && K == 4 && C == 4) {
+            if (!__builtin_is_constant_evaluated()) {
+                kernel::fixed_mul4(a.buffer(), b.buffer(), r.buffer());
+                return r;
+            }
+        }
+#endif
+        kernel::unroll<R * C>([&](auto ij) {
+            T s = T();
+            kernel::unroll<K>([&](auto k) { s += a(ij / C, k) * b(k, ij % C); });
+            r(ij / C, ij % C) = s;
+        });
+        return r;
+    }
+
+    /*!
+     * @brief The determinant, in closed form up to 4 x 4.
+     * @note Larger matrices use Gaussian elimination with partial pivoting, or the
+     *       fraction-free Bareiss elimination for integers, which stays exact.
+     */
+    template<class T, int R, int C>
+    constexpr T FixedMat<T, R, C>::det() const {
+        static_assert(R == C, "Row and column must be same!");
+        const T *m = a;
+        if constexpr (R == 1) {
+            return m[0];
+        } else if constexpr (R == 2) {
+            return m[0] * m[3] - m[1] * m[2];
+        } else if constexpr (R == 3) {
+            return m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) +
+                   m[2] * (m[3] * m[7] - m[4] * m[6]);
+        } else if constexpr (R == 4) {
+            // 2 x 2 minors of the top rows (s) and the bottom rows (c), as in inverse()
+            T s0 = m[0] * m[5] - m[4] * m[1], s1 = m[0] * m[6] - m[4] * m[2], s2 = m[0] * m[7] - m[4] * m[3];
+            T s3 = m[1] * m[6] - m[5] * m[2], s4 = m[1] * m[7] - m[5] * m[3], s5 = m[2] * m[7] - m[6] * m[3];
+            T c5 = m[10] * m[15] - m[14] * m[11], c4 = m[9] * m[15] - m[13] * m[11], c3 = m[9] * m[14] - m[13] * m[10];
+            T c2 = m[8] * m[15] - m[12] * m[11], c1 = m[8] * m[14] - m[12] * m[10], c0 = m[8] * m[13] - m[12] * m[9];
+            return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        } else {
+            FixedMat w(*this);
+            T d = T(1), prev = T(1);
+            for (int k = 0; k < R; k++) {
+                int p = k;
+                for (int i = k + 1; i < R; i++) {
+                    if (kernel::fixed_magnitude(w.a[i * C + k]) > kernel::fixed_magnitude(w.a[p * C + k])) p = i;
+                }
+                if (w.a[p * C + k] == T()) return T();
+                if (p != k) {
+                    for (int j = 0; j < C; j++) {
+                        T t = w.a[k * C + j];
+                        w.a[k * C + j] = w.a[p * C + j], w.a[p * C + j] = t;
+                    }
+                    d = -d;
+                }
+                T pivot = w.a[k * C + k];
+                for (int i = k + 1; i < R; i++)
+                    if constexpr (std::is_integral<T>::value) {
+                        for (int j = k + 1; j < C; j++)
+                            w.a[i * C + j] = (w.a[i * C + j] * pivot - w.a[i * C + k] * w.a[k * C + j]) / prev;
+                    } else {
+                        T f = w.a[i * C + k] / pivot;
+                        for (int j = k + 1; j < C; j++) w.a[i * C + j] -= f * w.a[k * C + j];
+                    }
+                if constexpr (std::is_integral<T>::value) prev = pivot;
+                else d *= pivot;
+            }
+            if constexpr (std::is_integral<T>::value) return d * w.a[R * C - 1];
+            else return d;
+        }
+    }
+
+    /*!
+     * @brief The inverse, by the adjugate up to 4 x 4 and Gauss-Jordan elimination above.
+     * @exception out_of_range : the matrix is irreversible
+     */
+    template<class T, int R, int C>
+    constexpr FixedMat<T, R, C> FixedMat<T, R, C>::inverse() const {
+        static_assert(R == C, "Row and column must be same!");
+        static_assert(!std::is_integral<T>::value, "The inverse needs a floating-point element type!");
+        const T *m = a;
+        FixedMat r;
+        T *b = r.a;
+        if constexpr (R <= 4) {
+            T d = det();
+            if (d == T()) throw std::out_of_range("Matrix is irreversible!");
+            T inv = T(1) / d;
+            if constexpr (R == 1) {
+                b[0] = inv;
+            } else if constexpr (R == 2) {
+                b[0] = m[3] * inv, b[1] = -m[1] * inv, b[2] = -m[2] * inv, b[3] = m[0] * inv;
+            } else if constexpr (R == 3) {
+                b[0] = (m[4] * m[8] - m[5] * m[7]) * inv, b[1] = (m[2] * m[7] - m[1] * m[8]) * inv;
+                b[2] = (m[1] * m[5] - m[2] * m[4]) * inv, b[3] = (m[5] * m[6] - m[3] * m[8]) * inv;
+                b[4] = (m[0] * m[8] - m[2] * m[6]) * inv, b[5] = (m[2] * m[3] - m[0] * m[5]) * inv;
+                b[6] = (m[3] * m[7] - m[4] * m[6]) * inv, b[7] = (m[1] * m[6] - m[0] * m[7]) * inv;
+                b[8] = (m[0] * m[4] - m[1] * m[3]) * inv;
+            } else {
+                T s0 = m[0] * m[5] - m[4] * m[1], s1 = m[0] * m[6] - m[4] * m[2], s2 = m[0] * m[7] - m[4] * m[3];
+                T s3 = m[1] * m[6] - m[5] * m[2], s4 = m[1] * m[7] - m[5] * m[3], s5 = m[2] * m[7] - m[6] * m[3];
+                T c5 = m[10] * m[15] - m[14] * m[11], c4 = m[9] * m[15] - m[13] * m[11], c3 = m[9] * m[14] - m[13] * m[10];
+                T c2 = m[8] * m[15] - m[12] * m[11], c1 = m[8] * m[14] - m[12] * m[10], c0 = m[8] * m[13] - m[12] * m[9];
+                b[0] = (m[5] * c5 - m[6] * c4 + m[7] * c3) * inv;
+                b[1] = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * inv;
+                b[2] = (m[13] * s5 - m[14] * s4 + m[15] * s3) * inv;
+                b[3] = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * inv;
+                b[4] = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * inv;
+                b[5] = (m[0] * c5 - m[2] * c2 + m[3] * c1) * inv;
+                b[6] = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * inv;
+                b[7] = (m[8] * s5 - m[10] * s2 + m[11] * s1) * inv;
+                b[8] = (m[4] * c4 - m[5] * c2 + m[7] * c0) * inv;
+                b[9] = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * inv;
+                b[10] = (m[12] * s4 - m[13] * s2 + m[15] * s0) * inv;
+                b[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * inv;
+                b[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * inv;
+                b[13] = (m[0] * c3 - m[1] * c1 + m[2] * c0) * inv;
+                b[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * inv;
+                b[15] = (m[8] * s3 - m[9] * s1 + m[10] * s0) * inv;
+            }
+        } else {
+            FixedMat w(*this);
+            r = identity();
+            for (int k = 0; k < R; k++) {
+                int p = k;
+                for (int i = k + 1; i < R; i++) {
+                    if (kernel::fixed_magnitude(w.a[i * C + k]) > kernel::fixed_magnitude(w.a[p * C + k])) p = i;
+                }
+                if (w.a[p * C + k] == T()) throw std::out_of_range("Matrix is irreversible!");
+                for (int j = 0; j < C && p != k; j++) {
+                    T t = w.a[k * C + j];
+                    w.a[k * C + j] = w.a[p * C + j], w.a[p * C + j] = t;
+                    t = b[k * C + j];
+                    b[k * C + j] = b[p * C + j], b[p * C + j] = t;
+                }
+                T inv = T(1) / w.a[k * C + k];
+                for (int j = 0; j < C; j++) w.a[k * C + j] *= inv, b[k * C + j] *= inv;
+                for (int i = 0; i < R; i++) {
+                    T f = w.a[i * C + k];
+                    if (i == k || f == T()) continue;
+                    for (int j = 0; j < C; j++) w.a[i * C + j] -= f * w.a[k * C + j], b[i * C + j] -= f * b[k * C + j];
+                }
+            }
+        }
+        return r;
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXFIXED_H
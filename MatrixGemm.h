@@ -0,0 +1,371 @@
+//
+// Packed, cache-blocked matrix multiplication kernels used by DenseMat.
+//
+
+#ifndef CPP_PROJECT_MATRIXGEMM_H
+#define CPP_PROJECT_MATRIXGEMM_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include "ThreadPool.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define MATRIX_USE_AVX2 1
+#endif
+
+/*!
+ * @brief A namespace storing the raw-buffer kernels behind DenseMat. \n
+ * All matrices here are row-major with an explicit leading dimension.
+ */
+namespace kernel {
+    template<class T>
+    struct is_complex : std::false_type {
+    };
+
+    template<class P>
+    struct is_complex<std::complex<P> > : std::true_type {
+    };
+
+    /*!
+     * @brief Register and cache blocking of the packed gemm for type T.
+     * @note MR x NR is the register tile, KC x NR the B sliver kept in L1,
+     *       MC x KC the packed A block kept in L2 and KC x NC the packed B panel.
+     */
+    template<class T>
+    struct blocking {
+        static constexpr bool packed = std::is_arithmetic<T>::value || is_complex<T>::value;
+        static constexpr int MR = 4, NR = 4, KC = 128, MC = 64, NC = 1024;
+    };
+
+    template<>
+    struct blocking<double> {
+        static constexpr bool packed = true;
+        static constexpr int MR = 6, NR = 8, KC = 256, MC = 96, NC = 2048;
+    };
+
+    template<>
+    struct blocking<float> {
+        static constexpr bool packed = true;
+        static constexpr int MR = 6, NR = 16, KC = 256, MC = 144, NC = 4096;
+    };
+
+    template<>
+    struct blocking<int> {
+        static constexpr bool packed = true;
+        static constexpr int MR = 6, NR = 16, KC = 256, MC = 144, NC = 4096;
+    };
+
+    /*!
+     * @brief A growable 64-byte aligned scratch buffer for packed panels.
+     */
+    template<class T>
+    class aligned_buffer {
+    private:
+        T *ptr = nullptr;
+        size_t cap = 0;
+
+        void release() {
+            if (ptr) ::operator delete(ptr, std::align_val_t(64));
+            ptr = nullptr;
+            cap = 0;
+        }
+
+    public:
+        aligned_buffer() = default;
+
+        aligned_buffer(const aligned_buffer &) = delete;
+
+        aligned_buffer &operator=(const aligned_buffer &) = delete;
+
+        ~aligned_buffer() { release(); }
+
+        T *reserve(size_t n) {
+            if (n > cap) {
+                release();
+                ptr = static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(64)));
+                cap = n;
+            }
+            return ptr;
+        }
+    };
+
+    /*!
+     * @brief Pack rows [0,mc) x cols [0,kc) of A into MR-row slivers scaled by alpha.
+     * @note Rows past mc are padded with zero so the micro-kernel never branches.
+     */
+    template<class T>
+    void pack_a(long long mc, long long kc, T alpha, const T *A, long long lda, T *Ap) {
+        constexpr int MR = blocking<T>::MR;
+        const bool scale = !(alpha == T(1));
+        for (long long i = 0; i < mc; i += MR, Ap += MR * kc) {
+            int mr = (int) std::min<long long>(MR, mc - i);
+            for (int r = 0; r < mr; r++) {
+                const T *a = A + (i + r) * lda;
+                if (scale) for (long long p = 0; p < kc; p++) Ap[p * MR + r] = alpha * a[p];
+                else for (long long p = 0; p < kc; p++) Ap[p * MR + r] = a[p];
+            }
+            for (int r = mr; r < MR; r++)
+                for (long long p = 0; p < kc; p++) Ap[p * MR + r] = T();
+        }
+    }
+
+    /*!
+     * @brief Pack rows [0,kc) x cols [0,nc) of B into NR-column slivers.
+     */
+    template<class T>
+    void pack_b(long long kc, long long nc, const T *B, long long ldb, T *Bp) {
+        constexpr int NR = blocking<T>::NR;
+        for (long long j = 0; j < nc; j += NR, Bp += NR * kc) {
+            int nr = (int) std::min<long long>(NR, nc - j);
+            for (long long p = 0; p < kc; p++) {
+                const T *b = B + p * ldb + j;
+                T *dst = Bp + p * NR;
+                for (int c = 0; c < nr; c++) dst[c] = b[c];
+                for (int c = nr; c < NR; c++) dst[c] = T();
+            }
+        }
+    }
+
+    /*!
+     * @brief Add a full MR x NR register tile to the mr x nr corner of C.
+     */
+    template<class T>
+    inline void store_tile(const T *tile, T *C, long long ldc, int mr, int nr) {
+        constexpr int NR = blocking<T>::NR;
+        for (int i = 0; i < mr; i++) {
+            T *c = C + i * ldc;
+            for (int j = 0; j < nr; j++) c[j] += tile[i * NR + j];
+        }
+    }
+
+    /*!
+     * @brief Portable micro-kernel: C[0:mr,0:nr] += Ap * Bp over kc steps.
+     */
+    template<class T>
+    struct micro_kernel {
+        static void run(long long kc, const T *a, const T *b, T *C, long long ldc, int mr, int nr) {
+            constexpr int MR = blocking<T>::MR, NR = blocking<T>::NR;
+            T tile[MR * NR];
+            for (int i = 0; i < MR * NR; i++) tile[i] = T();
+            for (long long p = 0; p < kc; p++, a += MR, b += NR)
+                for (int i = 0; i < MR; i++) {
+                    T ai = a[i];
+                    for (int j = 0; j < NR; j++) tile[i * NR + j] += ai * b[j];
+                }
+            store_tile(tile, C, ldc, mr, nr);
+        }
+    };
+
+#ifdef MATRIX_USE_AVX2
+#define GEMM_ROW_PD(r) { \
+        __m256d ar = _mm256_broadcast_sd(a + r); \
+        c##r##0 = _mm256_fmadd_pd(ar, b0, c##r##0); \
+        c##r##1 = _mm256_fmadd_pd(ar, b1, c##r##1); }
+
+    template<>
+    struct micro_kernel<double> {
+        static void run(long long kc, const double *a, const double *b, double *C, long long ldc, int mr, int nr) {
+            __m256d c00 = _mm256_setzero_pd(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00,
+                    c30 = c00, c31 = c00, c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+            for (long long p = 0; p < kc; p++, a += 6, b += 8) {
+                __m256d b0 = _mm256_load_pd(b), b1 = _mm256_load_pd(b + 4);
+                GEMM_ROW_PD(0) GEMM_ROW_PD(1) GEMM_ROW_PD(2)
+                GEMM_ROW_PD(3) GEMM_ROW_PD(4) GEMM_ROW_PD(5)
+            }
+            alignas(32) double tile[48];
+            _mm256_store_pd(tile, c00), _mm256_store_pd(tile + 4, c01);
+            _mm256_store_pd(tile + 8, c10), _mm256_store_pd(tile + 12, c11);
+            _mm256_store_pd(tile + 16, c20), _mm256_store_pd(tile + 20, c21);
+            _mm256_store_pd(tile + 24, c30), _mm256_store_pd(tile + 28, c31);
+            _mm256_store_pd(tile + 32, c40), _mm256_store_pd(tile + 36, c41);
+            _mm256_store_pd(tile + 40, c50), _mm256_store_pd(tile + 44, c51);
+            store_tile(tile, C, ldc, mr, nr);
+        }
+    };
+
+#undef GEMM_ROW_PD
+#define GEMM_ROW_PS(r) { \
+        __m256 ar = _mm256_broadcast_ss(a + r); \
+        c##r##0 = _mm256_fmadd_ps(ar, b0, c##r##0); \
+        c##r##1 = _mm256_fmadd_ps(ar, b1, c##r##1); }
+
+    template<>
+    struct micro_kernel<float> {
+        static void run(long long kc, const float *a, const float *b, float *C, long long ldc, int mr, int nr) {
+            __m256 c00 = _mm256_setzero_ps(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00,
+                    c30 = c00, c31 = c00, c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+            for (long long p = 0; p < kc; p++, a += 6, b += 16) {
+                __m256 b0 = _mm256_load_ps(b), b1 = _mm256_load_ps(b + 8);
+                GEMM_ROW_PS(0) GEMM_ROW_PS(1) GEMM_ROW_PS(2)
+                GEMM_ROW_PS(3) GEMM_ROW_PS(4) GEMM_ROW_PS(5)
+            }
+            alignas(32) float tile[96];
+            _mm256_store_ps(tile, c00), _mm256_store_ps(tile + 8, c01);
+            _mm256_store_ps(tile + 16, c10), _mm256_store_ps(tile + 24, c11);
+            _mm256_store_ps(tile + 32, c20), _mm256_store_ps(tile + 40, c21);
+            _mm256_store_ps(tile + 48, c30), _mm256_store_ps(tile + 56, c31);
+            _mm256_store_ps(tile + 64, c40), _mm256_store_ps(tile + 72, c41);
+            _mm256_store_ps(tile + 80, c50), _mm256_store_ps(tile + 88, c51);
+            store_tile(tile, C, ldc, mr, nr);
+        }
+    };
+
+#undef GEMM_ROW_PS
+#define GEMM_ROW_EPI32(r) { \
+        __m256i ar = _mm256_set1_epi32(a[r]); \
+        c##r##0 = _mm256_add_epi32(c##r##0, _mm256_mullo_epi32(ar, b0)); \
+        c##r##1 = _mm256_add_epi32(c##r##1, _mm256_mullo_epi32(ar, b1)); }
+
+    template<>
+    struct micro_kernel<int> {
+        static void run(long long kc, const int *a, const int *b, int *C, long long ldc, int mr, int nr) {
+            __m256i c00 = _mm256_setzero_si256(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00,
+                    c30 = c00, c31 = c00, c40 = c00, c41 = c00, c50 = c00, c51 = c00;
+            for (long long p = 0; p < kc; p++, a += 6, b += 16) {
+                __m256i b0 = _mm256_load_si256((const __m256i *) b);
+                __m256i b1 = _mm256_load_si256((const __m256i *) (b + 8));
+                GEMM_ROW_EPI32(0) GEMM_ROW_EPI32(1) GEMM_ROW_EPI32(2)
+                GEMM_ROW_EPI32(3) GEMM_ROW_EPI32(4) GEMM_ROW_EPI32(5)
+            }
+            alignas(32) int tile[96];
+            __m256i *t = (__m256i *) tile;
+            _mm256_store_si256(t, c00), _mm256_store_si256(t + 1, c01);
+            _mm256_store_si256(t + 2, c10), _mm256_store_si256(t + 3, c11);
+            _mm256_store_si256(t + 4, c20), _mm256_store_si256(t + 5, c21);
+            _mm256_store_si256(t + 6, c30), _mm256_store_si256(t + 7, c31);
+            _mm256_store_si256(t + 8, c40), _mm256_store_si256(t + 9, c41);
+            _mm256_store_si256(t + 10, c50), _mm256_store_si256(t + 11, c51);
+            store_tile(tile, C, ldc, mr, nr);
+        }
+    };
+
+#undef GEMM_ROW_EPI32
+#endif
+
+    /*!
+     * @brief Multiply the packed A block by the packed B panel into C.
+     */
+    template<class T>
+    void macro_kernel(long long mc, long long nc, long long kc, const T *Ap, const T *Bp, T *C, long long ldc) {
+        constexpr int MR = blocking<T>::MR, NR = blocking<T>::NR;
+        for (long long j = 0; j < nc; j += NR) {
+            int nr = (int) std::min<long long>(NR, nc - j);
+            for (long long i = 0; i < mc; i += MR) {
+                int mr = (int) std::min<long long>(MR, mc - i);
+                micro_kernel<T>::run(kc, Ap + i * kc, Bp + j * kc, C + i * ldc + j, ldc, mr, nr);
+            }
+        }
+    }
+
+    /*!
+     * @brief Single-threaded C = alpha * A * B + beta * C, see gemm().
+     */
+    template<class T>
+    void gemm_serial(long long m, long long n, long long k, T alpha, const T *A, long long lda,
+              const T *B, long long ldb, T beta, T *C, long long ldc) {
+        static_assert(blocking<T>::packed, "gemm needs an arithmetic or complex element type");
+        constexpr int NR = blocking<T>::NR, KC = blocking<T>::KC;
+        constexpr int MC = blocking<T>::MC, NC = blocking<T>::NC;
+        if (m <= 0 || n <= 0) return;
+        if (!(beta == T(1)))
+            for (long long i = 0; i < m; i++) {
+                T *c = C + i * ldc;
+                if (beta == T()) std::fill(c, c + n, T());
+                else for (long long j = 0; j < n; j++) c[j] *= beta;
+            }
+        if (k <= 0 || alpha == T()) return;
+
+        if (m * n * k < 4096) {
+            for (long long i = 0; i < m; i++) {
+                T *c = C + i * ldc;
+                for (long long p = 0; p < k; p++) {
+                    T a = alpha * A[i * lda + p];
+                    const T *b = B + p * ldb;
+                    for (long long j = 0; j < n; j++) c[j] += a * b[j];
+                }
+            }
+            return;
+        }
+
+        thread_local aligned_buffer<T> bufA, bufB;
+        T *Ap = bufA.reserve((size_t) MC * KC);
+        T *Bp = bufB.reserve((size_t) KC * ((NC + NR - 1) / NR * NR));
+        for (long long jc = 0; jc < n; jc += NC) {
+            long long nc = std::min<long long>(NC, n - jc);
+            for (long long pc = 0; pc < k; pc += KC) {
+                long long kc = std::min<long long>(KC, k - pc);
+                pack_b(kc, nc, B + pc * ldb + jc, ldb, Bp);
+                for (long long ic = 0; ic < m; ic += MC) {
+                    long long mc = std::min<long long>(MC, m - ic);
+                    pack_a(mc, kc, alpha, A + ic * lda + pc, lda, Ap);
+                    macro_kernel(mc, nc, kc, Ap, Bp, C + ic * ldc + jc, ldc);
+                }
+            }
+        }
+    }
+
+    /*!
+     * @brief General matrix multiplication C = alpha * A * B + beta * C.
+     * @param[in] m : rows of A and C
+     * @param[in] n : cols of B and C
+     * @param[in] k : cols of A and rows of B
+     * @note T must be arithmetic or std::complex. When beta is 0 the old content of C is ignored.
+     *       Large products are split into a 2D grid of C tiles run on the shared thread pool;
+     *       products below the pool's serial threshold stay on the calling thread.
+     */
+    template<class T>
+    void gemm(long long m, long long n, long long k, T alpha, const T *A, long long lda,
+              const T *B, long long ldb, T beta, T *C, long long ldc) {
+        constexpr int MR = blocking<T>::MR, NR = blocking<T>::NR;
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long work = 2 * m * n * std::max<long long>(k, 1);
+        if (m <= 0 || n <= 0 || pool.threads() == 1 || work < pool.serial_threshold()) {
+            gemm_serial(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+            return;
+        }
+        // Aim for a few tiles per thread so stealing can even out the tail.
+        long long target = 4LL * pool.threads();
+        long long maxTm = (m + MR - 1) / MR, maxTn = (n + NR - 1) / NR;
+        long long tn = std::max(1LL, std::min(maxTn, (long long) std::sqrt((double) target * n / m)));
+        long long tm = std::max(1LL, std::min(maxTm, target / tn));
+        long long th = ((m + tm - 1) / tm + MR - 1) / MR * MR;
+        long long tw = ((n + tn - 1) / tn + NR - 1) / NR * NR;
+        tm = (m + th - 1) / th, tn = (n + tw - 1) / tw;
+        pool.parallel_for(tm * tn, work, [&](long long t) {
+            long long i0 = t / tn * th, j0 = t % tn * tw;
+            gemm_serial(std::min(th, m - i0), std::min(tw, n - j0), k, alpha, A + i0 * lda, lda,
+                        B + j0, ldb, beta, C + i0 * ldc + j0, ldc);
+        });
+    }
+
+    /*!
+     * @brief Compute C = A * B for any element type.
+     * @note Types without a packed kernel (e.g. nested matrices) take a row-streaming
+     *       loop that assigns the first product instead of adding it to a default value,
+     *       so a default-constructed T never has to act as an additive identity.
+     */
+    template<class T>
+    void multiply(long long m, long long n, long long k, const T *A, long long lda,
+                  const T *B, long long ldb, T *C, long long ldc) {
+        if constexpr (blocking<T>::packed) {
+            gemm<T>(m, n, k, T(1), A, lda, B, ldb, T(), C, ldc);
+        } else {
+            for (long long i = 0; i < m; i++) {
+                T *c = C + i * ldc;
+                for (long long p = 0; p < k; p++) {
+                    T a = A[i * lda + p];
+                    const T *b = B + p * ldb;
+                    if (p == 0) for (long long j = 0; j < n; j++) c[j] = a * b[j];
+                    else for (long long j = 0; j < n; j++) c[j] = c[j] + a * b[j];
+                }
+            }
+        }
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXGEMM_H
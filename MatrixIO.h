@@ -0,0 +1,369 @@
+//
+// A versioned binary container for dense and compressed sparse matrices, read through mmap.
+//
+
+#ifndef CPP_PROJECT_MATRIXIO_H
+#define CPP_PROJECT_MATRIXIO_H
+
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATRIX_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*!
+ * @brief A namespace storing the binary matrix file format. \n
+ * @note A file is a 64-byte FileHeader followed by its sections, each starting at a
+ *       multiple of 64 bytes: the row-major (or column-major) elements of a dense matrix,
+ *       or the outer pointers (int64), inner indices (int32) and values of a sparse one.
+ *       Numbers are stored in the byte order of the writer, which the header records.
+ */
+namespace io {
+    const uint32_t FILE_VERSION = 1;
+    const uint64_t FILE_ALIGN = 64;
+    const char FILE_MAGIC[8] = {'C', 'S', '2', '0', '5', 'M', 'A', 'T'};
+    const uint32_t FILE_ENDIAN = 0x01020304;
+
+    enum class Kind : uint32_t {
+        Dense = 1, Csr = 2, Csc = 3
+    };
+
+    enum class ElemType : uint32_t {
+        Int8 = 1, UInt8, Int16, UInt16, Int32, UInt32, Int64, UInt64, Float32, Float64, Complex64, Complex128
+    };
+
+    const uint32_t FLAG_COL_MAJOR = 1; ///< dense elements are stored column by column
+    const uint32_t FLAG_CHECKSUM = 2;  ///< the checksum field is set
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t endian;   ///< FILE_ENDIAN as written by the writer
+        uint32_t version;
+        uint32_t kind;     ///< a Kind
+        uint32_t elem;     ///< an ElemType
+        uint32_t elemSize; ///< bytes per element
+        uint32_t flags;
+        int64_t rows, cols;
+        int64_t nnz;       ///< stored elements of a sparse matrix, rows * cols of a dense one
+        uint64_t checksum; ///< checksum() of the sections in order, without the padding
+    };
+
+    static_assert(sizeof(FileHeader) == 64, "The file header must be 64 bytes!");
+    static_assert(sizeof(long long) == 8 && sizeof(int) == 4, "Sparse indices must be 64 and 32 bits!");
+
+    /*!
+     * @brief The code of an element type that can be stored.
+     */
+    template<class T>
+    constexpr ElemType elem_type(const T *) {
+        static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= 8 &&
+                      (std::is_integral<T>::value || sizeof(T) >= 4), "This element type cannot be stored!");
+        return std::is_floating_point<T>::value ? (sizeof(T) == 4 ? ElemType::Float32 : ElemType::Float64)
+                                                : (ElemType) ((sizeof(T) == 1 ? 1 : sizeof(T) == 2 ? 3 : sizeof(T) == 4 ? 5 : 7) +
+                                                              (std::is_signed<T>::value ? 0 : 1));
+    }
+
+    template<class P>
+    constexpr ElemType elem_type(const std::complex<P> *) {
+        static_assert(std::is_same<P, float>::value || std::is_same<P, double>::value, "This element type cannot be stored!");
+        return sizeof(P) == 4 ? ElemType::Complex64 : ElemType::Complex128;
+    }
+
+    template<class T>
+    constexpr ElemType elem_type() {
+        return elem_type((const T *) nullptr);
+    }
+
+    /*!
+     * @brief Bytes per element of a type code, 0 for an unknown code.
+     */
+    inline uint32_t elem_size(uint32_t code) {
+        static const uint32_t SIZES[] = {0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 8, 16};
+        return code < sizeof(SIZES) / sizeof(SIZES[0]) ? SIZES[code] : 0;
+    }
+
+    /*!
+     * @brief A 64-bit checksum of n bytes, chained through seed.
+     * @note Four independent multiply-xorshift lanes over 8-byte words, so it runs at
+     *       memory speed; it detects corruption, it is not a cryptographic hash.
+     */
+    inline uint64_t checksum(const void *p, uint64_t n, uint64_t seed) {
+        const uint64_t K = 0x9E3779B97F4A7C15ULL;
+        const unsigned char *b = (const unsigned char *) p;
+        uint64_t lane[4] = {seed ^ 0x243F6A8885A308D3ULL, seed ^ 0x13198A2E03707344ULL,
+                            seed ^ 0xA4093822299F31D0ULL, seed ^ 0x082EFA98EC4E6C89ULL};
+        uint64_t i = 0;
+        for (; i + 32 <= n; i += 32)
+            for (int k = 0; k < 4; k++) {
+                uint64_t w;
+                std::memcpy(&w, b + i + 8 * k, 8);
+                lane[k] = (lane[k] ^ w) * K;
+                lane[k] ^= lane[k] >> 29;
+            }
+        for (; i < n; i++) lane[0] = ((lane[0] ^ b[i]) * K) ^ (lane[0] >> 29);
+        uint64_t h = n * K;
+        for (int k = 0; k < 4; k++) {
+            h = (h ^ lane[k]) * K;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+    inline uint64_t align_up(uint64_t v) {
+        return (v + FILE_ALIGN - 1) / FILE_ALIGN * FILE_ALIGN;
+    }
+
+    /*!
+     * @brief Byte offsets of the sections of a file; ptr and idx are 0 for a dense matrix.
+     */
+    struct Sections {
+        uint64_t ptr = 0, idx = 0, val = 0, end = 0;
+    };
+
+    /*!
+     * @brief Check a header and work out where its sections lie.
+     * @exception runtime_error : the header is not a valid one of this version and host
+     */
+    inline Sections sections(const FileHeader &h) {
+        if (std::memcmp(h.magic, FILE_MAGIC, 8) != 0) throw std::runtime_error("Not a matrix file!");
+        if (h.endian != FILE_ENDIAN) throw std::runtime_error("The matrix file has another byte order!");
+        if (h.version == 0 || h.version > FILE_VERSION) throw std::runtime_error("Unsupported matrix file version!");
+        if (h.elemSize == 0 || h.elemSize != elem_size(h.elem)) throw std::runtime_error("Unknown element type!");
+        if (h.rows < 0 || h.cols < 0 || h.nnz < 0) throw std::runtime_error("Negative size in the matrix file!");
+        const uint64_t LIMIT = 1ULL << 62;
+        Sections s;
+        s.val = sizeof(FileHeader);
+        if (h.kind == (uint32_t) Kind::Dense) {
+            if (h.cols && (uint64_t) h.rows > LIMIT / h.elemSize / (uint64_t) h.cols)
+                throw std::runtime_error("The matrix file is too large!");
+            if (h.nnz != h.rows * h.cols) throw std::runtime_error("Corrupted matrix file header!");
+        } else if (h.kind == (uint32_t) Kind::Csr || h.kind == (uint32_t) Kind::Csc) {
+            uint64_t outer = (uint64_t) (h.kind == (uint32_t) Kind::Csr ? h.rows : h.cols);
+            if (outer >= LIMIT / 8 || (uint64_t) h.nnz >= LIMIT / 16) throw std::runtime_error("The matrix file is too large!");
+            s.ptr = sizeof(FileHeader);
+            s.idx = align_up(s.ptr + 8 * (outer + 1));
+            s.val = align_up(s.idx + 4 * (uint64_t) h.nnz);
+        } else {
+            throw std::runtime_error("Unknown matrix kind!");
+        }
+        s.end = s.val + (uint64_t) h.nnz * h.elemSize;
+        return s;
+    }
+
+    /*!
+     * @brief The checksum of the sections of a file whose bytes start at base.
+     */
+    inline uint64_t file_checksum(const FileHeader &h, const Sections &s, const char *base) {
+        uint64_t c = 0;
+        if (s.ptr) {
+            c = checksum(base + s.ptr, s.idx - s.ptr, c);
+            c = checksum(base + s.idx, 4 * (uint64_t) h.nnz, c);
+        }
+        return checksum(base + s.val, s.end - s.val, c);
+    }
+
+    /*!
+     * @brief Write a matrix file.
+     * @param[in] h : the header; magic, endian, version, checksum and its flag are filled in
+     * @param[in] ptr, idx : outer pointers and inner indices of a sparse matrix, unused for a dense one
+     * @param[in] val : nnz elements of h.elemSize bytes
+     * @exception runtime_error : the file cannot be written
+     */
+    inline void write_file(const std::string &path, FileHeader h, const long long *ptr, const int *idx,
+                           const void *val, bool withChecksum) {
+        std::memcpy(h.magic, FILE_MAGIC, 8);
+        h.endian = FILE_ENDIAN;
+        h.version = FILE_VERSION;
+        h.flags &= ~FLAG_CHECKSUM;
+        h.checksum = 0;
+        Sections s = sections(h);
+        if (withChecksum) {
+            uint64_t c = 0;
+            if (s.ptr) {
+                c = checksum(ptr, s.idx - s.ptr, c);
+                c = checksum(idx, 4 * (uint64_t) h.nnz, c);
+            }
+            h.checksum = checksum(val, s.end - s.val, c);
+            h.flags |= FLAG_CHECKSUM;
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Cannot open the file for writing!");
+        static const char ZERO[FILE_ALIGN] = {};
+        uint64_t at = 0;
+        auto put = [&](uint64_t offset, const void *p, uint64_t n) {
+            out.write(ZERO, (std::streamsize) (offset - at));
+            out.write((const char *) p, (std::streamsize) n);
+            at = offset + n;
+        };
+        put(0, &h, sizeof(h));
+        if (s.ptr) {
+            put(s.ptr, ptr, s.idx - s.ptr);
+            put(s.idx, idx, 4 * (uint64_t) h.nnz);
+        }
+        put(s.val, val, s.end - s.val);
+        if (!out.flush()) throw std::runtime_error("Cannot write the file!");
+    }
+
+    /*!
+     * @brief The bytes of a file mapped into memory, 64-byte aligned.
+     * @note The mapping is private: pages are read from the file when first touched, and
+     *       writes change this process's copy only, never the file. Without mmap the file
+     *       is read into memory.
+     */
+    class Mapping {
+    private:
+        char *base = nullptr;
+        uint64_t length = 0;
+        std::vector<char> heap;
+
+    public:
+        /*!
+         * @exception runtime_error : the file cannot be opened or read
+         */
+        explicit Mapping(const std::string &path) {
+#ifdef MATRIX_USE_MMAP
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error("Cannot open the file!");
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                ::close(fd);
+                throw std::runtime_error("Cannot read the file!");
+            }
+            length = (uint64_t) st.st_size;
+            if (length > 0) {
+                void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("Cannot map the file!");
+                }
+                base = (char *) p;
+            }
+            ::close(fd);
+#else
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in) throw std::runtime_error("Cannot open the file!");
+            length = (uint64_t) in.tellg();
+            heap.resize(length + FILE_ALIGN);
+            base = heap.data() + (FILE_ALIGN - (uintptr_t) heap.data() % FILE_ALIGN) % FILE_ALIGN;
+            in.seekg(0);
+            if (!in.read(base, (std::streamsize) length)) throw std::runtime_error("Cannot read the file!");
+#endif
+        }
+
+        Mapping(const Mapping &) = delete;
+
+        Mapping &operator=(const Mapping &) = delete;
+
+        ~Mapping() {
+#ifdef MATRIX_USE_MMAP
+            if (base && heap.empty()) munmap(base, length);
+#endif
+        }
+
+        char *data() const { return base; }
+
+        uint64_t size() const { return length; }
+    };
+
+    /*!
+     * @brief A matrix file mapped into memory, see Mapping.
+     * @note Views of the file must not outlive it.
+     */
+    class MatrixFile {
+    private:
+        Mapping map;
+        char *base;
+        FileHeader h{};
+        Sections s;
+
+    public:
+        /*!
+         * @brief Map the file at path and check its header.
+         * @param[in] verify : also compare the checksum and check the sparse structure,
+         *            see well_formed(), which reads the whole file
+         * @note Without verify only the header, the section sizes and the first and last
+         *       outer pointers are checked; the rest of the file is trusted, and a corrupted
+         *       or hand-made one can make views of it read out of bounds.
+         * @exception runtime_error : the file cannot be read, is not a valid matrix file,
+         *            is truncated, or fails verification
+         */
+        explicit MatrixFile(const std::string &path, bool verify = false) : map(path), base(map.data()) {
+            if (map.size() < sizeof(FileHeader)) throw std::runtime_error("Not a matrix file!");
+            std::memcpy(&h, base, sizeof(h));
+            s = sections(h);
+            if (s.end > map.size()) throw std::runtime_error("The matrix file is truncated!");
+            if (s.ptr) {
+                const long long *ptr = outer_ptr();
+                long long outer = h.kind == (uint32_t) Kind::Csr ? h.rows : h.cols;
+                if (ptr[0] != 0 || ptr[outer] != h.nnz) throw std::runtime_error("Corrupted sparse matrix file!");
+            }
+            if (verify && !this->verify()) throw std::runtime_error("The matrix file fails its checksum!");
+            if (verify && !well_formed()) throw std::runtime_error("Corrupted sparse matrix file!");
+        }
+
+        const FileHeader &header() const { return h; }
+
+        Kind kind() const { return (Kind) h.kind; }
+
+        ElemType elem() const { return (ElemType) h.elem; }
+
+        long long rows() const { return h.rows; }
+
+        long long cols() const { return h.cols; }
+
+        long long nnz() const { return h.nnz; }
+
+        bool col_major() const { return (h.flags & FLAG_COL_MAJOR) != 0; }
+
+        /*!
+         * @brief The elements, 64-byte aligned.
+         */
+        void *values() const { return base + s.val; }
+
+        const long long *outer_ptr() const { return s.ptr ? (const long long *) (base + s.ptr) : nullptr; }
+
+        const int *inner_index() const { return s.ptr ? (const int *) (base + s.idx) : nullptr; }
+
+        /*!
+         * @brief Whether the sections match the stored checksum; true when none was stored.
+         * @note Reads the whole file, and sees changes made through views.
+         */
+        bool verify() const {
+            return !(h.flags & FLAG_CHECKSUM) || file_checksum(h, s, base) == h.checksum;
+        }
+
+        /*!
+         * @brief Whether the outer pointers rise from 0 to nnz and the inner indices of each
+         *        outer index are strictly increasing and in range; true for a dense matrix.
+         * @note Reads the pointer and index sections, so files saved without a checksum can
+         *       still be checked before they are trusted.
+         */
+        bool well_formed() const {
+            if (!s.ptr) return true;
+            const long long *ptr = outer_ptr();
+            const int *idx = inner_index();
+            bool csr = h.kind == (uint32_t) Kind::Csr;
+            long long outer = csr ? h.rows : h.cols, inner = csr ? h.cols : h.rows;
+            if (ptr[0] != 0 || ptr[outer] != h.nnz) return false;
+            for (long long o = 0; o < outer; o++)
+                if (ptr[o + 1] < ptr[o]) return false;
+            for (long long o = 0; o < outer; o++)
+                for (long long t = ptr[o]; t < ptr[o + 1]; t++)
+                    if (idx[t] < 0 || idx[t] >= inner || (t > ptr[o] && idx[t] <= idx[t - 1])) return false;
+            return true;
+        }
+    };
+}
+
+#endif //CPP_PROJECT_MATRIXIO_H
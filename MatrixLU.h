@@ -0,0 +1,148 @@
+//
+// Blocked LU factorization with partial pivoting on raw row-major buffers.
+//
+
+#ifndef CPP_PROJECT_MATRIXLU_H
+#define CPP_PROJECT_MATRIXLU_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include "MatrixGemm.h"
+
+namespace kernel {
+    /*!
+     * @brief The type LU works in for element type T: integers are factorized in double.
+     */
+    template<class T>
+    struct lu_scalar {
+        typedef typename std::conditional<std::is_integral<T>::value, double, T>::type type;
+    };
+
+    /*!
+     * @brief The real type underlying a real or complex scalar.
+     */
+    template<class S>
+    struct real_of {
+        typedef S type;
+    };
+
+    template<class P>
+    struct real_of<std::complex<P> > {
+        typedef P type;
+    };
+
+    /*!
+     * @brief Pivot magnitude of a real scalar.
+     */
+    template<class S>
+    inline double magnitude(const S &x) {
+        return std::fabs((double) x);
+    }
+
+    /*!
+     * @brief Pivot magnitude of a complex scalar: |re| + |im|, which avoids the sqrt of std::abs.
+     */
+    template<class P>
+    inline double magnitude(const std::complex<P> &x) {
+        return std::fabs((double) x.real()) + std::fabs((double) x.imag());
+    }
+
+    /*!
+     * @brief Unblocked LU of the n x jb panel starting at a, swapping whole rows of length rowLen.
+     * @param[in] rowStart : offset of the panel's first column inside a row
+     */
+    template<class S>
+    int lu_panel(long long n, long long jb, S *a, long long lda, long long rowStart, long long rowLen,
+                 long long *piv, long long base) {
+        int info = 0;
+        for (long long j = 0; j < jb; j++) {
+            long long p = j;
+            double best = magnitude(a[j * lda + j]);
+            for (long long i = j + 1; i < n; i++) {
+                double v = magnitude(a[i * lda + j]);
+                if (v > best) best = v, p = i;
+            }
+            piv[j] = base + p;
+            if (best == 0) {
+                if (!info) info = (int) (base + j + 1);
+                continue;
+            }
+            if (p != j) std::swap_ranges(a + j * lda - rowStart, a + j * lda - rowStart + rowLen, a + p * lda - rowStart);
+            S inv = S(1) / a[j * lda + j];
+            for (long long i = j + 1; i < n; i++) {
+                S l = a[i * lda + j] *= inv;
+                if (l == S()) continue;
+                S *ri = a + i * lda, *rj = a + j * lda;
+                for (long long c = j + 1; c < jb; c++) ri[c] -= l * rj[c];
+            }
+        }
+        return info;
+    }
+
+    /*!
+     * @brief In-place LU factorization PA = LU of an n x n row-major matrix.
+     * @param[out] piv : row i was swapped with row piv[i] at step i
+     * @return 0 on success, otherwise k where U(k,k) is exactly zero (1-based)
+     * @note The panel is factorized column by column; U12 is solved by forward
+     *       substitution and the trailing block is updated with one gemm call.
+     */
+    template<class S>
+    int lu_factor(long long n, S *a, long long lda, long long *piv) {
+        const long long NB = 64;
+        int info = 0;
+        for (long long j0 = 0; j0 < n; j0 += NB) {
+            long long jb = std::min(NB, n - j0);
+            S *panel = a + j0 * lda + j0;
+            int r = lu_panel(n - j0, jb, panel, lda, j0, n, piv + j0, j0);
+            if (r && !info) info = r;
+            long long rest = n - j0 - jb;
+            if (rest == 0) continue;
+            S *a12 = panel + jb;
+            for (long long j = 0; j < jb; j++)
+                for (long long i = j + 1; i < jb; i++) {
+                    S l = panel[i * lda + j];
+                    if (l == S()) continue;
+                    S *ri = a12 + i * lda, *rj = a12 + j * lda;
+                    for (long long c = 0; c < rest; c++) ri[c] -= l * rj[c];
+                }
+            gemm<S>(rest, rest, jb, S(-1), panel + jb * lda, lda, a12, lda, S(1), a12 + jb * lda, lda);
+        }
+        return info;
+    }
+
+    /*!
+     * @brief Solve A X = B in place from the factors of lu_factor().
+     * @param[in,out] b : n x nrhs right-hand sides, overwritten by X
+     */
+    template<class S>
+    void lu_solve(long long n, const S *a, long long lda, const long long *piv, S *b, long long nrhs, long long ldb) {
+        for (long long i = 0; i < n; i++)
+            if (piv[i] != i) std::swap_ranges(b + i * ldb, b + i * ldb + nrhs, b + piv[i] * ldb);
+        for (long long i = 1; i < n; i++) {
+            S *bi = b + i * ldb;
+            for (long long k = 0; k < i; k++) {
+                S l = a[i * lda + k];
+                if (l == S()) continue;
+                const S *bk = b + k * ldb;
+                for (long long c = 0; c < nrhs; c++) bi[c] -= l * bk[c];
+            }
+        }
+        for (long long i = n - 1; i >= 0; i--) {
+            S *bi = b + i * ldb;
+            for (long long k = i + 1; k < n; k++) {
+                S u = a[i * lda + k];
+                if (u == S()) continue;
+                const S *bk = b + k * ldb;
+                for (long long c = 0; c < nrhs; c++) bi[c] -= u * bk[c];
+            }
+            S inv = S(1) / a[i * lda + i];
+            for (long long c = 0; c < nrhs; c++) bi[c] *= inv;
+        }
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXLU_H
@@ -0,0 +1,193 @@
+//
+// Blocked Householder QR factorization on raw row-major buffers.
+//
+
+#ifndef CPP_PROJECT_MATRIXQR_H
+#define CPP_PROJECT_MATRIXQR_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "MatrixGemm.h"
+
+namespace kernel {
+    /*!
+     * @brief Make the reflector H = I - tau * v * v^T with H * x = (beta, 0, ..., 0).
+     * @param[in,out] x : len elements inc apart, overwritten by beta and v(1:), v(0) = 1
+     * @return tau, 0 when x is already a multiple of e1
+     */
+    template<class S>
+    S householder(long long len, S *x, long long inc) {
+        S scale = 0;
+        for (long long i = 1; i < len; i++) scale = std::max(scale, (S) std::fabs(x[i * inc]));
+        if (scale == 0) return 0;
+        S ss = 0;
+        for (long long i = 1; i < len; i++) {
+            S t = x[i * inc] / scale;
+            ss += t * t;
+        }
+        S alpha = x[0];
+        S beta = -std::copysign(std::hypot(alpha, scale * std::sqrt(ss)), alpha);
+        S inv = 1 / (alpha - beta);
+        for (long long i = 1; i < len; i++) x[i * inc] *= inv;
+        x[0] = beta;
+        return (beta - alpha) / beta;
+    }
+
+    /*!
+     * @brief The complex reflector H = I - tau * v * v^H with H^H * x = (beta, 0, ..., 0), beta real.
+     * @param[in,out] x : len elements inc apart, overwritten by beta and v(1:), v(0) = 1
+     * @return tau, 0 when x is already a real multiple of e1
+     */
+    template<class P>
+    std::complex<P> householder(long long len, std::complex<P> *x, long long inc) {
+        P xnorm = 0;
+        for (long long i = 1; i < len; i++) xnorm = std::hypot(xnorm, std::abs(x[i * inc]));
+        std::complex<P> alpha = x[0];
+        if (xnorm == 0 && alpha.imag() == 0) return 0;
+        P beta = -std::copysign(std::hypot(std::abs(alpha), xnorm), alpha.real());
+        std::complex<P> inv = P(1) / (alpha - beta);
+        for (long long i = 1; i < len; i++) x[i * inc] *= inv;
+        x[0] = beta;
+        return std::complex<P>((beta - alpha.real()) / beta, -alpha.imag() / beta);
+    }
+
+    /*!
+     * @brief Unblocked QR of the rows x jb panel at a, reflectors applied inside the panel only.
+     */
+    template<class S>
+    void qr_panel(long long rows, long long jb, S *a, long long lda, S *tau) {
+        std::vector<S> w(jb);
+        for (long long c = 0; c < jb && c < rows; c++) {
+            S *col = a + c * lda + c;
+            tau[c] = householder(rows - c, col, lda);
+            long long rest = jb - c - 1;
+            if (tau[c] == 0 || rest == 0) continue;
+            // w = v^T * A(c:, c+1:), then A(c:, c+1:) -= tau * v * w, with v(0) = 1.
+            std::copy(col + 1, col + 1 + rest, w.begin());
+            for (long long i = 1; i < rows - c; i++) {
+                S v = col[i * lda];
+                if (v == 0) continue;
+                const S *r = col + i * lda + 1;
+                for (long long q = 0; q < rest; q++) w[q] += v * r[q];
+            }
+            for (long long q = 0; q < rest; q++) w[q] *= tau[c];
+            for (long long q = 0; q < rest; q++) col[1 + q] -= w[q];
+            for (long long i = 1; i < rows - c; i++) {
+                S v = col[i * lda];
+                if (v == 0) continue;
+                S *r = col + i * lda + 1;
+                for (long long q = 0; q < rest; q++) r[q] -= v * w[q];
+            }
+        }
+    }
+
+    /*!
+     * @brief The compact WY form H(0) ... H(jb-1) = I - V * T * V^T of one panel.
+     * @param[in] a : the factorized panel, rows x jb with the reflectors below the diagonal
+     * @param[out] V : rows x jb, unit lower trapezoidal
+     * @param[out] Vt : the transpose of V, kept so both products with V are plain gemm calls
+     * @param[out] T : jb x jb upper triangular
+     */
+    template<class S>
+    void block_reflector(long long rows, long long jb, const S *a, long long lda, const S *tau,
+                         std::vector<S> &V, std::vector<S> &Vt, std::vector<S> &T) {
+        V.assign(rows * jb, S());
+        Vt.assign(jb * rows, S());
+        T.assign(jb * jb, S());
+        for (long long i = 0; i < rows; i++)
+            for (long long c = 0; c < jb && c <= i; c++) {
+                S v = c == i ? S(1) : a[i * lda + c];
+                V[i * jb + c] = v;
+                Vt[c * rows + i] = v;
+            }
+        std::vector<S> z(jb);
+        for (long long c = 0; c < jb; c++) {
+            // T(0:c, c) = -tau(c) * T(0:c, 0:c) * V(:, 0:c)^T * v(c)
+            for (long long p = 0; p < c; p++) {
+                S s = 0;
+                const S *vp = Vt.data() + p * rows, *vc = Vt.data() + c * rows;
+                for (long long i = c; i < rows; i++) s += vp[i] * vc[i];
+                z[p] = s;
+            }
+            for (long long p = 0; p < c; p++) {
+                S s = 0;
+                for (long long q = p; q < c; q++) s += T[p * jb + q] * z[q];
+                T[p * jb + c] = -tau[c] * s;
+            }
+            T[c * jb + c] = tau[c];
+        }
+    }
+
+    /*!
+     * @brief C = (I - V * T * V^T) * C, or its transpose applied when trans is set.
+     * @param[in,out] W, W2 : scratch owned by the caller, resized here
+     * @note Two gemm calls and one small triangular product: W = V^T * C, W = op(T) * W,
+     *       C -= V * W. The scratch is not thread_local: a thread waiting in a parallel
+     *       gemm runs other pool tasks, which may be another QR using the same thread.
+     */
+    template<class S>
+    void apply_block(long long rows, long long jb, const std::vector<S> &V, const std::vector<S> &Vt,
+                     const std::vector<S> &T, bool trans, S *C, long long n, long long ldc,
+                     std::vector<S> &W, std::vector<S> &W2) {
+        if (n <= 0) return;
+        W.resize(jb * n);
+        W2.assign(jb * n, S());
+        gemm<S>(jb, n, rows, S(1), Vt.data(), rows, C, ldc, S(), W.data(), n);
+        for (long long p = 0; p < jb; p++) {
+            S *w2 = W2.data() + p * n;
+            long long lo = trans ? 0 : p, hi = trans ? p + 1 : jb;
+            for (long long q = lo; q < hi; q++) {
+                S t = trans ? T[q * jb + p] : T[p * jb + q];
+                if (t == 0) continue;
+                const S *w = W.data() + q * n;
+                for (long long j = 0; j < n; j++) w2[j] += t * w[j];
+            }
+        }
+        gemm<S>(rows, n, jb, S(-1), V.data(), jb, W2.data(), n, S(1), C, ldc);
+    }
+
+    /*!
+     * @brief In-place Householder QR A = QR of an m x n row-major matrix.
+     * @param[out] tau : min(m, n) reflector factors
+     * @note R is left on and above the diagonal and the reflectors below it. Each panel
+     *       is factorized column by column and applied to the trailing matrix as one
+     *       block reflector.
+     */
+    template<class S>
+    void qr_factor(long long m, long long n, S *a, long long lda, S *tau) {
+        const long long NB = 32;
+        long long k = std::min(m, n);
+        std::vector<S> V, Vt, T, W, W2;
+        for (long long j0 = 0; j0 < k; j0 += NB) {
+            long long jb = std::min(NB, k - j0);
+            S *panel = a + j0 * lda + j0;
+            qr_panel(m - j0, jb, panel, lda, tau + j0);
+            if (j0 + jb >= n) continue;
+            block_reflector(m - j0, jb, panel, lda, tau + j0, V, Vt, T);
+            apply_block(m - j0, jb, V, Vt, T, true, panel + jb, n - j0 - jb, lda, W, W2);
+        }
+    }
+
+    /*!
+     * @brief B = Q^T * B (trans) or B = Q * B from the factors of qr_factor().
+     * @param[in,out] b : m x nrhs row-major
+     */
+    template<class S>
+    void qr_apply(long long m, long long n, const S *a, long long lda, const S *tau, bool trans,
+                  S *b, long long nrhs, long long ldb) {
+        const long long NB = 32;
+        long long k = std::min(m, n);
+        long long blocks = (k + NB - 1) / NB;
+        std::vector<S> V, Vt, T, W, W2;
+        for (long long t = 0; t < blocks; t++) {
+            long long j0 = (trans ? t : blocks - 1 - t) * NB;
+            long long jb = std::min(NB, k - j0);
+            block_reflector(m - j0, jb, a + j0 * lda + j0, lda, tau + j0, V, Vt, T);
+            apply_block(m - j0, jb, V, Vt, T, trans, b + j0 * ldb, nrhs, ldb, W, W2);
+        }
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXQR_H
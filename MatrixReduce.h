@@ -0,0 +1,284 @@
+//
+// Single-pass sum, min and max reductions on raw row-major buffers.
+//
+
+#ifndef CPP_PROJECT_MATRIXREDUCE_H
+#define CPP_PROJECT_MATRIXREDUCE_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace kernel {
+    /// Independent accumulators of a leaf; loops of this fixed length are vectorized at -O2.
+    const long long REDUCE_LANES = 16;
+    /// Elements of one leaf of a pairwise sum.
+    const long long REDUCE_LEAF = 1024;
+    /// Columns of one strip of a column reduction, so its accumulators stay in L1.
+    const long long REDUCE_STRIP = 256;
+    /// Rows summed straight into a strip before the partial joins the pairwise sum.
+    const long long REDUCE_BLOCK = 64;
+
+    /*!
+     * @brief The reductions of a run of elements.
+     */
+    template<class T>
+    struct Summary {
+        T sum = T(), min = T(), max = T();
+        long long argmin = 0, argmax = 0; ///< first position of the minimum and the maximum
+    };
+
+    template<class T>
+    inline void add_to(T &a, const T &b) {
+        a = a + b;
+    }
+
+    template<class T>
+    inline void add_to(std::vector<T> &a, const std::vector<T> &b) {
+        for (size_t j = 0; j < a.size(); j++) a[j] = a[j] + b[j];
+    }
+
+    /*!
+     * @brief A pairwise sum fed one leaf at a time.
+     * @note Leaves merge like a binary counter, so every addition joins two partials over
+     *       the same number of leaves and rounding grows with log2 of the leaf count.
+     */
+    template<class V>
+    struct PairwiseSum {
+        std::vector<V> partial;
+        long long leaves = 0;
+
+        void push(V v) {
+            for (long long c = leaves++; c & 1; c >>= 1) {
+                add_to(partial.back(), v);
+                v = std::move(partial.back());
+                partial.pop_back();
+            }
+            partial.push_back(std::move(v));
+        }
+
+        V total(V zero) const {
+            for (size_t i = partial.size(); i-- > 0;) add_to(zero, partial[i]);
+            return zero;
+        }
+    };
+
+    /*!
+     * @brief Sum of x[0, n) over REDUCE_LANES accumulators, combined as a tree.
+     */
+    template<class T>
+    T leaf_sum(long long n, const T *x) {
+        T acc[REDUCE_LANES];
+        std::fill(acc, acc + REDUCE_LANES, T());
+        long long i = 0;
+        for (; i + REDUCE_LANES <= n; i += REDUCE_LANES)
+            for (long long j = 0; j < REDUCE_LANES; j++) acc[j] = acc[j] + x[i + j];
+        for (; i < n; i++) acc[0] = acc[0] + x[i];
+        for (long long w = REDUCE_LANES / 2; w > 0; w /= 2)
+            for (long long j = 0; j < w; j++) acc[j] = acc[j] + acc[j + w];
+        return acc[0];
+    }
+
+    /*!
+     * @brief Minimum and maximum of x[0, n), n > 0, over REDUCE_LANES accumulators.
+     */
+    template<class T>
+    void leaf_minmax(long long n, const T *x, T &mn, T &mx) {
+        T lo[REDUCE_LANES], hi[REDUCE_LANES];
+        std::fill(lo, lo + REDUCE_LANES, x[0]);
+        std::fill(hi, hi + REDUCE_LANES, x[0]);
+        long long i = 0;
+        for (; i + REDUCE_LANES <= n; i += REDUCE_LANES)
+            for (long long j = 0; j < REDUCE_LANES; j++) {
+                T v = x[i + j];
+                lo[j] = v < lo[j] ? v : lo[j];
+                hi[j] = hi[j] < v ? v : hi[j];
+            }
+        for (; i < n; i++) {
+            lo[0] = x[i] < lo[0] ? x[i] : lo[0];
+            hi[0] = hi[0] < x[i] ? x[i] : hi[0];
+        }
+        mn = lo[0], mx = hi[0];
+        for (long long j = 1; j < REDUCE_LANES; j++) {
+            mn = lo[j] < mn ? lo[j] : mn;
+            mx = mx < hi[j] ? hi[j] : mx;
+        }
+    }
+
+    /*!
+     * @brief The first position of v in x[from, to), from if it is not there.
+     */
+    template<class T>
+    long long locate(const T *x, long long from, long long to, const T &v) {
+        for (long long i = from; i < to; i++)
+            if (x[i] == v) return i;
+        return from;
+    }
+
+    /*!
+     * @brief Reduce x[0, n), n > 0, on the calling thread.
+     * @note One sweep over the leaves: each leaf is summed and scanned for its extremes while
+     *       in L1, and only the leaf holding the final minimum or maximum is searched for it.
+     */
+    template<class T, bool SUM, bool MINMAX>
+    Summary<T> reduce_serial(long long n, const T *x) {
+        Summary<T> r;
+        PairwiseSum<T> ps;
+        long long minLeaf = 0, maxLeaf = 0;
+        for (long long l = 0; l < n; l += REDUCE_LEAF) {
+            long long len = std::min(REDUCE_LEAF, n - l);
+            if constexpr (SUM) ps.push(leaf_sum(len, x + l));
+            if constexpr (MINMAX) {
+                T lo, hi;
+                leaf_minmax(len, x + l, lo, hi);
+                if (l == 0 || lo < r.min) r.min = lo, minLeaf = l;
+                if (l == 0 || r.max < hi) r.max = hi, maxLeaf = l;
+            }
+        }
+        if constexpr (SUM) r.sum = ps.total(T());
+        if constexpr (MINMAX) {
+            r.argmin = locate(x, minLeaf, std::min(n, minLeaf + REDUCE_LEAF), r.min);
+            r.argmax = locate(x, maxLeaf, std::min(n, maxLeaf + REDUCE_LEAF), r.max);
+        }
+        return r;
+    }
+
+    /*!
+     * @brief Reduce all of x[0, n), n > 0: pairwise sum, minimum, maximum and their first positions.
+     * @note Chunks of whole leaves run on the thread pool and are joined in order, so ties
+     *       go to the earlier position as in a serial scan.
+     */
+    template<class T, bool SUM, bool MINMAX>
+    Summary<T> reduce_all(long long n, const T *x) {
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long leaves = (n + REDUCE_LEAF - 1) / REDUCE_LEAF;
+        long long chunks = std::max(1LL, std::min<long long>(4LL * pool.threads(), leaves / 16));
+        std::vector<Summary<T> > part(chunks);
+        pool.parallel_for(chunks, n, [&](long long t) {
+            long long l0 = leaves * t / chunks * REDUCE_LEAF, l1 = std::min(n, leaves * (t + 1) / chunks * REDUCE_LEAF);
+            part[t] = reduce_serial<T, SUM, MINMAX>(l1 - l0, x + l0);
+            part[t].argmin += l0, part[t].argmax += l0;
+        });
+        Summary<T> r = part[0];
+        PairwiseSum<T> ps;
+        for (long long t = 0; t < chunks; t++) {
+            if constexpr (SUM) ps.push(part[t].sum);
+            if constexpr (MINMAX) {
+                if (part[t].min < r.min) r.min = part[t].min, r.argmin = part[t].argmin;
+                if (r.max < part[t].max) r.max = part[t].max, r.argmax = part[t].argmax;
+            }
+        }
+        if constexpr (SUM) r.sum = ps.total(T());
+        return r;
+    }
+
+    /*!
+     * @brief Reduce each row of the rows x cols matrix x, cols > 0.
+     * @param[out] sum, mn, mx : one value per row; mn and mx may be null
+     */
+    template<class T, bool SUM, bool MINMAX>
+    void reduce_rows(long long rows, long long cols, const T *x, long long ldx, T *sum, T *mn, T *mx) {
+        long long step = std::max(1LL, (1LL << 16) / cols);
+        parallel::ThreadPool::instance().parallel_for((rows + step - 1) / step, rows * cols, [&](long long t) {
+            for (long long i = t * step; i < std::min(rows, (t + 1) * step); i++) {
+                Summary<T> r = reduce_serial<T, SUM, MINMAX>(cols, x + i * ldx);
+                if constexpr (SUM) sum[i] = r.sum;
+                if constexpr (MINMAX) {
+                    if (mn) mn[i] = r.min;
+                    if (mx) mx[i] = r.max;
+                }
+            }
+        });
+    }
+
+    /*!
+     * @brief Reduce the columns [c0, c0 + w) of rows [r0, r1) of x, w <= REDUCE_STRIP.
+     * @note Walks the rows in memory order; blocks of REDUCE_BLOCK rows are summed straight
+     *       into one strip and the block partials are summed pairwise.
+     */
+    template<class T, bool SUM, bool MINMAX>
+    void reduce_strip(long long r0, long long r1, long long c0, long long w, const T *x, long long ldx,
+                      T *sum, T *mn, T *mx) {
+        PairwiseSum<std::vector<T> > ps;
+        std::vector<T> block(w);
+        T lo[REDUCE_STRIP], hi[REDUCE_STRIP];
+        if constexpr (MINMAX) {
+            std::copy(x + r0 * ldx + c0, x + r0 * ldx + c0 + w, lo);
+            std::copy(lo, lo + w, hi);
+        }
+        for (long long b = r0; b < r1; b += REDUCE_BLOCK) {
+            std::fill(block.begin(), block.end(), T());
+            for (long long i = b; i < std::min(r1, b + REDUCE_BLOCK); i++) {
+                const T *xr = x + i * ldx + c0;
+                T *s = block.data();
+                if constexpr (SUM) {
+                    if (w == REDUCE_STRIP)
+                        for (long long j = 0; j < REDUCE_STRIP; j++) s[j] = s[j] + xr[j];
+                    else
+                        for (long long j = 0; j < w; j++) s[j] = s[j] + xr[j];
+                }
+                if constexpr (MINMAX) {
+                    if (w == REDUCE_STRIP)
+                        for (long long j = 0; j < REDUCE_STRIP; j++) {
+                            lo[j] = xr[j] < lo[j] ? xr[j] : lo[j];
+                            hi[j] = hi[j] < xr[j] ? xr[j] : hi[j];
+                        }
+                    else
+                        for (long long j = 0; j < w; j++) {
+                            lo[j] = xr[j] < lo[j] ? xr[j] : lo[j];
+                            hi[j] = hi[j] < xr[j] ? xr[j] : hi[j];
+                        }
+                }
+            }
+            if constexpr (SUM) ps.push(block);
+        }
+        if constexpr (SUM) {
+            std::vector<T> total = ps.total(std::vector<T>(w, T()));
+            std::copy(total.begin(), total.end(), sum + c0);
+        }
+        if constexpr (MINMAX) {
+            if (mn) std::copy(lo, lo + w, mn + c0);
+            if (mx) std::copy(hi, hi + w, mx + c0);
+        }
+    }
+
+    /*!
+     * @brief Reduce each column of the rows x cols matrix x, rows > 0.
+     * @param[out] sum, mn, mx : one value per column; mn and mx may be null
+     * @note Strips of REDUCE_STRIP columns run on the thread pool. When there are fewer
+     *       strips than tasks the rows are split too, and the row chunks are joined after.
+     */
+    template<class T, bool SUM, bool MINMAX>
+    void reduce_columns(long long rows, long long cols, const T *x, long long ldx, T *sum, T *mn, T *mx) {
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long strips = (cols + REDUCE_STRIP - 1) / REDUCE_STRIP;
+        long long chunks = std::max(1LL, std::min(4LL * pool.threads() / strips, rows / (4 * REDUCE_BLOCK)));
+        std::vector<T> ps, pn, px;
+        if constexpr (SUM) ps.resize(chunks * cols);
+        if constexpr (MINMAX) pn.resize(chunks * cols), px.resize(chunks * cols);
+        pool.parallel_for(strips * chunks, rows * cols, [&](long long t) {
+            long long s = t % strips, c = t / strips, c0 = s * REDUCE_STRIP;
+            reduce_strip<T, SUM, MINMAX>(rows * c / chunks, rows * (c + 1) / chunks, c0, std::min(REDUCE_STRIP, cols - c0),
+                                         x, ldx, ps.data() + c * cols, pn.data() + c * cols, px.data() + c * cols);
+        });
+        for (long long j = 0; j < cols; j++) {
+            if constexpr (SUM) {
+                PairwiseSum<T> total;
+                for (long long c = 0; c < chunks; c++) total.push(ps[c * cols + j]);
+                sum[j] = total.total(T());
+            }
+            if constexpr (MINMAX) {
+                T lo = pn[j], hi = px[j];
+                for (long long c = 1; c < chunks; c++) {
+                    lo = pn[c * cols + j] < lo ? pn[c * cols + j] : lo;
+                    hi = hi < px[c * cols + j] ? px[c * cols + j] : hi;
+                }
+                if (mn) mn[j] = lo;
+                if (mx) mx[j] = hi;
+            }
+        }
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXREDUCE_H
@@ -0,0 +1,214 @@
+//
+// Sparse kernels on raw compressed sparse row (CSR) and column (CSC) arrays.
+//
+
+#ifndef CPP_PROJECT_MATRIXSPARSE_H
+#define CPP_PROJECT_MATRIXSPARSE_H
+
+#include <algorithm>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace kernel {
+    /*!
+     * @brief y = beta * y, where beta == 0 clears y whatever it held.
+     */
+    template<class T>
+    void scale_vector(long long n, T beta, T *y) {
+        if (beta == T(1)) return;
+        if (beta == T()) std::fill(y, y + n, T());
+        else for (long long i = 0; i < n; i++) y[i] = beta * y[i];
+    }
+
+    /*!
+     * @brief y = alpha * A * x + beta * y for an m-row CSR matrix A.
+     * @note When beta is 0 the old content of y is ignored. x and y must not overlap.
+     */
+    template<class T>
+    void spmv_csr(long long m, const long long *ptr, const int *idx, const T *val,
+                  const T *x, T *y, T alpha, T beta) {
+        for (long long i = 0; i < m; i++) {
+            T sum = T();
+            for (long long k = ptr[i]; k < ptr[i + 1]; k++) sum = sum + val[k] * x[idx[k]];
+            y[i] = beta == T() ? alpha * sum : alpha * sum + beta * y[i];
+        }
+    }
+
+    /*!
+     * @brief A merge-path partition of a CSR matrix for parallel SpMV.
+     * @note SpMV walks the merge of the row ends and the non-zeros; the rows + nnz steps of
+     *       that walk are cut into segments of equal length, so each segment does the same
+     *       work however the non-zeros are spread over the rows. Segment s starts at row
+     *       row[s] and non-zero nz[s]. The cut only depends on the matrix and the grain,
+     *       never on the thread count, so results are reproducible on any machine.
+     */
+    struct SpmvPlan {
+        long long rows = 0, nnz = 0;
+        std::vector<long long> row, nz;
+
+        long long segments() const { return (long long) row.size() - 1; }
+    };
+
+    /*!
+     * @brief Cut the merge path of an m-row CSR matrix into segments of about grain steps.
+     */
+    inline SpmvPlan spmv_plan(long long m, const long long *ptr, long long grain = 1 << 16) {
+        SpmvPlan plan;
+        plan.rows = m, plan.nnz = ptr[m];
+        long long total = m + plan.nnz;
+        long long segments = std::max(1LL, (total + grain - 1) / grain);
+        plan.row.resize(segments + 1);
+        plan.nz.resize(segments + 1);
+        for (long long s = 0; s <= segments; s++) {
+            long long d = std::min(total, s * grain);
+            // Count the row ends that the merge takes before step d.
+            long long lo = std::max(0LL, d - plan.nnz), hi = std::min(d, m);
+            while (lo < hi) {
+                long long mid = (lo + hi) / 2;
+                if (ptr[mid + 1] <= d - 1 - mid) lo = mid + 1;
+                else hi = mid;
+            }
+            plan.row[s] = lo, plan.nz[s] = d - lo;
+        }
+        return plan;
+    }
+
+    /*!
+     * @brief y = alpha * A * x + beta * y for a CSR matrix A along a merge-path plan.
+     * @note Segments run on the thread pool. A row cut by a segment end leaves a partial
+     *       sum that is added afterwards in segment order, so the result is deterministic.
+     */
+    template<class T>
+    void spmv_csr(const SpmvPlan &plan, const long long *ptr, const int *idx, const T *val,
+                  const T *x, T *y, T alpha, T beta) {
+        long long segments = plan.segments();
+        std::vector<T> carry(segments, T());
+        auto run = [&](long long s) {
+            long long i = plan.row[s], k = plan.nz[s];
+            long long i1 = plan.row[s + 1], k1 = plan.nz[s + 1];
+            T sum = T();
+            for (; i < i1; i++) {
+                for (; k < ptr[i + 1]; k++) sum = sum + val[k] * x[idx[k]];
+                y[i] = beta == T() ? alpha * sum : alpha * sum + beta * y[i];
+                sum = T();
+            }
+            for (; k < k1; k++) sum = sum + val[k] * x[idx[k]];
+            carry[s] = sum;
+        };
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long tasks = std::min<long long>(segments, 4LL * pool.threads());
+        pool.parallel_for(tasks, 2 * plan.nnz, [&](long long t) {
+            for (long long s = segments * t / tasks; s < segments * (t + 1) / tasks; s++) run(s);
+        });
+        for (long long s = 0; s < segments; s++)
+            if (plan.row[s + 1] < plan.rows && !(carry[s] == T()))
+                y[plan.row[s + 1]] = y[plan.row[s + 1]] + alpha * carry[s];
+    }
+
+    /*!
+     * @brief y = alpha * A * x + beta * y for an m x n CSC matrix A, scattering column by column.
+     */
+    template<class T>
+    void spmv_csc(long long m, long long n, const long long *ptr, const int *idx, const T *val,
+                  const T *x, T *y, T alpha, T beta) {
+        scale_vector(m, beta, y);
+        for (long long j = 0; j < n; j++) {
+            T t = alpha * x[j];
+            if (t == T()) continue;
+            for (long long k = ptr[j]; k < ptr[j + 1]; k++) y[idx[k]] = y[idx[k]] + val[k] * t;
+        }
+    }
+
+    /*!
+     * @brief C = alpha * A * B + beta * C for an m-row CSR matrix A and a row-major B with n columns.
+     * @note Every non-zero A(i, k) adds a scaled row of B to row i of C, so the inner loop
+     *       is contiguous. Rows of C are independent and split over the thread pool.
+     */
+    template<class T>
+    void spmm_csr(long long m, long long n, const long long *ptr, const int *idx, const T *val,
+                  const T *B, long long ldb, T *C, long long ldc, T alpha, T beta) {
+        auto rows = [&](long long lo, long long hi) {
+            for (long long i = lo; i < hi; i++) {
+                T *c = C + i * ldc;
+                scale_vector(n, beta, c);
+                for (long long k = ptr[i]; k < ptr[i + 1]; k++) {
+                    T a = alpha * val[k];
+                    const T *b = B + idx[k] * ldb;
+                    for (long long j = 0; j < n; j++) c[j] = c[j] + a * b[j];
+                }
+            }
+        };
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        long long tasks = std::min<long long>(m, 4LL * pool.threads());
+        pool.parallel_for(tasks, 2 * ptr[m] * n, [&](long long t) {
+            rows(m * t / tasks, m * (t + 1) / tasks);
+        });
+    }
+
+    /*!
+     * @brief C = alpha * A * B + beta * C for an m x p CSC matrix A and a row-major B with n columns.
+     */
+    template<class T>
+    void spmm_csc(long long m, long long p, long long n, const long long *ptr, const int *idx, const T *val,
+                  const T *B, long long ldb, T *C, long long ldc, T alpha, T beta) {
+        for (long long i = 0; i < m; i++) scale_vector(n, beta, C + i * ldc);
+        for (long long k = 0; k < p; k++) {
+            const T *b = B + k * ldb;
+            for (long long q = ptr[k]; q < ptr[k + 1]; q++) {
+                T a = alpha * val[q];
+                T *c = C + idx[q] * ldc;
+                for (long long j = 0; j < n; j++) c[j] = c[j] + a * b[j];
+            }
+        }
+    }
+
+    /*!
+     * @brief C = A * B for CSR matrices with Gustavson's row-by-row algorithm.
+     * @param[in] m : rows of A and C
+     * @param[in] n : columns of B and C
+     * @param[out] cp, ci, cv : the CSR arrays of C, reusing their capacity
+     * @note Row i of C accumulates A(i, k) * B(k, :) in a dense accumulator marked by
+     *       row, which is kept per thread across calls. Entries that cancel to 0 are dropped.
+     */
+    template<class T>
+    void spgemm_csr(long long m, long long n, const long long *ap, const int *ai, const T *av,
+                    const long long *bp, const int *bi, const T *bv,
+                    std::vector<long long> &cp, std::vector<int> &ci, std::vector<T> &cv) {
+        thread_local std::vector<T> acc;
+        thread_local std::vector<long long> mark;
+        thread_local std::vector<int> cols;
+        acc.resize(n);
+        mark.assign(n, -1);
+        cp.assign(m + 1, 0);
+        ci.clear();
+        cv.clear();
+        for (long long i = 0; i < m; i++) {
+            cols.clear();
+            for (long long ka = ap[i]; ka < ap[i + 1]; ka++) {
+                T a = av[ka];
+                for (long long kb = bp[ai[ka]]; kb < bp[ai[ka] + 1]; kb++) {
+                    int j = bi[kb];
+                    if (mark[j] != i) {
+                        mark[j] = i;
+                        acc[j] = a * bv[kb];
+                        cols.push_back(j);
+                    } else {
+                        acc[j] = acc[j] + a * bv[kb];
+                    }
+                }
+            }
+            // Sorting a short row is cheaper than scanning the whole accumulator.
+            if ((long long) cols.size() * 8 < n) {
+                std::sort(cols.begin(), cols.end());
+                for (int j : cols)
+                    if (!(acc[j] == T())) ci.push_back(j), cv.push_back(acc[j]);
+            } else {
+                for (long long j = 0; j < n; j++)
+                    if (mark[j] == i && !(acc[j] == T())) ci.push_back((int) j), cv.push_back(acc[j]);
+            }
+            cp[i + 1] = (long long) ci.size();
+        }
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXSPARSE_H
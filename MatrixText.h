@@ -0,0 +1,680 @@
+//
+// Non-interactive loaders for whitespace, Matrix Market and CSV text matrices.
+//
+
+#ifndef CPP_PROJECT_MATRIXTEXT_H
+#define CPP_PROJECT_MATRIXTEXT_H
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "MatrixIO.h"
+#include "ThreadPool.h"
+
+namespace io {
+    /*!
+     * @brief The text layouts understood by the loaders.
+     * @note Whitespace is the layout of input(): "rows cols" and the values row by row for a
+     *       dense matrix, "rows cols", "nnz" and one 1-based "i j v" per line for a sparse one.
+     *       MatrixMarket is the coordinate or array format of .mtx files, with real, integer
+     *       or pattern values and general, symmetric or skew-symmetric entries. Csv is one row
+     *       per line, separated by commas. Auto picks by the .mtx / .csv extension, then by the
+     *       content: a %%MatrixMarket banner, or a comma in the first line.
+     */
+    enum class TextFormat {
+        Auto, Whitespace, MatrixMarket, Csv
+    };
+
+    const long long TEXT_CHUNK = 1LL << 20; ///< bytes of text per parallel task, at least
+
+    /*!
+     * @brief A malformed text matrix, with the 1-based line where it was found.
+     */
+    class ParseError : public std::runtime_error {
+    private:
+        long long ln;
+        std::string why;
+
+    public:
+        ParseError(long long line, const std::string &reason)
+                : std::runtime_error("line " + std::to_string(line) + ": " + reason), ln(line), why(reason) {}
+
+        long long line() const { return ln; }
+
+        const std::string &reason() const { return why; }
+    };
+
+    /*!
+     * @brief A loaded matrix, either dense or compressed by rows.
+     */
+    template<class T>
+    struct TextMatrix {
+        long long rows = 0, cols = 0;
+        bool sparse = false;
+        std::vector<T> dense;            ///< rows * cols elements, row by row
+        std::vector<long long> ptr;      ///< CSR row offsets, with sorted columns and no zeros
+        std::vector<int> idx;
+        std::vector<T> val;
+    };
+
+    /*!
+     * @brief A 0-based coordinate entry.
+     */
+    template<class T>
+    struct TextEntry {
+        int i, j;
+        T v;
+    };
+
+    /*!
+     * @brief A position in a text buffer that counts the lines it passes.
+     */
+    struct TextCursor {
+        const char *p, *end;
+        long long line;
+        char delim; ///< a separator besides blanks, ',' for CSV
+
+        TextCursor(const char *p, const char *end, long long line, char delim = 0)
+                : p(p), end(end), line(line), delim(delim) {}
+
+        [[noreturn]] void fail(const std::string &reason) const {
+            throw ParseError(line, reason);
+        }
+
+        /*!
+         * @brief Skip spaces and tabs, staying on this line.
+         */
+        void blank() {
+            while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        }
+
+        /*!
+         * @brief Skip blanks and line breaks.
+         */
+        void space() {
+            for (; p != end; p++) {
+                if (*p == '\n') line++;
+                else if (*p != ' ' && *p != '\t' && *p != '\r') break;
+            }
+        }
+
+        bool at_eol() {
+            blank();
+            return p == end || *p == '\n';
+        }
+
+        /*!
+         * @brief Move past the end of this line, which must hold nothing more.
+         */
+        void next_line() {
+            if (!at_eol()) fail("unexpected text after the values");
+            if (p != end) p++, line++;
+        }
+
+        /*!
+         * @brief Skip the rest of this line.
+         */
+        void skip_line() {
+            const char *q = (const char *) std::memchr(p, '\n', (size_t) (end - p));
+            if (q) p = q + 1, line++;
+            else p = end;
+        }
+
+        /*!
+         * @brief Parse the number at the cursor, which must be followed by a separator.
+         */
+        template<class V>
+        V number() {
+            blank();
+            const char *q = p;
+            // from_chars takes no leading '+'
+            if (q != end && *q == '+' && q + 1 != end && q[1] != '-') q++;
+            V v{};
+            std::from_chars_result r = std::from_chars(q, end, v);
+            if (r.ec == std::errc::result_out_of_range) fail("the number is out of range");
+            if (r.ec != std::errc() || (r.ptr != end && *r.ptr != ' ' && *r.ptr != '\t' && *r.ptr != '\r' &&
+                                        *r.ptr != '\n' && *r.ptr != delim))
+                fail(p == end || *p == '\n' ? "expected a number" : "malformed number");
+            p = r.ptr;
+            return v;
+        }
+
+        /*!
+         * @brief Parse an unsigned decimal index, faster than number() for the common case.
+         */
+        long long index() {
+            blank();
+            const char *q = p;
+            unsigned long long v = 0;
+            while (q != end && (unsigned) (*q - '0') < 10 && q - p < 18) v = v * 10 + (unsigned) (*q++ - '0');
+            if (q == p || (q != end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n' && *q != delim))
+                return number<long long>();
+            p = q;
+            return (long long) v;
+        }
+
+        /*!
+         * @brief The next word of this line, lower-cased.
+         */
+        std::string word() {
+            blank();
+            std::string w;
+            for (; p != end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'; p++)
+                w += (char) (*p >= 'A' && *p <= 'Z' ? *p - 'A' + 'a' : *p);
+            return w;
+        }
+    };
+
+    /*!
+     * @brief A piece of text starting at a line boundary.
+     */
+    struct TextChunk {
+        const char *begin, *end;
+    };
+
+    /*!
+     * @brief Split [p, end) at line breaks into pieces of about TEXT_CHUNK bytes, a few per thread.
+     */
+    inline std::vector<TextChunk> text_chunks(const char *p, const char *end) {
+        long long n = end - p;
+        long long pieces = std::max(1LL, std::min<long long>(4LL * parallel::ThreadPool::instance().threads(),
+                                                             n / TEXT_CHUNK));
+        std::vector<TextChunk> c;
+        const char *from = p;
+        for (long long t = 1; t <= pieces && from != end; t++) {
+            const char *to = t == pieces ? end : std::max(from, p + n * t / pieces);
+            if (to != end) {
+                const char *q = (const char *) std::memchr(to, '\n', (size_t) (end - to));
+                to = q ? q + 1 : end;
+            }
+            c.push_back(TextChunk{from, to});
+            from = to;
+        }
+        return c;
+    }
+
+    /*!
+     * @brief Run f(t, cursor) on every chunk on the pool, each cursor counting lines from 0.
+     * @note A ParseError is rethrown with its line in the whole text; the earliest one wins.
+     */
+    template<class F>
+    void for_chunks(const std::vector<TextChunk> &c, long long line, char delim, F &&f) {
+        std::vector<std::exception_ptr> error(c.size());
+        long long bytes = c.empty() ? 0 : c.back().end - c.front().begin;
+        parallel::ThreadPool::instance().parallel_for((long long) c.size(), bytes, [&](long long t) {
+            try {
+                TextCursor cur(c[t].begin, c[t].end, 0, delim);
+                f(t, cur);
+            } catch (...) {
+                error[t] = std::current_exception();
+            }
+        });
+        for (size_t t = 0; t < c.size(); t++) {
+            if (!error[t]) continue;
+            try {
+                std::rethrow_exception(error[t]);
+            } catch (const ParseError &e) {
+                throw ParseError(line + std::count(c[0].begin, c[t].begin, '\n') + e.line(), e.reason());
+            }
+        }
+    }
+
+    /*!
+     * @brief Line breaks in [p, end), not counting one that ends the text.
+     */
+    inline long long lines_in(const char *p, const char *end) {
+        if (p != end && end[-1] == '\n') end--;
+        return std::count(p, end, '\n');
+    }
+
+    /*!
+     * @brief The line of the k-th number (k from 0) of a chunk, see for_chunks().
+     */
+    inline long long line_of_number(const TextChunk &c, long long line, long long k, char delim) {
+        TextCursor cur(c.begin, c.end, line, delim);
+        for (;; k--) {
+            cur.space();
+            if (k == 0) return cur.line;
+            while (cur.p != cur.end && *cur.p != ' ' && *cur.p != '\t' && *cur.p != '\r' && *cur.p != '\n') cur.p++;
+        }
+    }
+
+    inline bool is_space(char ch) {
+        return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+    }
+
+    /*!
+     * @brief The end of the count-th word from p on, end when there are fewer.
+     */
+    inline const char *words_end(const char *p, const char *end, long long count) {
+        for (; count > 0; count--) {
+            while (p != end && is_space(*p)) p++;
+            if (p == end) break;
+            while (p != end && !is_space(*p)) p++;
+        }
+        return p;
+    }
+
+    /*!
+     * @brief The end of the count-th line from p on that is neither blank nor a % comment,
+     *        end when there are fewer.
+     */
+    inline const char *lines_end(const char *p, const char *end, long long count) {
+        while (count > 0) {
+            while (p != end && is_space(*p)) p++;
+            if (p == end) break;
+            if (*p != '%') count--;
+            const char *q = (const char *) std::memchr(p, '\n', (size_t) (end - p));
+            p = q ? q + 1 : end;
+        }
+        return p;
+    }
+
+    /*!
+     * @brief Move a cursor that was parsed up to stop by a copy of it.
+     */
+    inline void advance(TextCursor &cur, const char *stop) {
+        cur.line += std::count(cur.p, stop, '\n');
+        cur.p = stop;
+    }
+
+    /*!
+     * @brief Parse whitespace-separated numbers, in any line layout, until the end of the text.
+     * @param[in] count : the number expected
+     * @param[in] rest : whether they must fill the rest of the text; otherwise the cursor
+     *                   stops after the last of them
+     */
+    template<class T>
+    std::vector<T> read_values(TextCursor &cur, long long count, bool rest = true) {
+        if (!rest) {
+            TextCursor part = cur;
+            part.end = words_end(cur.p, cur.end, count);
+            std::vector<T> v = read_values<T>(part, count);
+            advance(cur, part.end);
+            return v;
+        }
+        std::vector<TextChunk> c = text_chunks(cur.p, cur.end);
+        std::vector<std::vector<T> > part(c.size());
+        for_chunks(c, cur.line, 0, [&](long long t, TextCursor &in) {
+            std::vector<T> &v = part[t];
+            v.reserve((size_t) std::min<long long>(count, (in.end - in.p) / 2 + 1));
+            for (in.space(); in.p != in.end; in.space()) v.push_back(in.number<T>());
+        });
+        long long total = 0;
+        for (const std::vector<T> &v : part) total += (long long) v.size();
+        if (total < count) {
+            cur.line += lines_in(cur.p, cur.end);
+            cur.fail("expected " + std::to_string(count) + " values, found " + std::to_string(total));
+        }
+        std::vector<T> res((size_t) count);
+        long long off = 0;
+        for (size_t t = 0; t < part.size(); t++) {
+            long long n = (long long) part[t].size();
+            if (off + n > count) {
+                long long line = cur.line + std::count(c[0].begin, c[t].begin, '\n');
+                throw ParseError(line_of_number(c[t], line, count - off, 0),
+                                 "more values than the " + std::to_string(count) + " of the matrix");
+            }
+            std::copy(part[t].begin(), part[t].end(), res.begin() + off);
+            off += n;
+        }
+        return res;
+    }
+
+    /*!
+     * @brief Build the CSR arrays of m from 0-based entries in input order; duplicates are summed.
+     */
+    template<class T>
+    void build_csr(TextMatrix<T> &m, const std::vector<std::vector<TextEntry<T> > > &part) {
+        m.sparse = true;
+        m.dense.clear();
+        m.ptr.assign(m.rows + 1, 0);
+        long long n = 0;
+        for (const std::vector<TextEntry<T> > &p : part) {
+            n += (long long) p.size();
+            for (const TextEntry<T> &e : p) m.ptr[e.i + 1]++;
+        }
+        for (long long r = 0; r < m.rows; r++) m.ptr[r + 1] += m.ptr[r];
+        m.idx.resize(n);
+        m.val.resize(n);
+        std::vector<long long> pos(m.ptr.begin(), m.ptr.end() - 1);
+        for (const std::vector<TextEntry<T> > &p : part)
+            for (const TextEntry<T> &e : p) {
+                long long k = pos[e.i]++;
+                m.idx[k] = e.j, m.val[k] = e.v;
+            }
+        // Sort and merge each row in place, then close the gaps left by merged entries.
+        std::vector<long long> kept(m.rows);
+        long long blocks = std::max(1LL, std::min<long long>(4LL * parallel::ThreadPool::instance().threads(), m.rows / 64));
+        parallel::ThreadPool::instance().parallel_for(blocks, n, [&](long long t) {
+            std::vector<std::pair<long long, T> > row;
+            for (long long r = m.rows * t / blocks; r < m.rows * (t + 1) / blocks; r++) {
+                long long b = m.ptr[r], e = m.ptr[r + 1], w = b;
+                if (!std::is_sorted(m.idx.begin() + b, m.idx.begin() + e)) {
+                    // The position breaks ties, so duplicates are summed in input order as in
+                    // SparseMat::from_triplets.
+                    row.clear();
+                    for (long long k = b; k < e; k++) row.emplace_back((long long) m.idx[k] << 32 | (k - b), m.val[k]);
+                    std::sort(row.begin(), row.end(), [](const std::pair<long long, T> &x, const std::pair<long long, T> &y) {
+                        return x.first < y.first;
+                    });
+                    for (long long k = b; k < e; k++) m.idx[k] = (int) (row[k - b].first >> 32), m.val[k] = row[k - b].second;
+                }
+                for (long long k = b; k < e;) {
+                    T sum = m.val[k];
+                    long long q = k + 1;
+                    for (; q < e && m.idx[q] == m.idx[k]; q++) sum = sum + m.val[q];
+                    if (!(sum == T())) m.idx[w] = m.idx[k], m.val[w] = sum, w++;
+                    k = q;
+                }
+                kept[r] = w - b;
+            }
+        });
+        long long w = 0;
+        for (long long r = 0; r < m.rows; r++) {
+            long long b = m.ptr[r];
+            m.ptr[r] = w;
+            if (w != b) {
+                std::copy(m.idx.begin() + b, m.idx.begin() + b + kept[r], m.idx.begin() + w);
+                std::copy(m.val.begin() + b, m.val.begin() + b + kept[r], m.val.begin() + w);
+            }
+            w += kept[r];
+        }
+        m.ptr[m.rows] = w;
+        m.idx.resize(w);
+        m.val.resize(w);
+    }
+
+    /*!
+     * @brief Read one entry per line until the end of the text, in parallel chunks.
+     * @param[in] count : the number of entries expected
+     * @param[in] valued : whether the lines hold a value after the 1-based row and column
+     * @param[in] mirror : 0, or 1 / -1 to also store (j, i, v) / (j, i, -v) off the diagonal
+     * @param[in] rest : whether they must fill the rest of the text; otherwise the cursor
+     *                   stops after the line of the last of them
+     */
+    template<class T>
+    void read_entries(TextCursor &cur, TextMatrix<T> &m, long long count, bool valued, int mirror, bool rest = true) {
+        if (!rest) {
+            TextCursor part = cur;
+            part.end = lines_end(cur.p, cur.end, count);
+            read_entries(part, m, count, valued, mirror);
+            advance(cur, part.end);
+            return;
+        }
+        std::vector<TextChunk> c = text_chunks(cur.p, cur.end);
+        std::vector<std::vector<TextEntry<T> > > part(c.size());
+        std::vector<long long> lines(c.size());
+        for_chunks(c, cur.line, 0, [&](long long t, TextCursor &in) {
+            std::vector<TextEntry<T> > &v = part[t];
+            v.reserve((size_t) std::min<long long>(count, (in.end - in.p) / 6 + 1));
+            for (in.space(); in.p != in.end; in.space()) {
+                if (*in.p == '%') {
+                    in.skip_line();
+                    continue;
+                }
+                long long i = in.index(), j = in.index();
+                T x = valued ? in.number<T>() : T(1);
+                if (i <= 0 || i > m.rows || j <= 0 || j > m.cols) in.fail("row or column is out of range");
+                in.next_line();
+                lines[t]++;
+                v.push_back(TextEntry<T>{(int) i - 1, (int) j - 1, x});
+                if (mirror && i != j) v.push_back(TextEntry<T>{(int) j - 1, (int) i - 1, mirror > 0 ? x : T(-x)});
+            }
+        });
+        long long total = 0;
+        for (size_t t = 0; t < c.size(); t++) {
+            if (total + lines[t] > count) {
+                TextCursor in(c[t].begin, c[t].end, cur.line + std::count(c[0].begin, c[t].begin, '\n'));
+                for (long long k = count - total;; k--) {
+                    in.space();
+                    if (*in.p == '%') k++;
+                    else if (k == 0) break;
+                    in.skip_line();
+                }
+                in.fail("more entries than the " + std::to_string(count) + " declared");
+            }
+            total += lines[t];
+        }
+        if (total < count) {
+            cur.line += lines_in(cur.p, cur.end);
+            cur.fail("expected " + std::to_string(count) + " entries, found " + std::to_string(total));
+        }
+        build_csr(m, part);
+    }
+
+    /*!
+     * @brief Read "rows cols" and check both are positive.
+     * @param[in] limit : the largest allowed rows or cols
+     */
+    inline void read_size(TextCursor &cur, long long &rows, long long &cols, long long limit) {
+        cur.space();
+        rows = cur.number<long long>();
+        cols = cur.number<long long>();
+        if (rows <= 0 || cols <= 0 || rows > limit || cols > limit || rows > LLONG_MAX / cols)
+            cur.fail("rows or columns are out of range");
+    }
+
+    /*!
+     * @param[in] rest : whether the matrix must fill the rest of the text, see TextReader
+     */
+    template<class T>
+    void read_whitespace(TextCursor &cur, TextMatrix<T> &m, bool sparse, bool rest = true) {
+        read_size(cur, m.rows, m.cols, sparse ? INT_MAX : LLONG_MAX);
+        if (!sparse) {
+            m.dense = read_values<T>(cur, m.rows * m.cols, rest);
+            return;
+        }
+        cur.space();
+        long long nnz = cur.number<long long>();
+        if (nnz < 0 || nnz > m.rows * m.cols) cur.fail("the number of non-zero values is out of range");
+        cur.next_line();
+        read_entries(cur, m, nnz, true, 0, rest);
+    }
+
+    template<class T>
+    void read_matrix_market(TextCursor &cur, TextMatrix<T> &m) {
+        if (cur.word() != "%%matrixmarket" || cur.word() != "matrix") cur.fail("not a Matrix Market matrix");
+        std::string layout = cur.word(), field = cur.word(), symmetry = cur.word();
+        if (layout != "coordinate" && layout != "array") cur.fail("unknown Matrix Market format " + layout);
+        if (field != "real" && field != "double" && field != "integer" && field != "pattern")
+            cur.fail("unsupported Matrix Market field " + field);
+        if (symmetry != "general" && symmetry != "symmetric" && symmetry != "skew-symmetric" && symmetry != "hermitian")
+            cur.fail("unknown Matrix Market symmetry " + symmetry);
+        if (layout == "array" && (field == "pattern" || symmetry != "general"))
+            cur.fail("only general Matrix Market arrays are supported");
+        cur.next_line();
+        for (cur.space(); cur.p != cur.end && *cur.p == '%'; cur.space()) cur.skip_line();
+        read_size(cur, m.rows, m.cols, layout == "array" ? LLONG_MAX : INT_MAX);
+        if (layout == "array") {
+            cur.next_line();
+            std::vector<T> v = read_values<T>(cur, m.rows * m.cols);
+            m.dense.resize(v.size());
+            // stored column by column
+            for (long long j = 0; j < m.cols; j++)
+                for (long long i = 0; i < m.rows; i++) m.dense[i * m.cols + j] = v[j * m.rows + i];
+            return;
+        }
+        long long nnz = cur.number<long long>();
+        if (nnz < 0 || nnz > m.rows * m.cols) cur.fail("the number of entries is out of range");
+        cur.next_line();
+        read_entries(cur, m, nnz, field != "pattern", symmetry == "general" ? 0 : symmetry == "skew-symmetric" ? -1 : 1);
+    }
+
+    template<class T>
+    void read_csv(TextCursor &cur, TextMatrix<T> &m) {
+        cur.space();
+        if (cur.p == cur.end) cur.fail("expected a number");
+        TextCursor first = cur;
+        m.cols = 1;
+        for (; first.p != first.end && *first.p != '\n'; first.p++) m.cols += *first.p == ',';
+        std::vector<TextChunk> c = text_chunks(cur.p, cur.end);
+        std::vector<std::vector<T> > part(c.size());
+        for_chunks(c, cur.line, ',', [&](long long t, TextCursor &in) {
+            std::vector<T> &v = part[t];
+            v.reserve((size_t) ((in.end - in.p) / 2 + 1));
+            for (in.space(); in.p != in.end; in.space()) {
+                for (long long j = 0; j < m.cols; j++) {
+                    if (j > 0) {
+                        in.blank();
+                        if (in.p == in.end || *in.p != ',') in.fail("expected " + std::to_string(m.cols) + " values");
+                        in.p++;
+                    }
+                    v.push_back(in.number<T>());
+                }
+                in.next_line();
+            }
+        });
+        long long total = 0;
+        for (const std::vector<T> &v : part) total += (long long) v.size();
+        m.rows = total / m.cols;
+        m.dense.resize(total);
+        long long off = 0;
+        for (const std::vector<T> &v : part) {
+            std::copy(v.begin(), v.end(), m.dense.begin() + off);
+            off += (long long) v.size();
+        }
+    }
+
+    /*!
+     * @brief Resolve TextFormat::Auto, see TextFormat.
+     */
+    inline TextFormat text_format(TextFormat f, const std::string &path, const char *p, const char *end) {
+        if (f != TextFormat::Auto) return f;
+        std::string ext = path.substr(std::min(path.size(), path.rfind('.')));
+        for (char &ch : ext) ch = (char) (ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch);
+        if (ext == ".mtx") return TextFormat::MatrixMarket;
+        if (ext == ".csv") return TextFormat::Csv;
+        if (p == end) return TextFormat::Whitespace;
+        if (end - p >= 14 && std::memcmp(p, "%%MatrixMarket", 14) == 0) return TextFormat::MatrixMarket;
+        const char *eol = (const char *) std::memchr(p, '\n', (size_t) (end - p));
+        if (std::find(p, eol ? eol : end, ',') != (eol ? eol : end)) return TextFormat::Csv;
+        return TextFormat::Whitespace;
+    }
+
+    /*!
+     * @brief Parse a text matrix held in [p, end).
+     * @param[in] path : the file name, for TextFormat::Auto; may be empty
+     * @param[in] sparse : read the sparse whitespace layout rather than the dense one
+     * @return the matrix; sparse for Matrix Market coordinates and the sparse layout
+     * @note Numbers are read with std::from_chars. Text of more than TEXT_CHUNK bytes is
+     *       split at line breaks and parsed on the thread pool.
+     * @exception ParseError : the text is malformed
+     */
+    template<class T>
+    TextMatrix<T> read_text(const char *p, const char *end, TextFormat f, const std::string &path, bool sparse) {
+        static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                      "Text matrices need an arithmetic element type!");
+        TextMatrix<T> m;
+        TextCursor cur(p, end, 1);
+        switch (text_format(f, path, p, end)) {
+            case TextFormat::MatrixMarket:
+                read_matrix_market(cur, m);
+                break;
+            case TextFormat::Csv:
+                cur.delim = ',';
+                read_csv(cur, m);
+                break;
+            default:
+                read_whitespace(cur, m, sparse);
+        }
+        return m;
+    }
+
+    /*!
+     * @brief Reads whitespace-layout matrices one after another, the way a sequence of
+     *        input() calls reads them from the console, e.g. a dense and then a sparse one.
+     * @note A matrix ends after its last value or entry and the next one may start right
+     *       there, whereas read_text() expects one matrix to fill the text. Large matrices
+     *       are still parsed on the thread pool.
+     */
+    class TextReader {
+    private:
+        std::unique_ptr<Mapping> file;
+        TextCursor cur;
+
+    public:
+        /*!
+         * @brief Read the file at path, mapped into memory until the reader is destroyed.
+         * @exception runtime_error : the file cannot be read
+         */
+        explicit TextReader(const std::string &path)
+                : file(new Mapping(path)), cur(file->data(), file->data() + file->size(), 1) {}
+
+        /*!
+         * @brief Read [p, end), which must outlive the reader.
+         */
+        TextReader(const char *p, const char *end) : cur(p, end, 1) {}
+
+        TextReader(const TextReader &) = delete;
+
+        TextReader &operator=(const TextReader &) = delete;
+
+        /*!
+         * @brief Whether only blanks are left.
+         */
+        bool done() {
+            cur.space();
+            return cur.p == cur.end;
+        }
+
+        /*!
+         * @brief The 1-based line the reader has reached.
+         */
+        long long line() const { return cur.line; }
+
+        /*!
+         * @brief The next matrix, stopping right after it.
+         * @param[in] sparse : read the sparse layout rather than the dense one
+         * @exception ParseError : the matrix is malformed or cut short
+         */
+        template<class T>
+        TextMatrix<T> next(bool sparse) {
+            static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                          "Text matrices need an arithmetic element type!");
+            TextMatrix<T> m;
+            read_whitespace(cur, m, sparse, false);
+            return m;
+        }
+    };
+
+    /*!
+     * @brief Turn a sparse result into a dense one.
+     */
+    template<class T>
+    void densify(TextMatrix<T> &m) {
+        if (!m.sparse) return;
+        m.dense.assign(m.rows * m.cols, T());
+        for (long long r = 0; r < m.rows; r++)
+            for (long long k = m.ptr[r]; k < m.ptr[r + 1]; k++) m.dense[r * m.cols + m.idx[k]] = m.val[k];
+        m.sparse = false;
+        m.ptr.clear(), m.idx.clear(), m.val.clear();
+    }
+
+    /*!
+     * @brief Turn a dense result into CSR, dropping zeros.
+     */
+    template<class T>
+    void sparsify(TextMatrix<T> &m) {
+        if (m.sparse) return;
+        m.ptr.assign(m.rows + 1, 0);
+        for (long long r = 0; r < m.rows; r++) {
+            for (long long j = 0; j < m.cols; j++) {
+                const T &v = m.dense[r * m.cols + j];
+                if (!(v == T())) m.idx.push_back((int) j), m.val.push_back(v);
+            }
+            m.ptr[r + 1] = (long long) m.idx.size();
+        }
+        m.sparse = true;
+        m.dense = std::vector<T>();
+    }
+}
+
+#endif //CPP_PROJECT_MATRIXTEXT_H
@@ -6,101 +6,405 @@
 #define CPP_PROJECT_MATRIXTOOPENCV_H
 
 #include "MyMatrix.h"
+#include <climits>
+#include <cstring>
 #include <opencv2/opencv.hpp>
 
-cv::Mat parseToOpenCV(dense::DenseMat<uchar> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_8UC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<uchar>(i, j) = (uchar) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @brief The OpenCV depth of an element type; undefined for types OpenCV cannot hold.
+ */
+template<class T>
+struct CvDepth;
+
+template<>
+struct CvDepth<uchar> {
+    static const int value = CV_8U;
+};
+
+template<>
+struct CvDepth<char> {
+    static const int value = CV_8S;
+};
+
+template<>
+struct CvDepth<schar> {
+    static const int value = CV_8S;
+};
+
+template<>
+struct CvDepth<ushort> {
+    static const int value = CV_16U;
+};
+
+template<>
+struct CvDepth<short> {
+    static const int value = CV_16S;
+};
+
+template<>
+struct CvDepth<int> {
+    static const int value = CV_32S;
+};
+
+template<>
+struct CvDepth<float> {
+    static const int value = CV_32F;
+};
+
+template<>
+struct CvDepth<double> {
+    static const int value = CV_64F;
+};
+
+namespace kernel {
+    const long long CHANNEL_BLOCK = 256; ///< pixels converted at a time between element types
+
+#ifdef MATRIX_USE_AVX2
+    /*!
+     * @brief pshufb masks between CN interleaved channels of E-byte elements and their planes.
+     * @note A group is L = 16 / E pixels: CN interleaved vectors, or one vector per plane.
+     *       split[c][v] gathers the channel c bytes of interleaved vector v into plane order,
+     *       merge[v][c] scatters plane c into interleaved vector v; the others become 0.
+     */
+    template<int CN, int E>
+    struct ChannelMasks {
+        __m128i split[CN][CN], merge[CN][CN];
+
+        ChannelMasks() {
+            const int L = 16 / E;
+            for (int c = 0; c < CN; c++)
+                for (int v = 0; v < CN; v++) {
+                    alignas(16) char s[16], m[16];
+                    for (int k = 0; k < L; k++)
+                        for (int b = 0; b < E; b++) {
+                            int from = CN * k + c, to = L * v + k;
+                            s[k * E + b] = (char) (from / L == v ? from % L * E + b : 0x80);
+                            m[k * E + b] = (char) (to % CN == c ? to / CN * E + b : 0x80);
+                        }
+                    split[c][v] = _mm_load_si128((const __m128i *) s);
+                    merge[v][c] = _mm_load_si128((const __m128i *) m);
+                }
+        }
+    };
+#endif
+
+    /*!
+     * @brief dst[c][i] = src[i * CN + c] for n pixels of CN interleaved channels.
+     */
+    template<int CN, class T>
+    void split_channels(const T *src, long long n, T *const *dst) {
+        long long i = 0;
+#ifdef MATRIX_USE_AVX2
+        const int E = (int) sizeof(T), L = 16 / E;
+        static const ChannelMasks<CN, E> M;
+        for (; i + L <= n; i += L) {
+            __m128i in[CN];
+            for (int v = 0; v < CN; v++) in[v] = _mm_loadu_si128((const __m128i *) (src + i * CN + v * L));
+            for (int c = 0; c < CN; c++) {
+                __m128i r = _mm_shuffle_epi8(in[0], M.split[c][0]);
+                for (int v = 1; v < CN; v++) r = _mm_or_si128(r, _mm_shuffle_epi8(in[v], M.split[c][v]));
+                _mm_storeu_si128((__m128i *) (dst[c] + i), r);
+            }
+        }
+#endif
+        for (; i < n; i++)
+            for (int c = 0; c < CN; c++) dst[c][i] = src[i * CN + c];
+    }
+
+    /*!
+     * @brief dst[i * CN + c] = src[c][i], the inverse of split_channels().
+     */
+    template<int CN, class T>
+    void merge_channels(const T *const *src, long long n, T *dst) {
+        long long i = 0;
+#ifdef MATRIX_USE_AVX2
+        const int E = (int) sizeof(T), L = 16 / E;
+        static const ChannelMasks<CN, E> M;
+        for (; i + L <= n; i += L) {
+            __m128i in[CN];
+            for (int c = 0; c < CN; c++) in[c] = _mm_loadu_si128((const __m128i *) (src[c] + i));
+            for (int v = 0; v < CN; v++) {
+                __m128i r = _mm_shuffle_epi8(in[0], M.merge[v][0]);
+                for (int c = 1; c < CN; c++) r = _mm_or_si128(r, _mm_shuffle_epi8(in[c], M.merge[v][c]));
+                _mm_storeu_si128((__m128i *) (dst + i * CN + v * L), r);
+            }
+        }
+#endif
+        for (; i < n; i++)
+            for (int c = 0; c < CN; c++) dst[i * CN + c] = src[c][i];
+    }
+
+    /*!
+     * @brief Split n pixels of cn channels of S into planes of T, with dst[c][i] = (T) v.
+     * @note 2, 3 and 4 channels have shuffle kernels. A change of type splits a block
+     *       of pixels into S planes first, then casts them with fixed-length loops.
+     */
+    template<class S, class T>
+    void split_channels(int cn, const S *src, long long n, T *const *dst) {
+        if (cn == 1 || cn > 4) {
+            for (long long i = 0; i < n; i++)
+                for (int c = 0; c < cn; c++) dst[c][i] = (T) src[i * cn + c];
+        } else if constexpr (std::is_same<S, T>::value) {
+            if (cn == 2) split_channels<2>(src, n, dst);
+            else if (cn == 3) split_channels<3>(src, n, dst);
+            else split_channels<4>(src, n, dst);
+        } else {
+            S buf[4][CHANNEL_BLOCK];
+            S *plane[4] = {buf[0], buf[1], buf[2], buf[3]};
+            for (long long i = 0; i < n; i += CHANNEL_BLOCK) {
+                long long len = std::min(CHANNEL_BLOCK, n - i);
+                split_channels<S, S>(cn, src + i * cn, len, plane);
+                for (int c = 0; c < cn; c++) {
+                    T *d = dst[c] + i;
+                    if (len == CHANNEL_BLOCK)
+                        for (long long k = 0; k < CHANNEL_BLOCK; k++) d[k] = (T) buf[c][k];
+                    else
+                        for (long long k = 0; k < len; k++) d[k] = (T) buf[c][k];
+                }
+            }
+        }
+    }
+
+    /*!
+     * @brief Merge cn planes of T into n interleaved pixels, the same element type.
+     */
+    template<class T>
+    void merge_channels(int cn, const T *const *src, long long n, T *dst) {
+        if (cn == 1) std::copy(src[0], src[0] + n, dst);
+        else if (cn == 2) merge_channels<2>(src, n, dst);
+        else if (cn == 3) merge_channels<3>(src, n, dst);
+        else if (cn == 4) merge_channels<4>(src, n, dst);
+        else
+            for (long long i = 0; i < n; i++)
+                for (int c = 0; c < cn; c++) dst[i * cn + c] = src[c][i];
+    }
 }
 
-cv::Mat parseToOpenCV(dense::DenseMat<char> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_8SC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<uchar>(i, j) = (char) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @exception length_error : the matrix has more rows or columns than a cv::Mat
+ */
+inline void checkCvSize(long long row, long long col) {
+    if (row > INT_MAX || col > INT_MAX) throw length_error("The matrix is too large for OpenCV!");
 }
 
-cv::Mat parseToOpenCV(dense::DenseMat<ushort> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_16UC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<ushort>(i, j) = (ushort) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @brief A cv::Mat header over the buffer of p, without copying it.
+ * @param[in] channels : the channels per pixel when p holds interleaved pixels, so the
+ *            header has p.col() / channels columns
+ * @note The header shares p's elements: writes go both ways, and it must not be used after
+ *       p is destroyed, resized or moved from. Use parseToOpenCV() for an owned copy.
+ * @exception invalid_argument : the columns are not a multiple of channels
+ */
+template<class T>
+cv::Mat wrapToOpenCV(dense::DenseMat<T> &p, int channels = 1) {
+    checkCvSize(p.row(), p.col());
+    if (channels <= 0 || channels > CV_CN_MAX || p.col() % channels)
+        throw invalid_argument("The columns are not a multiple of the channels!");
+    return cv::Mat((int) p.row(), (int) (p.col() / channels), CV_MAKETYPE(CvDepth<T>::value, channels), p.buffer());
 }
 
-cv::Mat parseToOpenCV(dense::DenseMat<short> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_16SC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<short>(i, j) = (short) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @brief A cv::Mat header over a view whose rows are contiguous, such as slicing().
+ * @exception invalid_argument : the columns of the view are strided, as in trans()
+ */
+template<class T>
+cv::Mat wrapToOpenCV(const dense::DenseView<T> &v) {
+    checkCvSize(v.row(), v.col());
+    if (v.col() > 1 && v.col_stride() != 1) throw invalid_argument("The view is not stored row by row!");
+    size_t step = v.row() > 1 ? (size_t) v.row_stride() * sizeof(T) : cv::Mat::AUTO_STEP;
+    return cv::Mat((int) v.row(), (int) v.col(), CV_MAKETYPE(CvDepth<T>::value, 1), v.buffer(), step);
 }
 
-cv::Mat parseToOpenCV(dense::DenseMat<int> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_32SC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<int>(i, j) = (int) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @brief A DenseView over the elements of a cv::Mat, without copying them.
+ * @return rows x (cols * channels) interleaved elements; see channelView() for one channel
+ * @note The view shares a's elements and must not outlive them.
+ * @exception invalid_argument : a has more than two dimensions, or another element type than T
+ */
+template<class T>
+dense::DenseView<T> wrapToMatrix(cv::Mat &a) {
+    if (a.dims > 2) throw invalid_argument("cv matrix is not two-dimensional!");
+    if (a.depth() != CvDepth<T>::value) throw invalid_argument("The element type of the cv matrix does not match!");
+    return dense::DenseView<T>(a.ptr<T>(), a.rows, (long long) a.cols * a.channels(),
+                               (long long) (a.step[0] / sizeof(T)), 1);
 }
 
-cv::Mat parseToOpenCV(dense::DenseMat<float> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_32FC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<float>(i, j) = (float) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @brief Channel c of a matrix of interleaved pixels, as a strided view.
+ * @param[in] channels : the channels per pixel, as in wrapToOpenCV()
+ * @exception invalid_argument : the columns are not a multiple of channels
+ * @exception out_of_range : c is not in [0, channels)
+ */
+template<class T>
+dense::DenseView<T> channelView(dense::DenseMat<T> &p, int channels, int c) {
+    if (channels <= 0 || p.col() % channels) throw invalid_argument("The columns are not a multiple of the channels!");
+    if (c < 0 || c >= channels) throw out_of_range("The channel is out of range!");
+    return dense::DenseView<T>(p.buffer() + c, p.row(), p.col() / channels, p.col(), channels);
 }
 
-cv::Mat parseToOpenCV(dense::DenseMat<double> &p) {
-    cv::Mat a(cv::Size(p.col(), p.row()), CV_64FC1);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++)
-            a.at<double>(i, j) = (double) p.get(i + 1, j + 1);
-    return a;
+/*!
+ * @brief Copy a matrix into a new cv::Mat of the matching type, with one memcpy.
+ * @param[in] channels : see wrapToOpenCV()
+ */
+template<class T>
+cv::Mat parseToOpenCV(const dense::DenseMat<T> &p, int channels = 1) {
+    return wrapToOpenCV(const_cast<dense::DenseMat<T> &>(p), channels).clone();
 }
 
+/*!
+ * @brief Interleave planes of the same size into a new cv::Mat of planes.size() channels.
+ * @exception invalid_argument : there are no planes, too many, or their sizes differ
+ */
 template<class T>
-dense::DenseMat<T> parseToMatrix(cv::Mat &a) {
-    if(a.type() > 6) throw invalid_argument("cv matrix is not single channel!");
-    int n = a.rows, m = a.cols;
-    dense::DenseMat<T> p(n, m);
-    for (int i = 0; i < p.row(); i++)
-        for (int j = 0; j < p.col(); j++) {
-            int type = a.type();
-            switch (type) {
-                case CV_8UC1:
-                    p.set(i + 1, j + 1, (T)a.at<uchar>(i, j));
-                    break;
-                case CV_8SC1:
-                    p.set(i + 1, j + 1, (T)a.at<char>(i, j));
-                    break;
-                case CV_16UC1:
-                    p.set(i + 1, j + 1, (T)a.at<ushort>(i, j));
-                    break;
-                case CV_16SC1:
-                    p.set(i + 1, j + 1, (T)a.at<short>(i, j));
-                    break;
-                case CV_32SC1:
-                    p.set(i + 1, j + 1, (T)a.at<int>(i, j));
-                    break;
-                case CV_32FC1:
-                    p.set(i + 1, j + 1, (T)a.at<float>(i, j));
-                    break;
-                case CV_64FC1:
-                    p.set(i + 1, j + 1, (T)a.at<double>(i, j));
-                    break;
-                default:
-                    throw invalid_argument("cv matrix is not single channel!");
-            }
+cv::Mat parseToOpenCV(const std::vector<dense::DenseMat<T> > &planes) {
+    int cn = (int) planes.size();
+    if (cn == 0 || cn > CV_CN_MAX) throw invalid_argument("The number of channels is out of range!");
+    long long n = planes[0].row(), m = planes[0].col();
+    checkCvSize(n, m);
+    std::vector<const T *> src(cn);
+    for (int c = 0; c < cn; c++) {
+        if (planes[c].row() != n || planes[c].col() != m) throw invalid_argument("The channels differ in size!");
+        src[c] = planes[c].buffer();
+    }
+    cv::Mat a((int) n, (int) m, CV_MAKETYPE(CvDepth<T>::value, cn));
+    parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+    long long tasks = std::min<long long>(n, 4LL * pool.threads());
+    pool.parallel_for(tasks, n * m * cn, [&](long long t) {
+        std::vector<const T *> row(cn);
+        for (long long i = n * t / tasks; i < n * (t + 1) / tasks; i++) {
+            for (int c = 0; c < cn; c++) row[c] = src[c] + i * m;
+            kernel::merge_channels(cn, row.data(), m, a.ptr<T>((int) i));
         }
+    });
+    return a;
+}
+
+/*!
+ * @brief dst = (T) src for the rows of a, one row of length rows * cols when a is continuous.
+ * @note The inner loop is a plain typed cast, which the compiler vectorizes.
+ */
+template<class S, class T>
+void castRows(const cv::Mat &a, T *dst) {
+    bool flat = a.isContinuous();
+    long long width = (long long) a.cols * a.channels();
+    long long rows = flat ? 1 : a.rows, cols = flat ? a.rows * width : width;
+    for (long long i = 0; i < rows; i++) {
+        const S *src = a.ptr<S>((int) i);
+        T *d = dst + i * cols;
+        for (long long j = 0; j < cols; j++) d[j] = (T) src[j];
+    }
+}
+
+/*!
+ * @brief Split each row of a into its channels, with planes[c] holding rows x cols of T.
+ */
+template<class S, class T>
+void splitRows(const cv::Mat &a, T *const *planes) {
+    int cn = a.channels();
+    long long m = a.cols;
+    long long n = a.rows;
+    parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+    long long tasks = std::min<long long>(n, 4LL * pool.threads());
+    pool.parallel_for(tasks, n * m * cn, [&](long long t) {
+        std::vector<T *> row(cn);
+        for (long long i = n * t / tasks; i < n * (t + 1) / tasks; i++) {
+            for (int c = 0; c < cn; c++) row[c] = planes[c] + i * m;
+            kernel::split_channels(cn, a.ptr<S>((int) i), m, row.data());
+        }
+    });
+}
+
+/*!
+ * @brief Copy a cv::Mat into a new matrix, casting each element to T.
+ * @return rows x (cols * channels) elements; pixels stay interleaved, see parseToPlanes()
+ * @note The same type is copied with memcpy, per row when a is not continuous; other
+ *       types are cast as (T) v, with the dispatch on the type done once.
+ * @exception invalid_argument : a has more than two dimensions or an unsupported depth
+ */
+template<class T>
+dense::DenseMat<T> parseToMatrix(const cv::Mat &a) {
+    if (a.dims > 2) throw invalid_argument("cv matrix is not two-dimensional!");
+    long long width = (long long) a.cols * a.channels();
+    dense::DenseMat<T> p(a.rows, width, dense::uninitialized);
+    T *d = p.buffer();
+    if (a.depth() == CvDepth<T>::value) {
+        if (a.isContinuous()) std::memcpy(d, a.data, sizeof(T) * a.rows * width);
+        else
+            for (int i = 0; i < a.rows; i++) std::memcpy(d + i * width, a.ptr(i), sizeof(T) * width);
+        return p;
+    }
+    switch (a.depth()) {
+        case CV_8U:
+            castRows<uchar>(a, d);
+            break;
+        case CV_8S:
+            castRows<schar>(a, d);
+            break;
+        case CV_16U:
+            castRows<ushort>(a, d);
+            break;
+        case CV_16S:
+            castRows<short>(a, d);
+            break;
+        case CV_32S:
+            castRows<int>(a, d);
+            break;
+        case CV_32F:
+            castRows<float>(a, d);
+            break;
+        case CV_64F:
+            castRows<double>(a, d);
+            break;
+        default:
+            throw invalid_argument("Unsupported cv matrix depth!");
+    }
     return p;
 }
 
+/*!
+ * @brief Split a cv::Mat into one matrix per channel, casting each element to T.
+ * @note Each plane is an ordinary DenseMat, so conv(), stats() and the like run on it
+ *       directly. Pixels are deinterleaved with shuffle kernels, see kernel::split_channels().
+ * @exception invalid_argument : a has more than two dimensions or an unsupported depth
+ */
+template<class T>
+std::vector<dense::DenseMat<T> > parseToPlanes(const cv::Mat &a) {
+    if (a.dims > 2) throw invalid_argument("cv matrix is not two-dimensional!");
+    int cn = a.channels();
+    std::vector<dense::DenseMat<T> > planes;
+    planes.reserve(cn);
+    std::vector<T *> d(cn);
+    for (int c = 0; c < cn; c++) {
+        planes.emplace_back(a.rows, a.cols, dense::uninitialized);
+        d[c] = planes[c].buffer();
+    }
+    switch (a.depth()) {
+        case CV_8U:
+            splitRows<uchar>(a, d.data());
+            break;
+        case CV_8S:
+            splitRows<schar>(a, d.data());
+            break;
+        case CV_16U:
+            splitRows<ushort>(a, d.data());
+            break;
+        case CV_16S:
+            splitRows<short>(a, d.data());
+            break;
+        case CV_32S:
+            splitRows<int>(a, d.data());
+            break;
+        case CV_32F:
+            splitRows<float>(a, d.data());
+            break;
+        case CV_64F:
+            splitRows<double>(a, d.data());
+            break;
+        default:
+            throw invalid_argument("Unsupported cv matrix depth!");
+    }
+    return planes;
+}
 
 
 #endif //CPP_PROJECT_MATRIXTOOPENCV_H
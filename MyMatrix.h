@@ -38,10 +38,24 @@
 #ifndef CPP_PROJECT_MYMATRIX_H
 #define CPP_PROJECT_MYMATRIX_H
 
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
 #include <vector>
+#include "MatrixConv.h"
+#include "MatrixEigen.h"
+#include "MatrixExpr.h"
+#include "MatrixFixed.h"
+#include "MatrixIO.h"
+#include "MatrixLU.h"
+#include "MatrixQR.h"
+#include "MatrixReduce.h"
+#include "MatrixSparse.h"
+#include "MatrixText.h"
 
-#define MAX_ROW 100
-#define MAX_COL 100
 #define MAX_ROW_SPARSE 100000
 #define MAX_COL_SPARSE 100000
 using namespace std;
@@ -62,17 +76,17 @@ struct triple {
  */
 class Mat {
 protected:
-    int Row, Col;
+    long long Row, Col;
 public:
     Mat();
 
-    Mat(int row, int col);
+    Mat(long long row, long long col);
 
     virtual ~Mat();
 
-    int row() const;
+    long long row() const;
 
-    int col() const;
+    long long col() const;
 };
 
 Mat::Mat() {
@@ -83,60 +97,351 @@ Mat::Mat() {
  * @brief Set the matrix with row and col.
  * @param[in] row : row number of the matrix
  * @param[in] col : col number of the matrix
- * @exception length_error : row or col too large
+ * @note Sizes are 64-bit, so row * col may exceed the range of int.
+ * @exception length_error : row * col overflows
  * @exception out_of_range : row or col be not positive
  */
-Mat::Mat(int row, int col) {
-    if (row > MAX_ROW || col > MAX_COL) throw length_error("Row or column is too large!");
+Mat::Mat(long long row, long long col) {
     if (row <= 0 || col <= 0) throw out_of_range("Row or column must be positive!");
+    if (row > LLONG_MAX / col) throw length_error("Row or column is too large!");
     Row = row, Col = col;
 }
 
 Mat::~Mat() = default;
 
-int Mat::row() const {
+long long Mat::row() const {
     return Row;
 }
 
-int Mat::col() const {
+long long Mat::col() const {
     return Col;
 }
 
+/*!
+ * @brief A namespace storing the process-wide memory budget of matrix buffers. \n
+ */
+namespace memory {
+    inline std::atomic<long long> &budget_bytes() {
+        static std::atomic<long long> budget(0);
+        return budget;
+    }
+
+    inline std::atomic<long long> &used_bytes() {
+        static std::atomic<long long> used(0);
+        return used;
+    }
+
+    /*!
+     * @brief Limit the bytes held by matrix buffers, so oversized allocations fail fast.
+     * @param[in] bytes : the budget, 0 means unlimited
+     */
+    inline void set_budget(long long bytes) {
+        budget_bytes() = bytes < 0 ? 0 : bytes;
+    }
+
+    inline long long budget() {
+        return budget_bytes();
+    }
+
+    /*!
+     * @brief Bytes currently held by matrix buffers, in whole pool blocks, including the free
+     *        blocks the pools keep for reuse.
+     */
+    inline long long in_use() {
+        return used_bytes();
+    }
+
+    /*!
+     * @brief Charge bytes to the budget before allocating them.
+     * @exception length_error : the budget would be exceeded
+     */
+    inline void acquire(long long bytes) {
+        long long used = used_bytes();
+        do {
+            long long limit = budget_bytes();
+            if (limit > 0 && bytes > limit - used) throw length_error("Memory budget exceeded!");
+        } while (!used_bytes().compare_exchange_weak(used, used + bytes));
+    }
+
+    inline void release(long long bytes) {
+        used_bytes() -= bytes;
+    }
+
+    const std::size_t ALIGNMENT = 64; ///< of every matrix buffer: a cache line, and any SIMD width
+    const int POOL_CLASSES = 21;      ///< pooled blocks are 64 << k bytes for k < POOL_CLASSES, up to 64 MB
+
+    /*!
+     * @brief The free blocks kept by one thread, as a linked list per size class.
+     * @note Trivially destructible, so it can still be reached while other thread_local
+     *       and static objects are destroyed; closed is set once the pool was emptied.
+     */
+    struct PoolState {
+        void *head[POOL_CLASSES];
+        long long cached;   ///< bytes in the lists
+        long long hits, misses;
+        int arenas;         ///< open Arena scopes
+        bool closed;
+    };
+
+    /*!
+     * @brief Counters of the pool of the calling thread.
+     */
+    struct PoolStats {
+        long long cached;   ///< bytes of free blocks kept
+        long long hits;     ///< allocations served from the pool
+        long long misses;   ///< allocations passed to the system allocator
+    };
+
+    inline std::atomic<long long> &pool_limit_bytes() {
+        static std::atomic<long long> limit(1LL << 26);
+        return limit;
+    }
+
+    inline std::atomic<long long> &arena_limit_bytes() {
+        static std::atomic<long long> limit(1LL << 30);
+        return limit;
+    }
+
+    /*!
+     * @brief Bytes of free blocks each thread keeps outside an Arena, 64 MB by default.
+     */
+    inline void set_pool_limit(long long bytes) {
+        pool_limit_bytes() = bytes < 0 ? 0 : bytes;
+    }
+
+    /*!
+     * @brief Bytes of free blocks each thread keeps while an Arena is open, 1 GB by default.
+     */
+    inline void set_arena_limit(long long bytes) {
+        arena_limit_bytes() = bytes < 0 ? 0 : bytes;
+    }
+
+    inline std::size_t class_bytes(int k) {
+        return ALIGNMENT << k;
+    }
+
+    /*!
+     * @brief The smallest size class holding bytes, POOL_CLASSES if none does.
+     */
+    inline int size_class(std::size_t bytes) {
+        int k = 0;
+        while (k < POOL_CLASSES && class_bytes(k) < bytes) k++;
+        return k;
+    }
+
+    /*!
+     * @brief Give the blocks of a pool back to the system, and their bytes to the budget,
+     *        until at most keep bytes are cached.
+     */
+    inline void trim(PoolState &p, long long keep) {
+        for (int k = POOL_CLASSES - 1; k >= 0 && p.cached > keep; k--)
+            while (p.head[k] && p.cached > keep) {
+                void *block = p.head[k];
+                p.head[k] = *static_cast<void **>(block);
+                p.cached -= (long long) class_bytes(k);
+                ::operator delete(block, std::align_val_t(ALIGNMENT));
+                release((long long) class_bytes(k));
+            }
+    }
+
+    /*!
+     * @brief Empties the pool of its thread when the thread ends.
+     */
+    struct PoolGuard {
+        PoolState &p;
+
+        ~PoolGuard() {
+            trim(p, 0);
+            p.closed = true;
+        }
+    };
+
+    inline PoolState &pool() {
+        thread_local PoolState p{};
+        thread_local PoolGuard guard{p};
+        (void) guard;
+        return p;
+    }
+
+    inline PoolStats pool_stats() {
+        PoolState &p = pool();
+        return PoolStats{p.cached, p.hits, p.misses};
+    }
+
+    /*!
+     * @brief Allocate bytes aligned to ALIGNMENT, reusing a block freed by this thread if any.
+     * @return the block, nullptr when the system is out of memory
+     * @note A new block is charged to the budget at its full size class. When the budget
+     *       or the system has no room, this thread's free blocks are given back first.
+     * @exception length_error : the budget would be exceeded
+     */
+    inline void *allocate(std::size_t bytes) {
+        int k = size_class(bytes);
+        PoolState &p = pool();
+        if (k < POOL_CLASSES) {
+            if (p.head[k]) {
+                void *block = p.head[k];
+                p.head[k] = *static_cast<void **>(block);
+                p.cached -= (long long) class_bytes(k);
+                p.hits++;
+                return block;
+            }
+            p.misses++;
+            bytes = class_bytes(k);
+        }
+        long long limit = budget();
+        if (limit > 0 && (long long) bytes > limit - in_use()) trim(p, 0);
+        acquire((long long) bytes);
+        void *block = ::operator new(bytes, std::align_val_t(ALIGNMENT), std::nothrow);
+        if (!block && p.cached > 0) {
+            trim(p, 0);
+            block = ::operator new(bytes, std::align_val_t(ALIGNMENT), std::nothrow);
+        }
+        if (!block) release((long long) bytes);
+        return block;
+    }
+
+    /*!
+     * @brief Free a block of allocate(bytes), keeping it in this thread's pool when there is room.
+     * @note A kept block stays charged to the budget until it is reused or trimmed.
+     */
+    inline void deallocate(void *block, std::size_t bytes) {
+        if (!block) return;
+        int k = size_class(bytes);
+        if (k < POOL_CLASSES) {
+            PoolState &p = pool();
+            long long keep = p.arenas > 0 ? arena_limit_bytes() : pool_limit_bytes();
+            if (!p.closed && p.cached + (long long) class_bytes(k) <= keep) {
+                *static_cast<void **>(block) = p.head[k];
+                p.head[k] = block;
+                p.cached += (long long) class_bytes(k);
+                return;
+            }
+            bytes = class_bytes(k);
+        }
+        ::operator delete(block, std::align_val_t(ALIGNMENT));
+        release((long long) bytes);
+    }
+
+    /*!
+     * @brief A scope in which the buffers the thread frees are kept for reuse, up to the
+     *        arena limit instead of the pool limit.
+     * @note The temporaries of a loop body then come back from the pool, with their pages
+     *       still mapped, instead of from the system allocator. When the outermost Arena
+     *       of the thread closes, the pool is trimmed back to its limit. Buffers may
+     *       outlive the Arena; it must be closed by the thread that opened it.
+     */
+    class Arena {
+    public:
+        Arena() {
+            pool().arenas++;
+        }
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+
+        ~Arena() {
+            PoolState &p = pool();
+            if (--p.arenas == 0) trim(p, pool_limit_bytes());
+        }
+    };
+}
+
 /*!
  * @brief A namespace storing DenseMat \n
  */
 namespace dense {
     template<class T>
-    class DenseMat : public Mat {
+    class LU;
+
+    template<class T>
+    class DenseView;
+
+    template<class T>
+    struct SymmetricEigen;
+
+    /*!
+     * @brief A tag constructing a DenseMat whose elements are left unset, to be overwritten.
+     */
+    struct Uninitialized {
+    };
+
+    const Uninitialized uninitialized = Uninitialized();
+
+    /*!
+     * @brief Minimum, maximum, sum and mean of all elements, as computed by DenseMat::stats().
+     */
+    template<class T>
+    struct Stats {
+        T min, max, sum;
+        double mean;
+        long long argmin, argmax; ///< row-major position of the first minimum and maximum
+    };
+
+    template<class T>
+    class DenseMat : public Mat, public expr::Expr<DenseMat<T> > {
     private:
         T *data;
 
-        DenseMat<T> add(const DenseMat<T> &p);
+        static T *allocate(long long n, bool zero = true);
+
+        static void deallocate(T *p, long long n);
 
-        DenseMat<T> sub(const DenseMat<T> &p);
+        static DenseMat<T> from_text(io::TextMatrix<T> &m);
 
-        DenseMat<T> scalar_multi(double num);
+        template<class> friend
+        class LU;
 
-        DenseMat<T> scalar_div(double num);
+        template<class E>
+        void assign(const E &e);
+
+        void resize(long long row, long long col);
 
         T determinant(const DenseMat<T> &p);
 
-        DenseMat<double> QRMa();
+        template<bool SUM>
+        DenseMat<T> reduce(char c, bool largest) const;
 
     public:
+        typedef T value_type;
+
         DenseMat();
 
-        DenseMat(int row, int col);
+        DenseMat(long long row, long long col);
+
+        DenseMat(long long row, long long col, Uninitialized);
+
+        DenseMat(long long row, long long col, T num);
+
+        DenseMat(const DenseMat<T> &p);
+
+        DenseMat(DenseMat<T> &&p) noexcept;
 
-        DenseMat(int row, int col, T num);
+        template<class E>
+        DenseMat(const expr::Expr<E> &e);
 
-        DenseMat(DenseMat<T> &p);
+        template<int R, int C>
+        DenseMat(const FixedMat<T, R, C> &f);
 
         virtual ~DenseMat();
 
-        T get(int i, int j) const;
+        T *buffer();
 
-        void set(int i, int j, T v);
+        const T *buffer() const;
+
+        /*!
+         * @brief The 0-based element (i, j), used by expression evaluation.
+         */
+        const T &elem(long long i, long long j) const { return data[i * Col + j]; }
+
+        void prepare() const {}
+
+        bool aliases(const expr::Window &w) const { return expr::hazard(expr::window(data, Row, Col, Col, 1LL), w); }
+
+        T get(long long i, long long j) const;
+
+        void set(long long i, long long j, T v);
 
         bool operator==(const DenseMat<T> &p);
 
@@ -144,27 +449,33 @@ namespace dense {
 
         DenseMat<T> &operator=(const DenseMat<T> &p);
 
-        DenseMat<T> operator+(const DenseMat<T> &p);
+        DenseMat<T> &operator=(DenseMat<T> &&p) noexcept;
 
-        DenseMat<T> operator-(const DenseMat<T> &p);
+        template<class E>
+        DenseMat<T> &operator=(const expr::Expr<E> &e);
 
-        DenseMat<T> operator-();
+        template<class E>
+        DenseMat<T> &operator+=(const expr::Expr<E> &e);
 
-        friend DenseMat<T> operator*(double num, DenseMat<T> &p) {
-            return p * num;
-        }
+        template<class E>
+        DenseMat<T> &operator-=(const expr::Expr<E> &e);
 
-        friend DenseMat<T> operator*(int num, DenseMat<T> p) {
-            return p * num;
-        }
+        template<class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+        DenseMat<T> &operator*=(S num);
+
+        template<class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+        DenseMat<T> &operator/=(S num);
+
+        template<class E>
+        DenseMat<T> &hadamard_inplace(const expr::Expr<E> &e);
 
         /*!
          * @brief Output overloading friend function.
          */
         friend ostream &operator<<(ostream &os, const DenseMat<T> &c) {
-            for (int i = 1; i <= c.row(); i++) {
+            for (long long i = 1; i <= c.row(); i++) {
                 os << "(";
-                for (int j = 1; j <= c.col(); j++) {
+                for (long long j = 1; j <= c.col(); j++) {
                     os << setw(10);
                     os << c.get(i, j);
                     if (j != c.col()) os << ",";
@@ -174,23 +485,22 @@ namespace dense {
             return os;
         }
 
-        DenseMat<T> operator*(double num);
+        template<class E>
+        expr::Binary<expr::Mul, DenseMat<T>, E> element_wise_multi(const expr::Expr<E> &p) const;
 
-        DenseMat<T> operator/(double num);
+        DenseView<T> view();
 
-        DenseMat<T> operator*(int num);
+        DenseView<T> trans();
 
-        DenseMat<T> operator/(int num);
+        DenseView<T> row_view(long long i);
 
-        DenseMat<T> element_wise_multi(const DenseMat<T> &p);
+        DenseView<T> col_view(long long j);
 
-        DenseMat<T> trans();
+        DenseView<T> diag_view();
 
         template<class P>
         DenseMat<complex<P>> conj();
 
-        DenseMat<T> operator*(const DenseMat<T> &p);
-
         DenseMat<T> max(char c = 'a');
 
         DenseMat<T> min(char c = 'a');
@@ -199,25 +509,198 @@ namespace dense {
 
         DenseMat<T> average(char c = 'a');
 
-        DenseMat<T> reshape(int row_new, int col_new);
+        Stats<T> stats() const;
 
-        DenseMat<T> slicing(int x1, int x2, int y1, int y2);
+        void save(const string &path, bool checksum = true) const;
+
+        static DenseView<T> mapped(const io::MatrixFile &file);
+
+        DenseMat<T> reshape(long long row_new, long long col_new);
+
+        DenseView<T> slicing(long long x1, long long x2, long long y1, long long y2);
 
         DenseMat<T> inverse();
 
+        DenseMat<T> solve(const DenseMat<T> &b);
+
         T trace();
 
         T det();
 
-        T cofactor(int i, int j);
+        T cofactor(long long i, long long j);
+
+        vector<complex<double>> eigenvalues(kernel::EigenInfo *info = nullptr);
 
         void eigenvalues(double *res);
 
-        DenseMat<T> conv(DenseMat<T> core);
+        DenseMat<T> conv(const DenseMat<T> &core, const kernel::ConvOptions &opt = kernel::ConvOptions()) const;
+
+        DenseMat<T> conv(const DenseMat<T> &vertical, const DenseMat<T> &horizontal,
+                         const kernel::ConvOptions &opt = kernel::ConvOptions()) const;
+
+        DenseMat<complex<double>> eigenvectors(const vector<complex<double>> &w);
 
         DenseMat<double> eigenvectors(const double *eigenValue);
 
+        SymmetricEigen<T> symmetric_eigen(long long top = 0) const;
+
         void input();
+
+        static DenseMat<T> load(const string &path, io::TextFormat f = io::TextFormat::Auto);
+
+        static DenseMat<T> parse(const string &text, io::TextFormat f = io::TextFormat::Auto);
+
+        static DenseMat<T> read(io::TextReader &in);
+    };
+
+    /*!
+     * @brief A reusable LU factorization PA = LU with partial pivoting.
+     * @note Integer matrices are factorized in double and results are rounded back.
+     */
+    template<class T>
+    class LU {
+    private:
+        typedef typename kernel::lu_scalar<T>::type S;
+        long long n;
+        std::vector<S> lu;
+        std::vector<long long> piv;
+        int info;
+        bool singularFlag;
+
+        static T to_elem(const S &v);
+
+    public:
+        explicit LU(const DenseMat<T> &p);
+
+        long long size() const;
+
+        bool singular() const;
+
+        T det() const;
+
+        DenseMat<T> solve(const DenseMat<T> &b) const;
+
+        DenseMat<T> inverse() const;
+    };
+
+    /*!
+     * @brief A reusable Householder QR factorization A = QR of an m x n matrix.
+     * @note Q is kept in compact WY form, as the reflectors below the diagonal of R and
+     *       their factors. Q is only formed when asked for: apply_qt() and apply_q() use
+     *       the reflectors blockwise, so least-squares solves never build it.
+     */
+    template<class T>
+    class QR {
+    private:
+        static_assert(std::is_floating_point<T>::value, "QR needs a real floating-point element type");
+        long long m, n;
+        std::vector<T> qr;
+        std::vector<T> tau;
+
+        DenseMat<T> apply(const DenseMat<T> &b, bool trans) const;
+
+    public:
+        explicit QR(const DenseMat<T> &p);
+
+        long long rows() const;
+
+        long long cols() const;
+
+        DenseMat<T> R() const;
+
+        DenseMat<T> Q(bool full = false) const;
+
+        DenseMat<T> apply_qt(const DenseMat<T> &b) const;
+
+        DenseMat<T> apply_q(const DenseMat<T> &b) const;
+
+        DenseMat<T> solve(const DenseMat<T> &b) const;
+    };
+
+    /*!
+     * @brief Eigenvalues and orthonormal eigenvectors of a symmetric or Hermitian matrix.
+     */
+    template<class T>
+    struct SymmetricEigen {
+        vector<double> values; ///< in descending order
+        DenseMat<T> vectors;   ///< column j is the eigenvector of values[j]
+    };
+
+    /*!
+     * @brief A non-owning strided view of a DenseMat: element (i, j) lives at
+     *       ptr[(i - 1) * row_stride() + (j - 1) * col_stride()].
+     * @note Copying a view copies the handle, while assigning to a view writes its
+     *       elements. A view must not outlive the matrix it was taken from, and a
+     *       view of a temporary matrix is only valid within the full expression.
+     */
+    template<class T>
+    class DenseView : public Mat, public expr::Expr<DenseView<T> > {
+    private:
+        T *ptr;
+        long long rowStride, colStride;
+
+        template<class E>
+        void assign(const E &e);
+
+    public:
+        typedef T value_type;
+
+        DenseView(T *ptr, long long row, long long col, long long rowStride, long long colStride);
+
+        DenseView(const DenseView<T> &v) = default;
+
+        T *buffer() const;
+
+        long long row_stride() const;
+
+        long long col_stride() const;
+
+        /*!
+         * @brief The 0-based element (i, j), used by expression evaluation.
+         */
+        const T &elem(long long i, long long j) const { return ptr[i * rowStride + j * colStride]; }
+
+        void prepare() const {}
+
+        bool aliases(const expr::Window &w) const {
+            return expr::hazard(expr::window((const T *) ptr, Row, Col, rowStride, colStride), w);
+        }
+
+        T get(long long i, long long j) const;
+
+        void set(long long i, long long j, T v);
+
+        DenseView<T> &operator=(const DenseView<T> &v);
+
+        template<class E>
+        DenseView<T> &operator=(const expr::Expr<E> &e);
+
+        template<class E>
+        DenseView<T> &operator+=(const expr::Expr<E> &e);
+
+        template<class E>
+        DenseView<T> &operator-=(const expr::Expr<E> &e);
+
+        template<class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+        DenseView<T> &operator*=(S num);
+
+        template<class S, class = typename std::enable_if<std::is_arithmetic<S>::value>::type>
+        DenseView<T> &operator/=(S num);
+
+        template<class E>
+        expr::Binary<expr::Mul, DenseView<T>, E> element_wise_multi(const expr::Expr<E> &p) const;
+
+        DenseView<T> trans() const;
+
+        DenseView<T> row_view(long long i) const;
+
+        DenseView<T> col_view(long long j) const;
+
+        DenseView<T> diag_view() const;
+
+        DenseView<T> slicing(long long x1, long long x2, long long y1, long long y2) const;
+
+        DenseMat<T> materialize() const;
     };
 
     /*!
@@ -225,7 +708,7 @@ namespace dense {
      */
     template<class T>
     DenseMat<T>::DenseMat():Mat() {
-        data = new T[1]();
+        data = allocate(1);
     }
 
     /*!
@@ -234,8 +717,63 @@ namespace dense {
      * @param[in] col : the col number of DenseMat
      */
     template<class T>
-    DenseMat<T>::DenseMat(int row, int col):Mat(row, col) {
-        data = new T[this->row() * this->col() + 1]();
+    DenseMat<T>::DenseMat(long long row, long long col):Mat(row, col) {
+        data = allocate(this->row() * this->col());
+    }
+
+    /*!
+     * @brief Init the DenseMat for a given row * col size without setting its elements.
+     * @note For callers that write every element next; arithmetic elements hold garbage.
+     */
+    template<class T>
+    DenseMat<T>::DenseMat(long long row, long long col, Uninitialized):Mat(row, col) {
+        data = allocate(this->row() * this->col(), false);
+    }
+
+    /*!
+     * @brief Copy a fixed-size matrix into a heap-allocated one of the same size.
+     */
+    template<class T>
+    template<int R, int C>
+    DenseMat<T>::DenseMat(const FixedMat<T, R, C> &f):Mat(R, C) {
+        data = allocate(R * C, false);
+        std::copy(f.buffer(), f.buffer() + R * C, data);
+    }
+
+    /*!
+     * @brief Allocate a 64-byte aligned buffer of n elements charged to the memory budget.
+     * @param[in] n : the number of elements
+     * @param[in] zero : value-initialize the elements, otherwise default-initialize them
+     * @note Blocks come from the pool of the calling thread when it has one, and are charged
+     *       at their pooled size, see memory::allocate().
+     * @exception length_error : the buffer is too large, exceeds the memory budget or
+     *                           cannot be allocated
+     */
+    template<class T>
+    T *DenseMat<T>::allocate(long long n, bool zero) {
+        if (n > (long long) (PTRDIFF_MAX / sizeof(T))) throw length_error("Row or column is too large!");
+        std::size_t bytes = (std::size_t) n * sizeof(T);
+        T *p = static_cast<T *>(memory::allocate(bytes));
+        if (!p) throw length_error("Out of memory when allocating the matrix!");
+        try {
+            if (zero) std::uninitialized_value_construct_n(p, n);
+            else std::uninitialized_default_construct_n(p, n);
+        } catch (...) {
+            memory::deallocate(p, bytes);
+            throw;
+        }
+        return p;
+    }
+
+    /*!
+     * @brief Free a buffer from allocate(), to the pool of this thread or to the system, see
+     *        memory::deallocate().
+     */
+    template<class T>
+    void DenseMat<T>::deallocate(T *p, long long n) {
+        if (!p) return;
+        std::destroy_n(p, n);
+        memory::deallocate(p, (std::size_t) n * sizeof(T));
     }
 
     /*!
@@ -243,10 +781,18 @@ namespace dense {
      * @param[in] p : DenseMat to be copied
      */
     template<class T>
-    DenseMat<T>::DenseMat(DenseMat<T> &p):DenseMat(p.row(), p.col()) {
-        for (int i = 1; i <= row(); i++)
-            for (int j = 1; j <= col(); j++)
-                set(i, j, p.get(i, j));
+    DenseMat<T>::DenseMat(const DenseMat<T> &p):DenseMat(p.row(), p.col(), uninitialized) {
+        std::copy(p.data, p.data + row() * col(), data);
+    }
+
+    /*!
+     * @brief Move constructor for DenseMat, taking over the buffer of p.
+     * @param[in] p : DenseMat to be moved, left empty (0 x 0)
+     */
+    template<class T>
+    DenseMat<T>::DenseMat(DenseMat<T> &&p) noexcept {
+        Row = p.Row, Col = p.Col, data = p.data;
+        p.Row = p.Col = 0, p.data = nullptr;
     }
 
     /*!
@@ -256,10 +802,8 @@ namespace dense {
      * @param[in] num : the num to fill into the matrix
      */
     template<class T>
-    DenseMat<T>::DenseMat(int row, int col, T num):DenseMat(row, col) {
-        for (int i = 1; i <= row; i++)
-            for (int j = 1; j <= col; j++)
-                set(i, j, num);
+    DenseMat<T>::DenseMat(long long row, long long col, T num):DenseMat(row, col, uninitialized) {
+        std::fill(data, data + row * col, num);
     }
 
     /*!
@@ -267,7 +811,7 @@ namespace dense {
      */
     template<class T>
     DenseMat<T>::~DenseMat() {
-        delete[] data;
+        deallocate(data, row() * col());
     }
 
     /*!
@@ -279,7 +823,7 @@ namespace dense {
      * @exception out_of_range : row or col be too small or too large
      */
     template<class T>
-    T DenseMat<T>::get(int i, int j) const {
+    T DenseMat<T>::get(long long i, long long j) const {
         if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
         return *(data + (i - 1) * col() + j - 1);
     }
@@ -293,7 +837,7 @@ namespace dense {
      * @exception out_of_range : row or col be too small or too large
      */
     template<class T>
-    void DenseMat<T>::set(int i, int j, T v) {
+    void DenseMat<T>::set(long long i, long long j, T v) {
         if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
         *(data + (i - 1) * col() + j - 1) = v;
     }
@@ -304,8 +848,8 @@ namespace dense {
     template<class T>
     bool DenseMat<T>::operator==(const DenseMat<T> &p) {
         if (row() != p.row() || col() != p.col()) return false;
-        for (int i = 1; i <= row(); i++)
-            for (int j = 1; j <= col(); j++)
+        for (long long i = 1; i <= row(); i++)
+            for (long long j = 1; j <= col(); j++)
                 if (!(get(i, j) == p.get(i, j))) return false;
         return true;
     }
@@ -322,157 +866,208 @@ namespace dense {
     DenseMat<T> &DenseMat<T>::operator=(const DenseMat<T> &p) {
         if (this == &p) return *this;
 
-        delete[] data;
+        if (row() * col() != p.row() * p.col()) {
+            T *fresh = allocate(p.row() * p.col(), false);
+            deallocate(data, row() * col());
+            data = fresh;
+        }
         this->Col = p.col();
         this->Row = p.row();
-        data = new T[this->row() * this->col() + 1]();
-        for (int i = 1; i <= row(); i++)
-            for (int j = 1; j <= col(); j++)
-                set(i, j, p.get(i, j));
+        std::copy(p.data, p.data + row() * col(), data);
         return *this;
     }
 
     /*!
-     * @brief Support arithmetic addition for matrix.
-     * @param[in] p : addend
-     * @return a matrix with addition result
-     * @exception out_of_range : sizes of matrix are not same
+     * @brief A move assignment operator, releasing the old buffer and taking over the one of p.
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::add(const DenseMat<T> &p) {
-        if (p.col() != col() || p.row() != row()) throw out_of_range("In this::Row or column must be same!");
-        DenseMat<T> mat(p.row(), p.col());
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                mat.set(i, j, get(i, j) + p.get(i, j));
-            }
-        }
-        return mat;
-    }
+    DenseMat<T> &DenseMat<T>::operator=(DenseMat<T> &&p) noexcept {
+        if (this == &p) return *this;
 
-    template<class T>
-    DenseMat<T> DenseMat<T>::operator+(const DenseMat<T> &p) {
-        return this->add(p);
+        deallocate(data, row() * col());
+        Row = p.Row, Col = p.Col, data = p.data;
+        p.Row = p.Col = 0, p.data = nullptr;
+        return *this;
     }
 
     /*!
-     * @brief Support arithmetic subtraction for matrix.
-     * @param[in] p : subtrahend
-     * @return a matrix with subtraction result
-     * @exception out_of_range : sizes of matrix are not same
+     * @brief Evaluate an expression into a new matrix.
+     * @param[in] e : the expression, e.g. a + b * 2 or alpha * a * b + c
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::sub(const DenseMat<T> &p) {
-
-        if (p.col() != col() || p.row() != row()) throw out_of_range("Row or column must be same!");
-
-        DenseMat<T> mat(p.row(), p.col());
-
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                mat.set(i, j, get(i, j) - p.get(i, j));
-            }
+    template<class E>
+    DenseMat<T>::DenseMat(const expr::Expr<E> &e):Mat(e.self().row(), e.self().col()) {
+        data = allocate(row() * col(), false);
+        try {
+            assign(e.self());
+        } catch (...) {
+            deallocate(data, row() * col());
+            throw;
         }
-        return mat;
-
     }
 
     /*!
-     * @brief A subtraction operator overloading function.
+     * @brief Evaluate an expression into this matrix.
+     * @note The operands may include this matrix itself.
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator-(const DenseMat<T> &p) {
-        return this->sub(p);
+    template<class E>
+    DenseMat<T> &DenseMat<T>::operator=(const expr::Expr<E> &e) {
+        assign(e.self());
+        return *this;
     }
 
+    /*!
+     * @brief Add an expression to this matrix in place, reusing its buffer.
+     * @note c += a * b maps onto a single gemm call accumulating into c.
+     * @exception out_of_range : sizes of matrix are not same
+     */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator-() {
-        DenseMat<T> res = *this;
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                res.set(i, j, -res.get(i, j));
-            }
-        }
-        return res;
+    template<class E>
+    DenseMat<T> &DenseMat<T>::operator+=(const expr::Expr<E> &e) {
+        assign(*this + e.self());
+        return *this;
     }
 
     /*!
-     * @brief Support arithmetic scalar multiplication for matrix.
-     * @param[in] num : scalar to be multiplied
-     * @return a matrix with scalar multiplication result
+     * @brief Subtract an expression from this matrix in place, reusing its buffer.
+     * @exception out_of_range : sizes of matrix are not same
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::scalar_multi(double num) {
-        DenseMat<T> mat(row(), col());
-
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                T value = this->get(i, j) * num;
-                mat.set(i, j, value);
-            }
-        }
-        return mat;
+    template<class E>
+    DenseMat<T> &DenseMat<T>::operator-=(const expr::Expr<E> &e) {
+        assign(*this - e.self());
+        return *this;
     }
 
+    /*!
+     * @brief Multiply this matrix by a scalar in place.
+     */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator*(double num) {
-        return scalar_multi(num);
+    template<class S, class>
+    DenseMat<T> &DenseMat<T>::operator*=(S num) {
+        assign(*this * num);
+        return *this;
     }
 
+    /*!
+     * @brief Divide this matrix by a scalar in place.
+     * @exception domain_error : divide the matrix by 0
+     */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator*(int num) {
-        return scalar_multi((double) num);
+    template<class S, class>
+    DenseMat<T> &DenseMat<T>::operator/=(S num) {
+        assign(*this / num);
+        return *this;
     }
 
     /*!
-     * @brief Support arithmetic scalar division for matrix.
-     * @param[in] num : scalar to be divided
-     * @return a matrix with scalar division result
-     * @excepton domain_error : divide the matrix by 0
+     * @brief Element-wise multiplication in place, reusing the buffer of this matrix.
+     * @param[in] e : the matrix or expression to be multiplied by element-wise
+     * @exception out_of_range : sizes of matrix are not same
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::scalar_div(double num) {
-
-        if (num == 0) throw domain_error("0 cannot exist as a divisor!");
+    template<class E>
+    DenseMat<T> &DenseMat<T>::hadamard_inplace(const expr::Expr<E> &e) {
+        assign(this->element_wise_multi(e));
+        return *this;
+    }
 
-        DenseMat<T> mat(row(), col());
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                T value = this->get(i, j) / num;
-                mat.set(i, j, value);
+    /*!
+     * @brief Write an expression into this matrix, resizing it when needed.
+     * @note alpha * A * B + beta * C goes straight to one gemm call. Anything else runs
+     *       products first and then fills the buffer in a single element-wise pass,
+     *       split over the thread pool for large matrices.
+     */
+    template<class T>
+    template<class E>
+    void DenseMat<T>::assign(const E &e) {
+        expr::Window self = expr::window(data, row(), col(), col(), 1LL);
+        if constexpr (kernel::blocking<T>::packed) {
+            expr::GemmForm<T> g;
+            if (expr::gemm_form(e, g) && expr::gemm_safe(g, self) &&
+                expr::representable<T>(g.alpha) && expr::representable<T>(g.beta)) {
+                resize(g.A.rows, g.B.cols);
+                expr::gemm_into(g, data, col());
+                return;
             }
         }
-        return mat;
+        if (e.aliases(self)) {
+            // A view of this matrix is read in another layout or shape: evaluate aside first.
+            *this = DenseMat<T>(e);
+            return;
+        }
+        e.prepare();
+        resize(e.row(), e.col());
+        expr::evaluate(e, data, col(), 1LL);
+    }
+
+    /*!
+     * @brief Give the matrix a new shape, keeping the buffer when the element count is unchanged.
+     * @note The content is unspecified afterwards.
+     */
+    template<class T>
+    void DenseMat<T>::resize(long long row, long long col) {
+        if (row == this->row() && col == this->col()) return;
+        if (row * col != this->row() * this->col()) *this = DenseMat<T>(row, col, uninitialized);
+        Row = row, Col = col;
     }
 
     /*!
-     * @brief A division operator overloading function.
+     * @brief The row-major storage of the matrix.
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator/(double num) {
-        return scalar_div(num);
+    T *DenseMat<T>::buffer() {
+        return data;
+    }
+
+    template<class T>
+    const T *DenseMat<T>::buffer() const {
+        return data;
     }
 
+    /*!
+     * @brief A view of the whole matrix.
+     */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator/(int num) {
-        return scalar_div((double) num);
+    DenseView<T> DenseMat<T>::view() {
+        return DenseView<T>(data, row(), col(), col(), 1);
     }
 
     /*!
      * @brief Support transposition for matrix.
-     * @return a matrix with transposition result
+     * @return a view of the transposition, sharing the storage of this matrix
+     * @note No element is copied; use materialize() or assign it to a DenseMat for a copy.
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::trans() {
+    DenseView<T> DenseMat<T>::trans() {
+        return DenseView<T>(data, col(), row(), 1, col());
+    }
 
-        DenseMat<T> mat(col(), row());
+    /*!
+     * @brief A 1 x col view of the i-th row.
+     * @exception out_of_range : i is too small or too large
+     */
+    template<class T>
+    DenseView<T> DenseMat<T>::row_view(long long i) {
+        return view().row_view(i);
+    }
 
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                mat.set(j, i, get(i, j));
-            }
-        }
-        return mat;
+    /*!
+     * @brief A row x 1 view of the j-th column.
+     * @exception out_of_range : j is too small or too large
+     */
+    template<class T>
+    DenseView<T> DenseMat<T>::col_view(long long j) {
+        return view().col_view(j);
+    }
+
+    /*!
+     * @brief A min(row, col) x 1 view of the main diagonal.
+     */
+    template<class T>
+    DenseView<T> DenseMat<T>::diag_view() {
+        return view().diag_view();
     }
 
     /*!
@@ -484,8 +1079,8 @@ namespace dense {
     template<class P>
     DenseMat<complex<P> > DenseMat<T>::conj() {
         DenseMat<complex<P> > mat(row(), col());
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
+        for (long long i = 1; i <= row(); ++i) {
+            for (long long j = 1; j <= col(); ++j) {
                 P imagNum = get(i, j).imag();
                 P realNum = get(i, j).real();
                 mat.set(i, j, complex<P>(realNum, -imagNum));
@@ -497,46 +1092,35 @@ namespace dense {
     /*!
      * @brief Support element-wise multiplication for matrix.
      * @param[in] p : the matrix to be multiplied by element-wise
-     * @return a matrix with element-wise multiplication result
+     * @return a lazy expression of the element-wise product
      * @exception out_of_range : sizes of matrix are not same
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::element_wise_multi(const DenseMat<T> &p) {
-
-        if (row() != p.row() || col() != p.col()) throw out_of_range("Row or column must be same!");
-        DenseMat<T> mat(row(), col());
-
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                T val = get(i, j) * p.get(i, j);
-                mat.set(i, j, val);
-            }
-        }
-
-        return mat;
+    template<class E>
+    expr::Binary<expr::Mul, DenseMat<T>, E> DenseMat<T>::element_wise_multi(const expr::Expr<E> &p) const {
+        return expr::Binary<expr::Mul, DenseMat<T>, E>(*this, p.self());
     }
 
-
     /*!
-     * @brief A multiplication operator overloading function.
-     * @note It can be used in all multiplication operation, for dot product and cross product, etc.
-     * @exception domain_error : row of right is not equal to col of left
+     * @brief Reduce the matrix along the axis given by c, see max(), min() and sum().
+     * @param[in] largest : the maximum rather than the minimum, when SUM is not set
+     * @exception invalid_argument : char c input is invalid
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::operator*(const DenseMat<T> &p) {
-        if (this->col() != p.row()) throw domain_error("Row of right is not equal to column of left");
-        int n = this->row(), m = this->col(), q = p.col();
-        DenseMat<T> result(n, q);
-        auto *zero = new DenseMat<T>();
-        for (int i = 1; i <= n; i++)
-            for (int j = 1; j <= q; j++)
-                for (int k = 1; k <= m; k++) {
-                    if (result.get(i, j) == zero->get(1, 1))
-                        result.set(i, j, this->get(i, k) * p.get(k, j));
-                    else
-                        result.set(i, j, result.get(i, j) + this->get(i, k) * p.get(k, j));
-                }
-        delete zero;
+    template<bool SUM>
+    DenseMat<T> DenseMat<T>::reduce(char c, bool largest) const {
+        if (c != 'x' && c != 'y' && c != 'a') throw invalid_argument("the character must be {'x','y','a'}");
+        long long n = this->row(), m = this->col();
+        DenseMat<T> result(c == 'x' ? n : 1, c == 'y' ? m : 1);
+        T *out = result.data, *mn = largest ? nullptr : out, *mx = largest ? out : nullptr;
+        if (c == 'x') {
+            kernel::reduce_rows<T, SUM, !SUM>(n, m, data, m, out, mn, mx);
+        } else if (c == 'y') {
+            kernel::reduce_columns<T, SUM, !SUM>(n, m, data, m, out, mn, mx);
+        } else {
+            kernel::Summary<T> r = kernel::reduce_all<T, SUM, !SUM>(n * m, data);
+            out[0] = SUM ? r.sum : largest ? r.max : r.min;
+        }
         return result;
     }
 
@@ -547,43 +1131,13 @@ namespace dense {
      *                  'y' : maximum of each col
      *                  'a' : maximum of all element
      * @return a matrix with maximum result of given type
+     * @note One pass in memory order for every axis, parallel for large matrices, see
+     *       kernel::reduce_all().
      * @exception invalid_argument : char c input is invalid
      */
     template<class T>
     DenseMat<T> DenseMat<T>::max(char c) {
-        int n = this->row(), m = this->col();
-        DenseMat<T> resultx(n, 1);
-        DenseMat<T> resulty(1, m);
-        DenseMat<T> result(1, 1);
-        switch (c) {
-            case 'x':
-
-                for (int i = 1; i <= n; i++) {
-                    resultx.set(i, 1, this->get(i, 1));
-                    for (int j = 2; j <= m; j++)
-                        if (resultx.get(i, 1) < this->get(i, j))
-                            resultx.set(i, 1, this->get(i, j));
-                }
-                break;
-            case 'y':
-                for (int i = 1; i <= m; i++) {
-                    resulty.set(1, i, this->get(1, i));
-                    for (int j = 2; j <= n; j++)
-                        if (resulty.get(1, i) < this->get(j, i))
-                            resulty.set(1, i, this->get(j, i));
-                }
-                break;
-            case 'a':
-                for (int i = 1; i <= n; i++) {
-                    for (int j = 1; j <= m; j++)
-                        if ((i == 1 && j == 1) || result.get(1, 1) < this->get(i, j))
-                            result.set(1, 1, this->get(i, j));
-                }
-                break;
-            default:
-                throw invalid_argument("the character must be {'x','y','a'}");
-        }
-        return (c == 'a') ? result : ((c == 'x') ? resultx : resulty);
+        return reduce<false>(c, true);
     }
 
     /*!
@@ -593,43 +1147,12 @@ namespace dense {
      *                  'y' : minimum of each col
      *                  'a' : minimum of all element
      * @return a matrix with minimum result of given type
+     * @note One pass in memory order for every axis, parallel for large matrices.
      * @exception invalid_argument : char c input is invalid
      */
     template<class T>
     DenseMat<T> DenseMat<T>::min(char c) {
-        int n = this->row(), m = this->col();
-        DenseMat<T> resultx(n, 1);
-        DenseMat<T> resulty(1, m);
-        DenseMat<T> result(1, 1);
-        switch (c) {
-            case 'x':
-
-                for (int i = 1; i <= n; i++) {
-                    resultx.set(i, 1, this->get(i, 1));
-                    for (int j = 2; j <= m; j++)
-                        if (resultx.get(i, 1) > this->get(i, j))
-                            resultx.set(i, 1, this->get(i, j));
-                }
-                break;
-            case 'y':
-                for (int i = 1; i <= m; i++) {
-                    resulty.set(1, i, this->get(1, i));
-                    for (int j = 2; j <= n; j++)
-                        if (resulty.get(1, i) > this->get(j, i))
-                            resulty.set(1, i, this->get(j, i));
-                }
-                break;
-            case 'a':
-                for (int i = 1; i <= n; i++) {
-                    for (int j = 1; j <= m; j++)
-                        if ((i == 1 && j == 1) || result.get(1, 1) > this->get(i, j))
-                            result.set(1, 1, this->get(i, j));
-                }
-                break;
-            default:
-                throw invalid_argument("the character must be {'x','y','a'}");
-        }
-        return (c == 'a') ? result : ((c == 'x') ? resultx : resulty);
+        return reduce<false>(c, false);
     }
 
     /*!
@@ -639,40 +1162,13 @@ namespace dense {
      *                  'y' : sum of each col
      *                  'a' : sum of all element
      * @return a matrix with sum result of given type
+     * @note Sums are pairwise over blocks of elements, so rounding grows with the log of
+     *       the count rather than with the count.
      * @exception invalid_argument : char c input is invalid
      */
     template<class T>
     DenseMat<T> DenseMat<T>::sum(char c) {
-        int n = this->row(), m = this->col();
-        DenseMat<T> resultx(n, 1);
-        DenseMat<T> resulty(1, m);
-        DenseMat<T> result(1, 1);
-        switch (c) {
-            case 'x':
-
-                for (int i = 1; i <= n; i++) {
-                    resultx.set(i, 1, this->get(i, 1));
-                    for (int j = 2; j <= m; j++)
-                        resultx.set(i, 1, resultx.get(i, 1) + this->get(i, j));
-                }
-                break;
-            case 'y':
-                for (int i = 1; i <= m; i++) {
-                    resulty.set(1, i, this->get(1, i));
-                    for (int j = 2; j <= n; j++)
-                        resulty.set(1, i, resulty.get(1, i) + this->get(j, i));
-                }
-                break;
-            case 'a':
-                for (int i = 1; i <= n; i++) {
-                    for (int j = 1; j <= m; j++)
-                        result.set(1, 1, result.get(1, 1) + this->get(i, j));
-                }
-                break;
-            default:
-                throw invalid_argument("the character must be {'x','y','a'}");
-        }
-        return (c == 'a') ? result : ((c == 'x') ? resultx : resulty);
+        return reduce<true>(c, false);
     }
 
     /*!
@@ -682,29 +1178,74 @@ namespace dense {
      *                  'y' : average of each col
      *                  'a' : average of all element
      * @return a matrix with average result of given type
+     * @note The sums are divided in place, without another matrix.
      * @exception invalid_argument : char c input is invalid
      */
     template<class T>
     DenseMat<T> DenseMat<T>::average(char c) {
-        if (c != 'x' && c != 'y' && c != 'a') throw invalid_argument("the character must be {'x','y','a'}");
-        DenseMat<T> result = this->sum(c);
-        result = result / (double) ((this->col() * this->row()) / (result.col() * result.row()));
+        DenseMat<T> result = reduce<true>(c, false);
+        double count = (double) ((this->col() * this->row()) / (result.col() * result.row()));
+        for (long long i = 0; i < result.row() * result.col(); i++) result.data[i] = T(result.data[i] / count);
         return result;
     }
 
+    /*!
+     * @brief Minimum, maximum, sum, mean and the positions of the extremes in one sweep.
+     * @return the statistics of all elements, see Stats
+     * @note Each block of elements is summed and scanned for its extremes while in cache.
+     */
+    template<class T>
+    Stats<T> DenseMat<T>::stats() const {
+        kernel::Summary<T> r = kernel::reduce_all<T, true, true>(row() * col(), data);
+        return Stats<T>{r.min, r.max, r.sum, (double) r.sum / (double) (row() * col()), r.argmin, r.argmax};
+    }
+
+    /*!
+     * @brief Write the matrix to a binary matrix file, see io::MatrixFile.
+     * @param[in] path : the file, replaced if it exists
+     * @param[in] checksum : store a checksum of the elements
+     * @exception runtime_error : the file cannot be written
+     */
+    template<class T>
+    void DenseMat<T>::save(const string &path, bool checksum) const {
+        io::FileHeader h{};
+        h.kind = (uint32_t) io::Kind::Dense;
+        h.elem = (uint32_t) io::elem_type<T>();
+        h.elemSize = sizeof(T);
+        h.rows = row(), h.cols = col(), h.nnz = row() * col();
+        io::write_file(path, h, nullptr, nullptr, data, checksum);
+    }
+
+    /*!
+     * @brief A view of the dense matrix in a mapped file, without copying it.
+     * @param[in] file : a mapped file holding a dense matrix of T, which must outlive the view
+     * @return a view of the stored layout; column-major files give a transposed stride
+     * @note Elements are read from disk as they are first touched. Writes through the view
+     *       stay in this process, see io::MatrixFile. materialize() makes an owned copy.
+     * @exception invalid_argument : the file holds a sparse matrix or another element type
+     */
+    template<class T>
+    DenseView<T> DenseMat<T>::mapped(const io::MatrixFile &file) {
+        if (file.kind() != io::Kind::Dense) throw invalid_argument("The file does not hold a dense matrix!");
+        if (file.elem() != io::elem_type<T>()) throw invalid_argument("The element type of the file does not match!");
+        long long r = file.rows(), c = file.cols();
+        T *p = static_cast<T *>(file.values());
+        return file.col_major() ? DenseView<T>(p, r, c, 1, r) : DenseView<T>(p, r, c, c, 1);
+    }
+
     /*!
      * @brief Support reshape operation with a new row and col for the matrix.
      * @param[in] row_new : new row of the matrix
      * @param[in] col_new : new col of the matrix
      * @return a matrix with new row and col size
      * @exception length_error : count of elements of new and old mismatch
-     * @exception out_of_range : new row or col is too small or too large
+     * @exception out_of_range : new row or col is not positive
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::reshape(int row_new, int col_new) {
-        if (row_new > MAX_ROW || col_new > MAX_COL) throw length_error("Row or column is too large!");
+    DenseMat<T> DenseMat<T>::reshape(long long row_new, long long col_new) {
         if (row_new <= 0 || col_new <= 0) throw out_of_range("Row or column must be positive!");
-        if (row_new * col_new != row() * col()) throw length_error("Count of elements mismatch!");
+        long long count = row() * col();
+        if (count % col_new != 0 || count / col_new != row_new) throw length_error("Count of elements mismatch!");
         DenseMat<T> result = *this;
         result.Row = row_new;
         result.Col = col_new;
@@ -717,19 +1258,13 @@ namespace dense {
      * @param[in] x2 : row of right-up index
      * @param[in] y1 : col of left-down index
      * @param[in] y2 : col of right-up index
-     * @return a sliced piece of matrix
+     * @return a view of the sliced piece, sharing the storage of this matrix
      * @exception out_of_range : the given index is too small or too large
      *                           left-down index is larger than right-up index
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::slicing(int x1, int x2, int y1, int y2) {
-        if (x1 <= 0 || x2 > row() || x1 > x2) throw out_of_range("Out of x-axis range!");
-        if (y1 <= 0 || y2 > col() || y1 > y2) throw out_of_range("Out of y-axis range!");
-        DenseMat<T> result(x2 - x1 + 1, y2 - y1 + 1);
-        for (int i = x1; i <= x2; i++)
-            for (int j = y1; j <= y2; j++)
-                result.set(i - x1 + 1, j - y1 + 1, this->get(i, j));
-        return result;
+    DenseView<T> DenseMat<T>::slicing(long long x1, long long x2, long long y1, long long y2) {
+        return view().slicing(x1, x2, y1, y2);
     }
 
     /*!
@@ -741,7 +1276,7 @@ namespace dense {
     T DenseMat<T>::trace() {
         if (row() != col()) throw out_of_range("Row and column must be same!");
         T trace = get(1, 1);
-        for (int i = 2; i <= col(); i++) {
+        for (long long i = 2; i <= col(); i++) {
             trace = trace + get(i, i);
         }
         return trace;
@@ -751,41 +1286,13 @@ namespace dense {
      * @brief Support determinant computing operation for the matrix.
      * @param[in] p : the matrix to be computed
      * @return a numeric result of determinant of the matrix
+     * @note Computed in O(n^3) from the pivots of an LU factorization.
      * @exception out_of_range : the row and col of matrix are not the same
      */
     template<class T>
     T DenseMat<T>::determinant(const DenseMat<T> &p) {
-
         if (p.col() != p.row()) throw out_of_range("Row and column must be same!");
-
-        if (p.col() == 1) return p.get(1, 1);
-
-        DenseMat<T> bb(p.row() - 1, p.col() - 1);
-
-        T *zero = new T();
-        T sum = *zero;
-        T flag;
-
-        for (int i = 1; i <= p.col(); ++i) {
-            int sign = ((i & 1) == 1) ? 1 : -1;
-            flag = p.get(1, i);
-            for (int x = 2; x <= p.row(); ++x) {
-                for (int y = 1; y < i; ++y) {
-                    bb.set(x - 1, y, p.get(x, y));
-                }
-            }
-            for (int x = 2; x <= p.row(); ++x) {
-                for (int y = i + 1; y <= p.col(); ++y) {
-                    bb.set(x - 1, y - 1, p.get(x, y));
-                }
-            }
-
-            if (sum == *zero) sum = (sign == 1 ? flag : -flag) * determinant(bb);
-            else sum = sum + (sign == 1 ? flag : -flag) * determinant(bb);
-        }
-
-        delete zero;
-        return sum;
+        return LU<T>(p).det();
     }
 
     /*!
@@ -805,29 +1312,29 @@ namespace dense {
      *                           row or col is too small or too large
      */
     template<class T>
-    T DenseMat<T>::cofactor(int i, int j) {
+    T DenseMat<T>::cofactor(long long i, long long j) {
         if (col() != row()) throw out_of_range("row and col must be same!");
         if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
         if (col() == 1) return 0;
         DenseMat<T> mat(row() - 1, col() - 1);
 
-        for (int x = 1; x < i; ++x) {
-            for (int y = 1; y < j; ++y) {
+        for (long long x = 1; x < i; ++x) {
+            for (long long y = 1; y < j; ++y) {
                 mat.set(x, y, get(x, y));
             }
         }
-        for (int x = i + 1; x <= row(); ++x) {
-            for (int y = 1; y < j; ++y) {
+        for (long long x = i + 1; x <= row(); ++x) {
+            for (long long y = 1; y < j; ++y) {
                 mat.set(x - 1, y, get(x, y));
             }
         }
-        for (int x = 1; x < i; ++x) {
-            for (int y = j + 1; y <= col(); ++y) {
+        for (long long x = 1; x < i; ++x) {
+            for (long long y = j + 1; y <= col(); ++y) {
                 mat.set(x, y - 1, get(x, y));
             }
         }
-        for (int x = i + 1; x <= row(); ++x) {
-            for (int y = j + 1; y <= col(); ++y) {
+        for (long long x = i + 1; x <= row(); ++x) {
+            for (long long y = j + 1; y <= col(); ++y) {
                 mat.set(x - 1, y - 1, get(x, y));
             }
         }
@@ -838,288 +1345,248 @@ namespace dense {
     /*!
      * @brief Support the inverse operation for the matrix.
      * @return a matrix with an inverse result
+     * @note Solves A X = I against one LU factorization, so complex matrices need
+     *       no invertible real or imaginary part.
      * @exception out_of_range : row and col of the matrix are not the same
      *                           the matrix is irreversible
      */
     template<class T>
     DenseMat<T> DenseMat<T>::inverse() {
         if (row() != col()) throw out_of_range("Row and column must be same!");
-        T det0 = det();
-        if (det0 == (T) 0) throw out_of_range("Matrix is irreversible!");
-        DenseMat<T> Mt = trans();
-        DenseMat<T> coMet(row(), col());
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                coMet.set(i, j, Mt.cofactor(i, j));
-            }
-        }
-        DenseMat<T> signMat(coMet.row(), coMet.col());
-
-        for (int i = 1; i <= coMet.row(); ++i) {
-            for (int j = 1; j <= coMet.col(); ++j) {
-                T sign = ((i + j) & 1) == 1 ? (T) -1 : (T) 1;
-                signMat.set(i, j, sign);
-            }
-        }
-        coMet = coMet.element_wise_multi(signMat);
-        coMet = coMet.scalar_multi((double) (1 / det0));
-        return coMet;
+        LU<T> lu(*this);
+        if (lu.singular()) throw out_of_range("Matrix is irreversible!");
+        return lu.inverse();
     }
 
     /*!
-     * @brief Support the inverse operation for the complex matrix.
-     * @return a complex matrix with an inverse result
+     * @brief Solve the linear system A X = B for this square matrix A.
+     * @param[in] b : the right-hand sides, one per column
+     * @return the solution X with the same size as b
      * @exception out_of_range : row and col of the matrix are not the same
-     *                           the real part of matrix is irreversible
-     *                           the image part of matrix is irreversible
+     *                           row of b is not equal to the size of the matrix
+     *                           the matrix is irreversible
      */
-    template<>
-    DenseMat<complex<double> > DenseMat<complex<double>>::inverse() {
+    template<class T>
+    DenseMat<T> DenseMat<T>::solve(const DenseMat<T> &b) {
         if (row() != col()) throw out_of_range("Row and column must be same!");
-        DenseMat<double> A(row(), col());
-        DenseMat<double> B(row(), col());
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                A.set(i, j, this->get(i, j).real());
-                B.set(i, j, this->get(i, j).imag());
-            }
-        }
-        if (A.det() == 0) throw out_of_range("The real part is irreversible!");
-        if (B.det() == 0) throw out_of_range("The image part is irreversible!");
-        DenseMat<double> Real = (A + B * A.inverse() * B).inverse();
-        DenseMat<double> Imag = A.inverse() * B * Real;
-        DenseMat<complex<double> > ans(row(), col());
-        for (int i = 1; i <= row(); ++i) {
-            for (int j = 1; j <= col(); ++j) {
-                complex<double> z0(Real.get(i, j), -Imag.get(i, j));
-                ans.set(i, j, z0);
-            }
-        }
-        return ans;
+        return LU<T>(*this).solve(b);
     }
 
     /*!
-     * @brief  Support QR factorization operation for the matrix.
-     * @return the Q matrix result after QR factorization
+     * @brief Support eigenvalues computing operation for the matrix.
+     * @param[out] info : if not null, receives the iteration counts of the QR algorithm
+     * @return the n eigenvalues, a complex pair as conjugates next to each other
+     * @note The elements of matrix can only be double type. The matrix is balanced,
+     *       reduced to Hessenberg form and then iterated with Francis double shifts
+     *       until every subdiagonal element has converged.
      * @exception out_of_range : the row and col of the matrix are not the same
-     *                           the matrix can not be QR factorized
+     * @exception domain_error : the iteration does not converge
      */
     template<>
-    DenseMat<double> DenseMat<double>::QRMa() {
-        if (this->row() != this->col()) throw out_of_range("Matrix must be square!");
-        int n = this->row();
-        DenseMat<double> Q(this->row(), this->row());
-        for (int i = 1; i <= n; i++)
-            for (int j = 1; j <= n; j++)
-                if (i == j) Q.set(i, j, 1.0);
-                else Q.set(i, j, 0.0);
-
-        int nn = n - 1;
-        double u, alpha, w, t;
-        for (int k = 0; k <= nn - 1; k++)//ڴѭk0~mУH⣬QԼA
-        {
-            u = 0.0;
-            for (int i = k; i <= n - 1; i++) {
-                w = fabs(this->get(i + 1, k + 1));
-                if (w > u) u = w;
-            }
-            alpha = 0.0;
-            for (int i = k; i <= n - 1; i++) {
-                t = this->get(i + 1, k + 1) / u;
-                alpha = alpha + t * t;
-            }
-            if (this->get(k + 1, k + 1) > 0.0) u = -u;
-            alpha = u * sqrt(alpha);
-            if (fabs(alpha) + 1.0 == 1.0) throw out_of_range("QR factorization failed!");
-
-            u = sqrt(2.0 * alpha * (alpha - this->get(k + 1, k + 1)));
-            if ((u + 1.0) != 1.0) {
-                this->set(k + 1, k + 1, (this->get(k + 1, k + 1) - alpha) / u);
-                for (int i = k + 1; i <= n - 1; i++)
-                    this->set(i + 1, k + 1, this->get(i + 1, k + 1) / u);
-
-                //ϾHãʵϳûκݽṹ洢H
-                //󣬶ֱӽuԪظֵԭAԭӦλã
-                //Ϊ˼˾QA
-                for (int j = 0; j <= n - 1; j++) {
-                    t = 0.0;
-                    for (int jj = k; jj <= n - 1; jj++)
-                        t = t + this->get(jj + 1, k + 1) * Q.get(jj + 1, j + 1);
-                    for (int i = k; i <= n - 1; i++)
-                        Q.set(i + 1, j + 1, Q.get(i + 1, j + 1) - 2.0 * t * this->get(i + 1, k + 1));
-                }
-                //˾Qѭõһٽתһ¾͵õQRֽеQ
-                //Ҳ
-
-                for (int j = k + 1; j <= n - 1; j++) {
-                    t = 0.0;
-                    for (int jj = k; jj <= n - 1; jj++)
-                        t = t + this->get(jj + 1, k + 1) * this->get(jj + 1, j + 1);
-                    for (int i = k; i <= n - 1; i++)
-                        this->set(i + 1, j + 1, this->get(i + 1, j + 1) - 2.0 * t * this->get(i + 1, k + 1));
-                }
-                //HAѭ֮ǲֵݾǾR
-                this->set(k + 1, k + 1, alpha);
-                for (int i = k + 1; i <= n - 1; i++) this->set(i + 1, k + 1, 0.0);
-            }
-        }
-        for (int i = 0; i <= n - 2; i++)
-            for (int j = i + 1; j <= n - 1; j++) {
-                t = Q.get(i + 1, j + 1);//Q[i][j];
-                Q.set(i + 1, j + 1, Q.get(j + 1, i + 1));
-                Q.set(j + 1, i + 1, t);
-            }
-        return Q;
+    vector<complex<double>> DenseMat<double>::eigenvalues(kernel::EigenInfo *info) {
+        if (row() != col()) throw out_of_range("Matrix must be square!");
+        long long n = row();
+        vector<double> a(data, data + n * n), scale(n), tau(std::max(n - 1, 0LL));
+        kernel::balance(n, a.data(), n, scale.data());
+        kernel::hessenberg(n, a.data(), n, tau.data());
+        for (long long i = 2; i < n; i++) fill(a.begin() + i * n, a.begin() + i * n + i - 1, 0.0);
+        vector<complex<double>> w(n);
+        kernel::EigenInfo local;
+        kernel::hqr(n, a.data(), n, w.data(), info ? *info : local);
+        return w;
     }
 
     /*!
      * @brief Support eigenvalues computing operation for the matrix.
-     * @param[out] res : store the eigenvalues computed
+     * @param[out] res : store the real parts of the eigenvalues, row() of them
      * @note The elements of matrix can only be double type.
      * @exception out_of_range : the row and col of the matrix are not the same
      */
     template<>
     void DenseMat<double>::eigenvalues(double *res) {
-        if (this->row() != this->col()) throw out_of_range("Matrix must be square!");
-        int n = this->row();
-        if (n == 1) {
-            res[0] = this->get(1, 1);
-            return;
-        }
-        DenseMat<double> A1, A2, Q;
-        A1 = *this;
-        for(int t = 1; t <= 100; t++){
-            Q = A1.QRMa();
-            A2 = A1 * Q;
-            A1 = A2;
-        }
-        for (int i = 0; i < n; i++) res[i] = A1.get(i + 1, i + 1);
+        vector<complex<double>> w = eigenvalues();
+        for (size_t i = 0; i < w.size(); i++) res[i] = w[i].real();
     }
 
     /*!
      * @brief Support convolutional operations of two matrices.
-     * @param[in] core : the convolutional core
+     * @param[in] core : the convolutional core, of any size
+     * @param[in] opt : padding mode, output shape, stride, dilation and method
      * @return a matrix with convolutional result
-     * @exception out_of_range : the row or col of the core is larger than the matrix
-     *                           the row and col of the core are not the same
+     * @note The image is padded once and the work is split over rows of the result on
+     *       the thread pool. Under the Auto method, rank-1 cores run as two 1D passes and
+     *       large cores of floating-point matrices go through FFT tiles, see kernel::conv2d().
+     * @note The default, zero padding with the Same shape, changes the old result. The
+     *       old conv() padded one zero on each side and returned the valid part, n + 3 - k
+     *       elements per axis, so the size only matched for 3 x 3 cores: a 4 x 4 core of
+     *       a 4 x 4 matrix gave 3 x 3 and now gives 4 x 4. It also left the middle row of
+     *       odd cores unflipped, so even 3 x 3 results differ when that row is not
+     *       symmetric, as in Sobel-x. The core is now fully flipped.
+     * @exception out_of_range : a valid convolution with the core larger than the matrix
+     * @exception invalid_argument : a stride or dilation is not positive, or FFT asked
+     *            for with an element type that is not floating-point
      */
     template<class T>
-    DenseMat<T> DenseMat<T>::conv(DenseMat<T> core) {
-        if (col() < core.col() || row() < core.row()) throw out_of_range("the core is too large!");
-        if (col() != row()) throw out_of_range("the core must be a square!");
-
-
-        DenseMat mat(row() + 2, col() + 2);
-
-        for (int i = 2; i <= row() + 1; ++i) {
-            for (int j = 2; j <= col() + 1; ++j) {
-                mat.set(i, j, get(i - 1, j - 1));
-            }
-        }
-
-        for (int i = 1; i <= col() + 2; ++i) {
-            mat.set(1, i, (T) 0);
-            mat.set(row() + 2, i, (T) 0);
-        }
-
-        for (int i = 1; i <= row() + 2; ++i) {
-            mat.set(i, 1, (T) 0);
-            mat.set(i, col() + 2, (T) 0);
-        }
-
-        for (int i = 1; i <= (core.row() + 1) / 2; ++i) {
-            for (int j = 1; j <= core.col(); ++j) {
-                T temp = core.get(i, j);
-                core.set(i, j, core.get(core.row() - i + 1, core.col() - j + 1));
-                core.set(core.row() - i + 1, core.col() - j + 1, temp);
-            }
-        }
-
-        DenseMat<T> ans(mat.row() - core.row() + 1, mat.col() - core.col() + 1);
-
-        for (int i = 1; i <= mat.row() - core.row() + 1; ++i) {
-            for (int j = 1; j <= mat.col() - core.col() + 1; ++j) {
-                T sum = (T) 0;
-                for (int x = 0; x < core.row(); ++x) {
-                    for (int y = 0; y < core.col(); ++y) {
-                        sum = sum + mat.get(x + i, y + j) * core.get(x + 1, y + 1);
-                    }
-                }
-                ans.set(i, j, sum);
-            }
-        }
+    DenseMat<T> DenseMat<T>::conv(const DenseMat<T> &core, const kernel::ConvOptions &opt) const {
+        kernel::ConvAxis rows = kernel::conv_axis(row(), core.row(), opt.strideRow, opt.dilationRow, opt.shape);
+        kernel::ConvAxis cols = kernel::conv_axis(col(), core.col(), opt.strideCol, opt.dilationCol, opt.shape);
+        DenseMat<T> ans(rows.out, cols.out);
+        kernel::conv2d<T>(row(), col(), data, col(), 1, core.data, core.row(), core.col(), opt, ans.data);
+        return ans;
+    }
 
+    /*!
+     * @brief Convolve with the separable core vertical * horizontal, given as its two factors.
+     * @param[in] vertical : the column factor, a row or column vector of kh elements
+     * @param[in] horizontal : the row factor, a row or column vector of kw elements
+     * @param[in] opt : as for the single core; method and separableTolerance are not used
+     * @return the same as conv() with the kh x kw core vertical(a) * horizontal(b)
+     * @note Runs a column pass and a row pass, 2 * (kh + kw) flops per output instead of
+     *       2 * kh * kw, without a padded copy of the matrix, see kernel::conv_separable().
+     * @exception invalid_argument : a factor is not a vector, or a stride or dilation is not positive
+     * @exception out_of_range : a valid convolution with the core larger than the matrix
+     */
+    template<class T>
+    DenseMat<T> DenseMat<T>::conv(const DenseMat<T> &vertical, const DenseMat<T> &horizontal,
+                                  const kernel::ConvOptions &opt) const {
+        if ((vertical.row() != 1 && vertical.col() != 1) || (horizontal.row() != 1 && horizontal.col() != 1))
+            throw invalid_argument("The factors of a separable core must be vectors!");
+        long long kh = vertical.row() * vertical.col(), kw = horizontal.row() * horizontal.col();
+        kernel::ConvAxis rows = kernel::conv_axis(row(), kh, opt.strideRow, opt.dilationRow, opt.shape);
+        kernel::ConvAxis cols = kernel::conv_axis(col(), kw, opt.strideCol, opt.dilationCol, opt.shape);
+        DenseMat<T> ans(rows.out, cols.out);
+        vector<T> cf(vertical.data, vertical.data + kh), rf(horizontal.data, horizontal.data + kw);
+        reverse(cf.begin(), cf.end());
+        reverse(rf.begin(), rf.end());
+        kernel::conv_separable<T>(data, col(), rows, cols, opt.padding, cf.data(), rf.data(), ans.data);
         return ans;
     }
 
     /*!
      * @brief Support eigenvectors computing operation of the matrix.
-     * @param[in] eigenValue : the eigenvalue to be computed for the eigenvector
-     * @return a matrix with computed eigenvector by the given eigenvalue
+     * @param[in] w : the eigenvalues whose eigenvectors are wanted
+     * @return a matrix whose column j is the eigenvector of w[j], with unit 2-norm and its
+     *         largest element real and positive
+     * @note The elements of matrix can only be double type. The matrix is reduced to
+     *       Hessenberg form once; every eigenvalue then costs one O(n^2) inverse
+     *       iteration, and the eigenvalues are spread over the thread pool.
+     * @exception out_of_range : the row and col of the matrix are not the same
+     */
+    template<>
+    DenseMat<complex<double>> DenseMat<double>::eigenvectors(const vector<complex<double>> &w) {
+        if (row() != col()) throw out_of_range("Matrix must be square!");
+        long long n = row(), k = (long long) w.size();
+        vector<double> a(data, data + n * n), scale(n), tau(std::max(n - 1, 0LL));
+        kernel::balance(n, a.data(), n, scale.data());
+        kernel::hessenberg(n, a.data(), n, tau.data());
+        vector<complex<double>> v(n * k);
+        kernel::eigenvectors(n, a.data(), n, tau.data(), scale.data(), w.data(), k, v.data(), n);
+        DenseMat<complex<double>> eigenVector(n, k);
+        for (long long j = 0; j < k; j++)
+            for (long long i = 0; i < n; i++) eigenVector.buffer()[i * k + j] = v[j * n + i];
+        return eigenVector;
+    }
+
+    /*!
+     * @brief Support eigenvectors computing operation of the matrix.
+     * @param[in] eigenValue : row() real eigenvalues to be computed for the eigenvectors
+     * @return a matrix whose column j is the eigenvector of eigenValue[j]
+     * @exception out_of_range : the row and col of the matrix are not the same
      */
     template<>
     DenseMat<double> DenseMat<double>::eigenvectors(const double *eigenValue) {
-        unsigned i, j, q;
-        int count;
-        int m;
-        const unsigned NUM = this->col();
-        double eValue, sum, midSum, mid;
-        DenseMat<double> temp(this->row(), this->col()), eigenVector(this->row(), this->col());
-        for (count = 0; count < NUM; ++count) {
-            //ֵΪeValueʱϵ
-            eValue = eigenValue[count];
-            temp = *this;
-            for (i = 0; i < temp.col(); ++i) {
-                temp.set(i + 1, i + 1, temp.get(i + 1, i + 1) - eValue);
-            }
+        if (row() != col()) throw out_of_range("Matrix must be square!");
+        DenseMat<complex<double>> v = eigenvectors(vector<complex<double>>(eigenValue, eigenValue + row()));
+        DenseMat<double> eigenVector(row(), col());
+        for (long long i = 0; i < row() * col(); i++) eigenVector.data[i] = v.buffer()[i].real();
+        return eigenVector;
+    }
 
-            //tempΪ;
-            for (i = 0; i < temp.row() - 1; ++i) {
-                mid = temp.get(i + 1, i + 1);
-                for (j = i; j < temp.col(); ++j) {
-                    temp.set(i + 1, j + 1, temp.get(i + 1, j + 1) / mid);
-                }
+    /*!
+     * @brief Support eigen decomposition of a symmetric or Hermitian matrix.
+     * @param[in] top : how many of the largest eigenpairs to compute, 0 for all of them
+     * @return the eigenvalues in descending order and their eigenvectors as columns, each
+     *         with unit 2-norm and its largest element real and positive
+     * @note The elements of matrix can only be double or complex<double>, and only the
+     *       lower triangle is read. The matrix is reduced to tridiagonal form; all pairs
+     *       then come from divide and conquer, while a few top pairs come from bisection
+     *       and inverse iteration, which is much cheaper when top is small.
+     * @exception out_of_range : the row and col of the matrix are not the same, or top is
+     *                           negative or larger than the order of the matrix
+     */
+    template<class T>
+    SymmetricEigen<T> DenseMat<T>::symmetric_eigen(long long top) const {
+        static_assert(std::is_same<T, double>::value || std::is_same<T, complex<double> >::value,
+                      "symmetric_eigen needs double or complex<double> elements");
+        if (row() != col()) throw out_of_range("Matrix must be square!");
+        long long n = row();
+        if (top < 0 || top > n) throw out_of_range("The number of eigenpairs is out of range!");
+        long long k = top == 0 ? n : top;
+        vector<T> a(data, data + n * n);
+        SymmetricEigen<T> res;
+        res.values.resize(k);
+        res.vectors = DenseMat<T>(n, k);
+        kernel::symmetric_eigen<T>(n, a.data(), n, k, res.values.data(), res.vectors.data, k);
+        return res;
+    }
 
-                for (j = i + 1; j < temp.row(); ++j) {
-                    mid = temp.get(j + 1, i + 1);
-                    for (q = i; q < temp.col(); ++q) {
-                        temp.set(j + 1, q + 1, temp.get(j + 1, q + 1) - mid * temp.get(i + 1, q + 1));
-                    }
-                }
-            }
+    /*!
+     * @brief Read a text matrix file without prompting, see io::TextFormat.
+     * @param[in] path : the file, mapped into memory while it is parsed
+     * @param[in] f : the layout, by default chosen from the extension and the content
+     * @note Sparse layouts are expanded. Large files are parsed on the thread pool. The
+     *       file holds one matrix; read() takes several in turn, as in 1.in.
+     * @exception runtime_error : the file cannot be read
+     * @exception io::ParseError : the file is malformed; its message starts with the line
+     */
+    template<class T>
+    DenseMat<T> DenseMat<T>::load(const string &path, io::TextFormat f) {
+        io::Mapping map(path);
+        io::TextMatrix<T> m = io::read_text<T>(map.data(), map.data() + map.size(), f, path, false);
+        return from_text(m);
+    }
 
-            midSum = 1.0;
-            eigenVector.set(eigenVector.row(), count + 1, 1.0);
-            for (m = temp.row() - 2; m >= 0; --m) {
-                sum = 0;
-                for (j = m + 1; j < temp.col(); ++j) {
-                    sum += temp.get(m + 1, j + 1) * eigenVector.get(j + 1, count + 1);
-                }
-                sum = -sum / temp.get(m + 1, m + 1);
-                midSum += sum * sum;
-                eigenVector.set(m + 1, count + 1, sum);
-            }
+    /*!
+     * @brief Parse a text matrix held in a string, the same as load().
+     */
+    template<class T>
+    DenseMat<T> DenseMat<T>::parse(const string &text, io::TextFormat f) {
+        io::TextMatrix<T> m = io::read_text<T>(text.data(), text.data() + text.size(), f, "", false);
+        return from_text(m);
+    }
 
-            midSum = sqrt(midSum);
-            for (i = 0; i < eigenVector.row(); ++i) {
-                eigenVector.set(i + 1, count + 1, eigenVector.get(i + 1, count + 1) / midSum);
-            }
-        }
-        return eigenVector;
+    /*!
+     * @brief Read the next dense matrix of a text holding several, in the layout of input().
+     * @exception io::ParseError : the matrix is malformed or cut short
+     */
+    template<class T>
+    DenseMat<T> DenseMat<T>::read(io::TextReader &in) {
+        io::TextMatrix<T> m = in.next<T>(false);
+        return from_text(m);
+    }
+
+    template<class T>
+    DenseMat<T> DenseMat<T>::from_text(io::TextMatrix<T> &m) {
+        io::densify(m);
+        DenseMat<T> res(m.rows, m.cols, uninitialized);
+        std::copy(m.dense.begin(), m.dense.end(), res.data);
+        return res;
     }
 
     /*!
      * @brief Support the input of a matrix.
+     * @note Interactive: it prompts on cout and reads cin. load() and parse() read text
+     *       matrices in one pass.
      */
     template<class T>
     void DenseMat<T>::input() {
-        int x, y;
+        long long x, y;
         string s1, s2, s;
         int flag = 1;
         while (true) {
             cout << "Please input the rows and columns.\n";
             cin >> s1 >> s2;
-            if (s1 != to_string(stoi(s1)) || s2 != to_string(stoi(s2))) {
+            if (s1 != to_string(stoll(s1)) || s2 != to_string(stoll(s2))) {
                 cout << "The input is not integers!\n Do you want to continue? [y/n]\n";
                 cin >> s;
                 if (s == "y") continue;
@@ -1128,8 +1595,8 @@ namespace dense {
                     break;
                 }
             }
-            x = stoi(s1), y = stoi(s2);
-            if (x <= 0 || x > MAX_ROW || y < 0 || y > MAX_COL) {
+            x = stoll(s1), y = stoll(s2);
+            if (x <= 0 || y <= 0 || x > LLONG_MAX / y) {
                 cout << "rows or columns are out of range!\n Do you want to continue? [y/n]\n";
                 cin >> s;
                 if (s == "y") continue;
@@ -1144,111 +1611,667 @@ namespace dense {
         DenseMat<T> res(x, y);
         T v;
         cout << "Please input n*m values in order.\n";
-        for (int i = 1; i <= x; i++)
-            for (int j = 1; j <= y; j++) {
+        for (long long i = 1; i <= x; i++)
+            for (long long j = 1; j <= y; j++) {
                 cin >> v;
                 res.set(i, j, v);
             }
         *this = res;
     }
-}
-
-/*!
- * @brief A namespace storing SparseMat \n
- */
-namespace sparse {
-    using namespace dense;
 
+    /*!
+     * @brief Factorize a square matrix.
+     * @param[in] p : the matrix to be factorized
+     * @note The matrix is flagged singular when a pivot is below n * eps * max|a(i,j)|.
+     * @exception out_of_range : the row and col of the matrix are not the same
+     */
     template<class T>
-    class SparseMat : public Mat {
-    public:
-        std::vector<triple<T> > data_t;
-
-        SparseMat();
-
-        SparseMat(int row, int col);
-
-        SparseMat(SparseMat<T> &p);
-
-        SparseMat(DenseMat<T> &p);
-
-        virtual ~SparseMat();
-
-        T get(int i, int j);
-
-        void set(int i, int j, T v);
-
-        operator DenseMat<T>() const;
-
-        SparseMat<T> &operator=(const SparseMat<T> &p);
-
-        void input();
-
-        friend ostream &operator<<(ostream &os, SparseMat<T> &c) {
-            for (int i = 1; i <= c.row(); i++) {
-                os << "(";
-                for (int j = 1; j <= c.col(); j++) {
-                    os << setw(10);
-                    os << c.get(i, j);
-                    if (j != c.col()) os << ",";
-                }
-                os << ")\n";
-            }
-            return os;
+    LU<T>::LU(const DenseMat<T> &p) {
+        if (p.row() != p.col()) throw out_of_range("Row and column must be same!");
+        n = p.row();
+        lu.resize((size_t) n * n);
+        piv.resize(n);
+        double scale = 0;
+        for (size_t i = 0; i < lu.size(); i++) {
+            lu[i] = (S) p.data[i];
+            scale = std::max(scale, kernel::magnitude(lu[i]));
         }
-    };
+        info = kernel::lu_factor<S>(n, lu.data(), n, piv.data());
+        double tol = n * std::numeric_limits<typename kernel::real_of<S>::type>::epsilon() * scale;
+        singularFlag = info != 0;
+        for (long long i = 0; i < n && !singularFlag; i++)
+            if (kernel::magnitude(lu[(size_t) i * n + i]) <= tol) singularFlag = true;
+    }
 
     template<class T>
-    SparseMat<T>::SparseMat():Mat() {}
+    T LU<T>::to_elem(const S &v) {
+        if constexpr (std::is_integral<T>::value) return (T) llround(v);
+        else return (T) v;
+    }
 
     template<class T>
-    SparseMat<T>::SparseMat(int row, int col) {
-        if (row > MAX_ROW_SPARSE || col > MAX_COL_SPARSE) throw length_error("Row or column is too large!");
-        if (row <= 0 || col <= 0) throw out_of_range("Row or column must be positive!");
-        Row = row;
-        Col = col;
+    long long LU<T>::size() const {
+        return n;
     }
 
     /*!
-     * @brief The constructor using type SparseMat<T>.
-     * @tparam T
-     * @param p The sparse matrix
+     * @brief Whether a pivot vanished (within round-off) during factorization.
      */
     template<class T>
-    SparseMat<T>::SparseMat(SparseMat<T> &p):SparseMat(p.row(), p.col()) {
-        for (triple<T> e : p.data_t) data_t.push_back(e);
+    bool LU<T>::singular() const {
+        return singularFlag;
     }
 
     /*!
-     * @brief The constructor using type DenseMat<T>.
-     * @param p The dense matrix
+     * @brief The determinant: the product of the pivots with the sign of the row permutation.
      */
     template<class T>
-    SparseMat<T>::SparseMat(DenseMat<T> &p):SparseMat(p.row(), p.col()) {
-        for (int i = 1; i <= row(); i++)
-            for (int j = 1; j <= col(); j++)
-                set(i, j, p.get(i, j));
+    T LU<T>::det() const {
+        if (info) return to_elem(S());
+        S d = S(1);
+        for (long long i = 0; i < n; i++) {
+            d *= lu[(size_t) i * n + i];
+            if (piv[i] != i) d = -d;
+        }
+        return to_elem(d);
     }
 
-    template<class T>
-    SparseMat<T>::~SparseMat() = default;
-
     /*!
-     *
-     * @brief The same as the implementation of DenseMat.
-     * @tparam T
-     * @param i
-     * @param j
-     * @return
+     * @brief Solve A X = B with the stored factors.
+     * @param[in] b : the right-hand sides, one per column
+     * @exception out_of_range : row of b is not equal to the size of the matrix
+     *                           the matrix is irreversible
      */
     template<class T>
-    T SparseMat<T>::get(int i, int j) {
+    DenseMat<T> LU<T>::solve(const DenseMat<T> &b) const {
+        if (b.row() != n) throw out_of_range("Row of b must be equal to the size of the matrix!");
+        if (singularFlag) throw out_of_range("Matrix is irreversible!");
+        size_t size = (size_t) b.row() * b.col();
+        std::vector<S> x(size);
+        for (size_t i = 0; i < size; i++) x[i] = (S) b.data[i];
+        kernel::lu_solve<S>(n, lu.data(), n, piv.data(), x.data(), b.col(), b.col());
+        DenseMat<T> res(b.row(), b.col());
+        for (size_t i = 0; i < size; i++) res.data[i] = to_elem(x[i]);
+        return res;
+    }
+
+    /*!
+     * @brief The inverse matrix, solved column by column against the identity.
+     * @exception out_of_range : the matrix is irreversible
+     */
+    template<class T>
+    DenseMat<T> LU<T>::inverse() const {
+        DenseMat<T> id(n, n);
+        for (long long i = 0; i < n; i++) id.data[(size_t) i * n + i] = (T) 1;
+        return solve(id);
+    }
+
+    /*!
+     * @brief Factorize an m x n matrix.
+     * @param[in] p : the matrix to be factorized, any shape
+     */
+    template<class T>
+    QR<T>::QR(const DenseMat<T> &p) : m(p.row()), n(p.col()), qr(p.buffer(), p.buffer() + p.row() * p.col()),
+                                      tau(std::min(p.row(), p.col())) {
+        kernel::qr_factor<T>(m, n, qr.data(), n, tau.data());
+    }
+
+    template<class T>
+    long long QR<T>::rows() const {
+        return m;
+    }
+
+    template<class T>
+    long long QR<T>::cols() const {
+        return n;
+    }
+
+    /*!
+     * @brief The min(m, n) x n upper triangular factor R.
+     */
+    template<class T>
+    DenseMat<T> QR<T>::R() const {
+        long long k = std::min(m, n);
+        DenseMat<T> res(k, n);
+        for (long long i = 0; i < k; i++) std::copy(qr.begin() + i * n + i, qr.begin() + (i + 1) * n, res.buffer() + i * n + i);
+        return res;
+    }
+
+    /*!
+     * @brief The orthogonal factor, formed by applying the reflectors to the identity.
+     * @param[in] full : return all m columns instead of the first min(m, n)
+     */
+    template<class T>
+    DenseMat<T> QR<T>::Q(bool full) const {
+        long long k = full ? m : std::min(m, n);
+        DenseMat<T> res(m, k);
+        for (long long i = 0; i < k; i++) res.buffer()[i * k + i] = 1;
+        kernel::qr_apply<T>(m, n, qr.data(), n, tau.data(), false, res.buffer(), k, k);
+        return res;
+    }
+
+    template<class T>
+    DenseMat<T> QR<T>::apply(const DenseMat<T> &b, bool trans) const {
+        if (b.row() != m) throw out_of_range("Row of b must be equal to the row of the matrix!");
+        DenseMat<T> res(b);
+        kernel::qr_apply<T>(m, n, qr.data(), n, tau.data(), trans, res.buffer(), res.col(), res.col());
+        return res;
+    }
+
+    /*!
+     * @brief Q^T * b without forming Q.
+     * @exception out_of_range : row of b is not equal to the row of the matrix
+     */
+    template<class T>
+    DenseMat<T> QR<T>::apply_qt(const DenseMat<T> &b) const {
+        return apply(b, true);
+    }
+
+    /*!
+     * @brief Q * b without forming Q.
+     * @exception out_of_range : row of b is not equal to the row of the matrix
+     */
+    template<class T>
+    DenseMat<T> QR<T>::apply_q(const DenseMat<T> &b) const {
+        return apply(b, false);
+    }
+
+    /*!
+     * @brief The least-squares solution X minimizing ||A X - B|| for m >= n.
+     * @param[in] b : m x nrhs right-hand sides
+     * @return the n x nrhs solution, exact when A is square
+     * @exception out_of_range : row of the matrix is less than its column
+     *                           row of b is not equal to the row of the matrix
+     *                           the matrix is rank deficient
+     */
+    template<class T>
+    DenseMat<T> QR<T>::solve(const DenseMat<T> &b) const {
+        if (m < n) throw out_of_range("Row must not be less than column!");
+        DenseMat<T> y = apply_qt(b);
+        long long nrhs = b.col();
+        T scale = 0;
+        for (long long i = 0; i < n; i++) scale = std::max(scale, std::fabs(qr[i * n + i]));
+        T tol = (T) m * std::numeric_limits<T>::epsilon() * scale;
+        DenseMat<T> x(n, nrhs);
+        T *xb = x.buffer();
+        std::copy(y.buffer(), y.buffer() + n * nrhs, xb);
+        for (long long i = n - 1; i >= 0; i--) {
+            T *xi = xb + i * nrhs;
+            for (long long k = i + 1; k < n; k++) {
+                T r = qr[i * n + k];
+                if (r == 0) continue;
+                const T *xk = xb + k * nrhs;
+                for (long long c = 0; c < nrhs; c++) xi[c] -= r * xk[c];
+            }
+            T d = qr[i * n + i];
+            if (std::fabs(d) <= tol) throw out_of_range("Matrix is rank deficient!");
+            for (long long c = 0; c < nrhs; c++) xi[c] /= d;
+        }
+        return x;
+    }
+
+    /*!
+     * @brief Make a view of rows x cols elements starting at ptr.
+     * @param[in] rowStride : distance in elements between two rows
+     * @param[in] colStride : distance in elements between two columns
+     * @note Strides of a single row or column are normalized, so a contiguous
+     *       vector is recognized as a row-major block by the kernels.
+     * @exception out_of_range : row or col be not positive, or a stride is negative
+     */
+    template<class T>
+    DenseView<T>::DenseView(T *ptr, long long row, long long col, long long rowStride, long long colStride)
+            :Mat(row, col), ptr(ptr), rowStride(rowStride), colStride(colStride) {
+        if (rowStride < 0 || colStride < 0) throw out_of_range("Stride must not be negative!");
+        if (Col == 1) this->colStride = 1;
+        if (Row == 1) this->rowStride = Col * this->colStride;
+    }
+
+    template<class T>
+    T *DenseView<T>::buffer() const {
+        return ptr;
+    }
+
+    template<class T>
+    long long DenseView<T>::row_stride() const {
+        return rowStride;
+    }
+
+    template<class T>
+    long long DenseView<T>::col_stride() const {
+        return colStride;
+    }
+
+    /*!
+     * @brief The same as the implementation of DenseMat.
+     */
+    template<class T>
+    T DenseView<T>::get(long long i, long long j) const {
         if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
-        for (int i_ = 0; i_ < data_t.size(); i_++) {
-            if (data_t[i_].x != i || data_t[i_].y != j) continue;
-            return data_t[i_].v;
+        return ptr[(i - 1) * rowStride + (j - 1) * colStride];
+    }
+
+    /*!
+     * @brief The same as the implementation of DenseMat, writing through to the viewed matrix.
+     */
+    template<class T>
+    void DenseView<T>::set(long long i, long long j, T v) {
+        if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
+        ptr[(i - 1) * rowStride + (j - 1) * colStride] = v;
+    }
+
+    /*!
+     * @brief Copy the elements of another view into the viewed elements.
+     * @exception out_of_range : sizes of the views are not same
+     */
+    template<class T>
+    DenseView<T> &DenseView<T>::operator=(const DenseView<T> &v) {
+        assign(v);
+        return *this;
+    }
+
+    /*!
+     * @brief Evaluate an expression into the viewed elements.
+     * @note The operands may overlap the view, e.g. a.row_view(1) = a.row_view(2) * 2.
+     * @exception out_of_range : sizes of the view and the expression are not same
+     */
+    template<class T>
+    template<class E>
+    DenseView<T> &DenseView<T>::operator=(const expr::Expr<E> &e) {
+        assign(e.self());
+        return *this;
+    }
+
+    template<class T>
+    template<class E>
+    DenseView<T> &DenseView<T>::operator+=(const expr::Expr<E> &e) {
+        assign(*this + e.self());
+        return *this;
+    }
+
+    template<class T>
+    template<class E>
+    DenseView<T> &DenseView<T>::operator-=(const expr::Expr<E> &e) {
+        assign(*this - e.self());
+        return *this;
+    }
+
+    template<class T>
+    template<class S, class>
+    DenseView<T> &DenseView<T>::operator*=(S num) {
+        assign(*this * num);
+        return *this;
+    }
+
+    /*!
+     * @exception domain_error : divide the view by 0
+     */
+    template<class T>
+    template<class S, class>
+    DenseView<T> &DenseView<T>::operator/=(S num) {
+        assign(*this / num);
+        return *this;
+    }
+
+    /*!
+     * @brief Write an expression into the viewed elements; the view is never resized.
+     * @note A gemm goes straight into the viewed block when its columns are contiguous.
+     */
+    template<class T>
+    template<class E>
+    void DenseView<T>::assign(const E &e) {
+        if (e.row() != row() || e.col() != col()) throw out_of_range("Row or column must be same!");
+        expr::Window self = expr::window((const T *) ptr, row(), col(), rowStride, colStride);
+        if constexpr (kernel::blocking<T>::packed) {
+            expr::GemmForm<T> g;
+            if (colStride == 1 && expr::gemm_form(e, g) && expr::gemm_safe(g, self) &&
+                expr::representable<T>(g.alpha) && expr::representable<T>(g.beta)) {
+                expr::gemm_into(g, ptr, rowStride);
+                return;
+            }
         }
-        return T();
+        if (e.aliases(self)) {
+            DenseMat<T> tmp(e);
+            expr::evaluate(tmp, ptr, rowStride, colStride);
+            return;
+        }
+        e.prepare();
+        expr::evaluate(e, ptr, rowStride, colStride);
+    }
+
+    /*!
+     * @brief The same as the implementation of DenseMat.
+     */
+    template<class T>
+    template<class E>
+    expr::Binary<expr::Mul, DenseView<T>, E> DenseView<T>::element_wise_multi(const expr::Expr<E> &p) const {
+        return expr::Binary<expr::Mul, DenseView<T>, E>(*this, p.self());
+    }
+
+    /*!
+     * @brief The transposed view, swapping the strides.
+     */
+    template<class T>
+    DenseView<T> DenseView<T>::trans() const {
+        return DenseView<T>(ptr, col(), row(), colStride, rowStride);
+    }
+
+    /*!
+     * @brief A 1 x col view of the i-th row.
+     * @exception out_of_range : i is too small or too large
+     */
+    template<class T>
+    DenseView<T> DenseView<T>::row_view(long long i) const {
+        if (i <= 0 || i > row()) throw out_of_range("Row or column be out of range!");
+        return DenseView<T>(ptr + (i - 1) * rowStride, 1, col(), rowStride, colStride);
+    }
+
+    /*!
+     * @brief A row x 1 view of the j-th column.
+     * @exception out_of_range : j is too small or too large
+     */
+    template<class T>
+    DenseView<T> DenseView<T>::col_view(long long j) const {
+        if (j <= 0 || j > col()) throw out_of_range("Row or column be out of range!");
+        return DenseView<T>(ptr + (j - 1) * colStride, row(), 1, rowStride, colStride);
+    }
+
+    /*!
+     * @brief A min(row, col) x 1 view of the main diagonal.
+     */
+    template<class T>
+    DenseView<T> DenseView<T>::diag_view() const {
+        return DenseView<T>(ptr, std::min(row(), col()), 1, rowStride + colStride, 1);
+    }
+
+    /*!
+     * @brief The same as DenseMat::slicing(), in O(1).
+     * @exception out_of_range : the given index is too small or too large
+     *                           left-down index is larger than right-up index
+     */
+    template<class T>
+    DenseView<T> DenseView<T>::slicing(long long x1, long long x2, long long y1, long long y2) const {
+        if (x1 <= 0 || x2 > row() || x1 > x2) throw out_of_range("Out of x-axis range!");
+        if (y1 <= 0 || y2 > col() || y1 > y2) throw out_of_range("Out of y-axis range!");
+        return DenseView<T>(ptr + (x1 - 1) * rowStride + (y1 - 1) * colStride, x2 - x1 + 1, y2 - y1 + 1,
+                            rowStride, colStride);
+    }
+
+    /*!
+     * @brief Copy the viewed elements into a new matrix owning its storage.
+     */
+    template<class T>
+    DenseMat<T> DenseView<T>::materialize() const {
+        return DenseMat<T>(*this);
+    }
+}
+
+/*!
+ * @brief A namespace storing SparseMat \n
+ */
+namespace sparse {
+    using namespace dense;
+
+    template<class T>
+    class SparseView;
+
+    /*!
+     * @brief The compressed layouts of a SparseMat.
+     */
+    enum class Format {
+        CSR, ///< compressed sparse row: rows are outer, columns are inner
+        CSC  ///< compressed sparse column: columns are outer, rows are inner
+    };
+
+    /*!
+     * @brief A sparse matrix in compressed sparse row or column storage.
+     * @note Outer index o holds the entries ptr[o] ... ptr[o + 1] - 1, sorted by their inner
+     *       index, so get() is a binary search within one row (or column). set() updates a
+     *       stored entry in place and queues a new one; queued entries are merged in one
+     *       O(nnz + k log k) pass by compress(), which get() and every reader call first.
+     *       Read a matrix from several threads only after compress().
+     */
+    template<class T>
+    class SparseMat : public Mat {
+    private:
+        mutable Format fmt = Format::CSR;
+        mutable std::vector<long long> ptr;
+        mutable std::vector<int> idx;
+        mutable std::vector<T> val;
+        mutable std::vector<triple<T> > pending;
+        mutable kernel::SpmvPlan plan;
+
+        long long outer() const;
+
+        long long inner() const;
+
+        long long find(long long o, int in) const;
+
+        static SparseMat<T> from_text(io::TextMatrix<T> &m);
+
+        template<class> friend
+        class SparseView;
+
+    public:
+        SparseMat();
+
+        SparseMat(int row, int col, Format f = Format::CSR);
+
+        SparseMat(const SparseMat<T> &p);
+
+        SparseMat(SparseMat<T> &&p) noexcept;
+
+        SparseMat(const DenseMat<T> &p, Format f = Format::CSR);
+
+        virtual ~SparseMat();
+
+        static SparseMat<T> from_triplets(int row, int col, const std::vector<triple<T> > &t,
+                                          Format f = Format::CSR);
+
+        T get(int i, int j) const;
+
+        void set(int i, int j, T v);
+
+        operator DenseMat<T>() const;
+
+        SparseMat<T> &operator=(const SparseMat<T> &p);
+
+        SparseMat<T> &operator=(SparseMat<T> &&p) noexcept;
+
+        Format format() const;
+
+        void compress() const;
+
+        void convert(Format f);
+
+        long long nnz() const;
+
+        const std::vector<long long> &outer_ptr() const;
+
+        const std::vector<int> &inner_index() const;
+
+        const std::vector<T> &values() const;
+
+        std::vector<triple<T> > to_triplets() const;
+
+        const kernel::SpmvPlan &spmv_plan() const;
+
+        void spmv(const T *x, T *y, T alpha = T(1), T beta = T()) const;
+
+        void spmm(const DenseMat<T> &b, DenseMat<T> &c, T alpha = T(1), T beta = T()) const;
+
+        void spgemm(const SparseMat<T> &b, SparseMat<T> &c) const;
+
+        void input();
+
+        static SparseMat<T> load(const string &path, io::TextFormat f = io::TextFormat::Auto);
+
+        static SparseMat<T> parse(const string &text, io::TextFormat f = io::TextFormat::Auto);
+
+        static SparseMat<T> read(io::TextReader &in);
+
+        void save(const string &path, bool checksum = true) const;
+
+        static SparseView<T> mapped(const io::MatrixFile &file, bool check = false);
+
+        friend ostream &operator<<(ostream &os, const SparseMat<T> &c) {
+            for (int i = 1; i <= c.row(); i++) {
+                os << "(";
+                for (int j = 1; j <= c.col(); j++) {
+                    os << setw(10);
+                    os << c.get(i, j);
+                    if (j != c.col()) os << ",";
+                }
+                os << ")\n";
+            }
+            return os;
+        }
+    };
+
+    /*!
+     * @brief A read-only compressed sparse matrix over outside arrays, such as a mapped file.
+     * @note The arrays are laid out as in SparseMat, sorted within each outer index, and
+     *       must outlive the view. Nothing is ever queued, so a view can be read from
+     *       several threads at once.
+     */
+    template<class T>
+    class SparseView : public Mat {
+    private:
+        Format fmt;
+        const long long *ptr;
+        const int *idx;
+        const T *val;
+        kernel::SpmvPlan plan;
+
+    public:
+        SparseView(long long row, long long col, Format f, const long long *ptr, const int *idx, const T *val);
+
+        Format format() const;
+
+        long long nnz() const;
+
+        const long long *outer_ptr() const;
+
+        const int *inner_index() const;
+
+        const T *values() const;
+
+        T get(long long i, long long j) const;
+
+        void spmv(const T *x, T *y, T alpha = T(1), T beta = T()) const;
+
+        SparseMat<T> materialize() const;
+    };
+
+    template<class T>
+    SparseMat<T>::SparseMat():Mat(), ptr(2, 0) {}
+
+    /*!
+     * @brief An empty sparse matrix of row * col.
+     * @param[in] f : the compressed layout to store it in
+     * @exception length_error : row or col is larger than MAX_ROW_SPARSE or MAX_COL_SPARSE
+     * @exception out_of_range : row or col be not positive
+     */
+    template<class T>
+    SparseMat<T>::SparseMat(int row, int col, Format f) {
+        if (row > MAX_ROW_SPARSE || col > MAX_COL_SPARSE) throw length_error("Row or column is too large!");
+        if (row <= 0 || col <= 0) throw out_of_range("Row or column must be positive!");
+        Row = row;
+        Col = col;
+        fmt = f;
+        ptr.assign(outer() + 1, 0);
+    }
+
+    /*!
+     * @brief The constructor using type SparseMat<T>.
+     * @tparam T
+     * @param p The sparse matrix
+     */
+    template<class T>
+    SparseMat<T>::SparseMat(const SparseMat<T> &p) = default;
+
+    template<class T>
+    SparseMat<T>::SparseMat(SparseMat<T> &&p) noexcept = default;
+
+    /*!
+     * @brief The constructor using type DenseMat<T>, keeping its non-zero elements.
+     * @param p The dense matrix
+     * @param f The compressed layout to store it in
+     */
+    template<class T>
+    SparseMat<T>::SparseMat(const DenseMat<T> &p, Format f):SparseMat(p.row(), p.col(), f) {
+        const T *b = p.buffer();
+        long long rs = f == Format::CSR ? col() : 1, cs = f == Format::CSR ? 1 : col();
+        for (long long o = 0; o < outer(); o++) {
+            for (long long in = 0; in < inner(); in++) {
+                const T &v = b[o * rs + in * cs];
+                if (v == T()) continue;
+                idx.push_back((int) in);
+                val.push_back(v);
+            }
+            ptr[o + 1] = (long long) idx.size();
+        }
+    }
+
+    template<class T>
+    SparseMat<T>::~SparseMat() = default;
+
+    /*!
+     * @brief Build a matrix from coordinate (COO) entries in O(nnz log(nnz per row)).
+     * @param[in] t : 1-based (row, col, value) entries in any order, duplicates are summed
+     * @param[in] f : the compressed layout to build
+     * @exception out_of_range : an entry is outside the matrix
+     */
+    template<class T>
+    SparseMat<T> SparseMat<T>::from_triplets(int row, int col, const std::vector<triple<T> > &t, Format f) {
+        SparseMat<T> res(row, col, f);
+        bool csr = f == Format::CSR;
+        long long no = res.outer();
+        std::vector<long long> start(no + 1, 0);
+        for (const triple<T> &e : t) {
+            if (e.x <= 0 || e.y <= 0 || e.x > row || e.y > col) throw out_of_range("Row or column be out of range!");
+            start[(csr ? e.x : e.y)]++;
+        }
+        for (long long o = 0; o < no; o++) start[o + 1] += start[o];
+        std::vector<std::pair<int, T> > ent(t.size());
+        std::vector<long long> pos(start.begin(), start.end() - 1);
+        for (const triple<T> &e : t)
+            ent[pos[(csr ? e.x : e.y) - 1]++] = std::make_pair((csr ? e.y : e.x) - 1, e.v);
+        res.idx.reserve(t.size());
+        res.val.reserve(t.size());
+        for (long long o = 0; o < no; o++) {
+            // Stable, so duplicates are summed in input order and the result is reproducible.
+            std::stable_sort(ent.begin() + start[o], ent.begin() + start[o + 1],
+                             [](const std::pair<int, T> &a, const std::pair<int, T> &b) { return a.first < b.first; });
+            for (long long k = start[o]; k < start[o + 1];) {
+                T sum = ent[k].second;
+                long long r = k + 1;
+                for (; r < start[o + 1] && ent[r].first == ent[k].first; r++) sum = sum + ent[r].second;
+                if (!(sum == T())) res.idx.push_back(ent[k].first), res.val.push_back(sum);
+                k = r;
+            }
+            res.ptr[o + 1] = (long long) res.idx.size();
+        }
+        return res;
+    }
+
+    template<class T>
+    long long SparseMat<T>::outer() const {
+        return fmt == Format::CSR ? row() : col();
+    }
+
+    template<class T>
+    long long SparseMat<T>::inner() const {
+        return fmt == Format::CSR ? col() : row();
+    }
+
+    /*!
+     * @brief The position of the stored entry (o, in), -1 if absent.
+     */
+    template<class T>
+    long long SparseMat<T>::find(long long o, int in) const {
+        auto first = idx.begin() + ptr[o], last = idx.begin() + ptr[o + 1];
+        auto it = std::lower_bound(first, last, in);
+        return it != last && *it == in ? (long long) (it - idx.begin()) : -1;
     }
 
     /*!
@@ -1257,35 +2280,370 @@ namespace sparse {
      * @tparam T
      * @param i
      * @param j
+     * @return
+     */
+    template<class T>
+    T SparseMat<T>::get(int i, int j) const {
+        if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
+        compress();
+        long long p = fmt == Format::CSR ? find(i - 1, j - 1) : find(j - 1, i - 1);
+        return p < 0 ? T() : val[p];
+    }
+
+    /*!
+     *
+     * @brief The same as the implementation of DenseMat.
+     * @note A stored entry is updated in place, or erased when v is 0. A new entry is
+     *       queued in O(1) until the next compress().
+     * @tparam T
+     * @param i
+     * @param j
      * @param v
      */
     template<class T>
     void SparseMat<T>::set(int i, int j, T v) {
         if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
-        T zero = T();
-        if (v == zero) return;
-        for (int i_ = 0; i_ < data_t.size(); i_++) {
-            if (data_t[i_].x == i && data_t[i_].y == j) {
-                data_t[i_].v = v;
+        long long o = fmt == Format::CSR ? i - 1 : j - 1;
+        long long p = find(o, fmt == Format::CSR ? j - 1 : i - 1);
+        if (p >= 0) {
+            if (!(v == T())) {
+                val[p] = v;
                 return;
             }
+            idx.erase(idx.begin() + p);
+            val.erase(val.begin() + p);
+            for (long long k = o + 1; k <= outer(); k++) ptr[k]--;
+            plan = kernel::SpmvPlan();
+            return;
+        }
+        // A zero only matters when it overrides an earlier queued entry.
+        if (v == T() && pending.empty()) return;
+        pending.push_back(triple<T>(i, j, v));
+    }
+
+    /*!
+     * @brief Merge the entries queued by set() into the compressed storage.
+     * @note The last set() of an element wins, and queued zeros are dropped.
+     */
+    template<class T>
+    void SparseMat<T>::compress() const {
+        if (pending.empty()) return;
+        bool csr = fmt == Format::CSR;
+        long long no = outer();
+        // Bucket the queue by outer index, then sort every bucket by inner index. Both
+        // steps are stable, so the last set() of an element ends a run of equal keys.
+        std::vector<long long> start(no + 1, 0);
+        for (const triple<T> &e : pending) start[csr ? e.x : e.y]++;
+        for (long long o = 0; o < no; o++) start[o + 1] += start[o];
+        std::vector<std::pair<int, size_t> > q(pending.size());
+        std::vector<long long> pos(start.begin(), start.end() - 1);
+        for (size_t s = 0; s < pending.size(); s++) {
+            const triple<T> &e = pending[s];
+            q[pos[(csr ? e.x : e.y) - 1]++] = std::make_pair((csr ? e.y : e.x) - 1, s);
+        }
+        std::vector<long long> np(ptr.size(), 0);
+        std::vector<int> ni;
+        std::vector<T> nv;
+        ni.reserve(idx.size() + pending.size());
+        nv.reserve(idx.size() + pending.size());
+        for (long long o = 0; o < no; o++) {
+            std::stable_sort(q.begin() + start[o], q.begin() + start[o + 1],
+                             [](const std::pair<int, size_t> &a, const std::pair<int, size_t> &b) {
+                                 return a.first < b.first;
+                             });
+            long long k = ptr[o], ke = ptr[o + 1];
+            for (long long s = start[o]; s < start[o + 1]; s++) {
+                int in = q[s].first;
+                if (s + 1 < start[o + 1] && q[s + 1].first == in) continue;
+                for (; k < ke && idx[k] < in; k++) ni.push_back(idx[k]), nv.push_back(val[k]);
+                if (k < ke && idx[k] == in) k++;
+                const T &v = pending[q[s].second].v;
+                if (!(v == T())) ni.push_back(in), nv.push_back(v);
+            }
+            for (; k < ke; k++) ni.push_back(idx[k]), nv.push_back(val[k]);
+            np[o + 1] = (long long) ni.size();
         }
-        data_t.push_back(triple<T>(i, j, v));
+        ptr.swap(np);
+        idx.swap(ni);
+        val.swap(nv);
+        pending.clear();
+        pending.shrink_to_fit();
+        plan = kernel::SpmvPlan();
+    }
+
+    /*!
+     * @brief Switch between CSR and CSC in O(nnz + row + col) by a counting transpose.
+     */
+    template<class T>
+    void SparseMat<T>::convert(Format f) {
+        compress();
+        if (f == fmt) return;
+        long long no = outer(), ni = inner();
+        std::vector<long long> np(ni + 1, 0);
+        for (int in : idx) np[in + 1]++;
+        for (long long o = 0; o < ni; o++) np[o + 1] += np[o];
+        std::vector<long long> pos(np.begin(), np.end() - 1);
+        std::vector<int> nidx(idx.size());
+        std::vector<T> nval(val.size());
+        for (long long o = 0; o < no; o++)
+            for (long long k = ptr[o]; k < ptr[o + 1]; k++) {
+                long long d = pos[idx[k]]++;
+                nidx[d] = (int) o;
+                nval[d] = val[k];
+            }
+        ptr.swap(np);
+        idx.swap(nidx);
+        val.swap(nval);
+        fmt = f;
+        plan = kernel::SpmvPlan();
+    }
+
+    template<class T>
+    Format SparseMat<T>::format() const {
+        return fmt;
+    }
+
+    /*!
+     * @brief The number of stored non-zero elements.
+     */
+    template<class T>
+    long long SparseMat<T>::nnz() const {
+        compress();
+        return (long long) idx.size();
+    }
+
+    /*!
+     * @brief The outer pointers: row (CSR) or column (CSC) o holds entries ptr[o] ... ptr[o + 1] - 1.
+     */
+    template<class T>
+    const std::vector<long long> &SparseMat<T>::outer_ptr() const {
+        compress();
+        return ptr;
+    }
+
+    /*!
+     * @brief The 0-based column (CSR) or row (CSC) of every stored entry.
+     */
+    template<class T>
+    const std::vector<int> &SparseMat<T>::inner_index() const {
+        compress();
+        return idx;
+    }
+
+    template<class T>
+    const std::vector<T> &SparseMat<T>::values() const {
+        compress();
+        return val;
+    }
+
+    /*!
+     * @brief The stored entries as 1-based coordinate (COO) triples, in storage order.
+     */
+    template<class T>
+    std::vector<triple<T> > SparseMat<T>::to_triplets() const {
+        compress();
+        std::vector<triple<T> > res;
+        res.reserve(idx.size());
+        for (long long o = 0; o < outer(); o++)
+            for (long long k = ptr[o]; k < ptr[o + 1]; k++)
+                if (fmt == Format::CSR) res.push_back(triple<T>((int) o + 1, idx[k] + 1, val[k]));
+                else res.push_back(triple<T>(idx[k] + 1, (int) o + 1, val[k]));
+        return res;
+    }
+
+    /*!
+     * @brief Scatter the stored entries into a dense matrix.
+     */
+    template<class T>
+    SparseMat<T>::operator DenseMat<T>() const {
+        compress();
+        DenseMat<T> res(row(), col());
+        T *b = res.buffer();
+        long long rs = fmt == Format::CSR ? col() : 1, cs = fmt == Format::CSR ? 1 : col();
+        for (long long o = 0; o < outer(); o++)
+            for (long long k = ptr[o]; k < ptr[o + 1]; k++) b[o * rs + idx[k] * cs] = val[k];
+        return res;
     }
 
     /*!
      * @brief The same as the implementation of DenseMat.
      */
     template<class T>
-    SparseMat<T> &SparseMat<T>::operator=(const SparseMat<T> &p) {
-        if (this == &p) return *this;
+    SparseMat<T> &SparseMat<T>::operator=(const SparseMat<T> &p) = default;
 
-        data_t.clear();
+    template<class T>
+    SparseMat<T> &SparseMat<T>::operator=(SparseMat<T> &&p) noexcept = default;
 
-        this->Col = p.col();
-        this->Row = p.row();
-        for (triple<T> e : p.data_t) data_t.push_back(e);
-        return *this;
+    /*!
+     * @brief The merge-path partition used by spmv() on a CSR matrix.
+     * @note Built on first use and kept until the structure of the matrix changes. Like
+     *       compress(), call it once before running spmv() from several threads.
+     */
+    template<class T>
+    const kernel::SpmvPlan &SparseMat<T>::spmv_plan() const {
+        compress();
+        if (plan.segments() <= 0 && fmt == Format::CSR) plan = kernel::spmv_plan(row(), ptr.data());
+        return plan;
+    }
+
+    /*!
+     * @brief Sparse matrix-vector product y = alpha * A * x + beta * y into a caller-owned vector.
+     * @param[in] x : col() elements, must not overlap y
+     * @param[in,out] y : row() elements, whose old content is ignored when beta is 0
+     * @note A CSR matrix is split by non-zeros rather than by rows, so rows of very different
+     *       lengths still keep every thread busy, and the result does not depend on the
+     *       thread count. A CSC matrix scatters serially; convert() it for parallel runs.
+     */
+    template<class T>
+    void SparseMat<T>::spmv(const T *x, T *y, T alpha, T beta) const {
+        compress();
+        if (fmt == Format::CSR) kernel::spmv_csr(spmv_plan(), ptr.data(), idx.data(), val.data(), x, y, alpha, beta);
+        else kernel::spmv_csc(row(), col(), ptr.data(), idx.data(), val.data(), x, y, alpha, beta);
+    }
+
+    /*!
+     * @brief Sparse times dense product c = alpha * A * b + beta * c, reusing the buffer of c.
+     * @param[in,out] c : reallocated only when its size is not row() x b.col() and beta is 0
+     * @exception domain_error : row of b is not equal to column of this matrix
+     * @exception out_of_range : beta is not 0 and c has a wrong size
+     */
+    template<class T>
+    void SparseMat<T>::spmm(const DenseMat<T> &b, DenseMat<T> &c, T alpha, T beta) const {
+        if (col() != b.row()) throw domain_error("Row of right is not equal to column of left");
+        if (&c == &b) {
+            DenseMat<T> res(c);
+            spmm(b, res, alpha, beta);
+            c = std::move(res);
+            return;
+        }
+        if (c.row() != row() || c.col() != b.col()) {
+            if (!(beta == T())) throw out_of_range("Row or column must be same!");
+            c = DenseMat<T>(row(), b.col());
+        }
+        compress();
+        if (b.col() == 1)
+            spmv(b.buffer(), c.buffer(), alpha, beta);
+        else if (fmt == Format::CSR)
+            kernel::spmm_csr(row(), b.col(), ptr.data(), idx.data(), val.data(), b.buffer(), b.col(),
+                             c.buffer(), c.col(), alpha, beta);
+        else
+            kernel::spmm_csc(row(), col(), b.col(), ptr.data(), idx.data(), val.data(), b.buffer(), b.col(),
+                             c.buffer(), c.col(), alpha, beta);
+    }
+
+    /*!
+     * @brief Sparse times sparse product c = A * b, reusing the storage of c.
+     * @note c gets the format of this matrix; b is converted to it on a copy if needed.
+     *       A CSC product is computed as the CSR product of the transposes.
+     * @exception domain_error : row of b is not equal to column of this matrix
+     */
+    template<class T>
+    void SparseMat<T>::spgemm(const SparseMat<T> &b, SparseMat<T> &c) const {
+        if (col() != b.row()) throw domain_error("Row of right is not equal to column of left");
+        if (&c == this || &c == &b) {
+            SparseMat<T> res;
+            spgemm(b, res);
+            c = std::move(res);
+            return;
+        }
+        compress();
+        b.compress();
+        SparseMat<T> converted;
+        const SparseMat<T> *r = &b;
+        if (b.fmt != fmt) {
+            converted = b;
+            converted.convert(fmt);
+            r = &converted;
+        }
+        c.Row = row(), c.Col = b.col(), c.fmt = fmt;
+        c.pending.clear();
+        c.plan = kernel::SpmvPlan();
+        if (fmt == Format::CSR)
+            kernel::spgemm_csr(row(), b.col(), ptr.data(), idx.data(), val.data(),
+                               r->ptr.data(), r->idx.data(), r->val.data(), c.ptr, c.idx, c.val);
+        else
+            kernel::spgemm_csr(b.col(), row(), r->ptr.data(), r->idx.data(), r->val.data(),
+                               ptr.data(), idx.data(), val.data(), c.ptr, c.idx, c.val);
+    }
+
+    /*!
+     * @brief Sparse matrix-vector multiplication.
+     * @exception domain_error : size of x is not equal to column of the matrix
+     */
+    template<class T>
+    std::vector<T> operator*(const SparseMat<T> &a, const std::vector<T> &x) {
+        if ((long long) x.size() != a.col()) throw domain_error("Row of right is not equal to column of left");
+        std::vector<T> y(a.row());
+        a.spmv(x.data(), y.data());
+        return y;
+    }
+
+    /*!
+     * @brief Sparse times dense matrix multiplication.
+     * @exception domain_error : row of right is not equal to column of left
+     */
+    template<class T>
+    DenseMat<T> operator*(const SparseMat<T> &a, const DenseMat<T> &b) {
+        DenseMat<T> c(a.row(), b.col());
+        a.spmm(b, c);
+        return c;
+    }
+
+    /*!
+     * @brief Sparse times sparse matrix multiplication with a sparse result.
+     * @exception domain_error : row of right is not equal to column of left
+     */
+    template<class T>
+    SparseMat<T> operator*(const SparseMat<T> &a, const SparseMat<T> &b) {
+        SparseMat<T> c;
+        a.spgemm(b, c);
+        return c;
+    }
+
+    /*!
+     * @brief Read a text matrix file without prompting, see io::TextFormat.
+     * @note The whitespace layout is the sparse one of input(). Dense layouts drop their
+     *       zeros. The result is CSR. The file holds one matrix; read() takes several in turn.
+     * @exception runtime_error : the file cannot be read
+     * @exception io::ParseError : the file is malformed; its message starts with the line
+     * @exception length_error : rows or columns are larger than MAX_ROW_SPARSE or MAX_COL_SPARSE
+     */
+    template<class T>
+    SparseMat<T> SparseMat<T>::load(const string &path, io::TextFormat f) {
+        io::Mapping map(path);
+        io::TextMatrix<T> m = io::read_text<T>(map.data(), map.data() + map.size(), f, path, true);
+        return from_text(m);
+    }
+
+    /*!
+     * @brief Parse a text matrix held in a string, the same as load().
+     */
+    template<class T>
+    SparseMat<T> SparseMat<T>::parse(const string &text, io::TextFormat f) {
+        io::TextMatrix<T> m = io::read_text<T>(text.data(), text.data() + text.size(), f, "", true);
+        return from_text(m);
+    }
+
+    /*!
+     * @brief Read the next sparse matrix of a text holding several, in the layout of input().
+     * @exception io::ParseError : the matrix is malformed or cut short
+     * @exception length_error : rows or columns are larger than MAX_ROW_SPARSE or MAX_COL_SPARSE
+     */
+    template<class T>
+    SparseMat<T> SparseMat<T>::read(io::TextReader &in) {
+        io::TextMatrix<T> m = in.next<T>(true);
+        return from_text(m);
+    }
+
+    template<class T>
+    SparseMat<T> SparseMat<T>::from_text(io::TextMatrix<T> &m) {
+        if (m.rows > MAX_ROW_SPARSE || m.cols > MAX_COL_SPARSE) throw length_error("Row or column is too large!");
+        io::sparsify(m);
+        SparseMat<T> res((int) m.rows, (int) m.cols);
+        res.ptr = std::move(m.ptr);
+        res.idx = std::move(m.idx);
+        res.val = std::move(m.val);
+        return res;
     }
 
     /*!
@@ -1335,7 +2693,7 @@ namespace sparse {
                 }
             }
             num = stoi(s1);
-            if (num < 0 || num > x * y) {
+            if (num < 0 || num > (long long) x * y) {
                 cout << "Number is out of range!\n Do you want to continue? [y/n]\n";
                 cin >> s;
                 if (s == "y") continue;
@@ -1369,6 +2727,113 @@ namespace sparse {
         }
         if (flag) *this = res;
     }
+
+    /*!
+     * @brief Write the matrix in its compressed layout to a binary matrix file, see io::MatrixFile.
+     * @param[in] path : the file, replaced if it exists
+     * @param[in] checksum : store a checksum of the arrays
+     * @exception runtime_error : the file cannot be written
+     */
+    template<class T>
+    void SparseMat<T>::save(const string &path, bool checksum) const {
+        compress();
+        io::FileHeader h{};
+        h.kind = (uint32_t) (fmt == Format::CSR ? io::Kind::Csr : io::Kind::Csc);
+        h.elem = (uint32_t) io::elem_type<T>();
+        h.elemSize = sizeof(T);
+        h.rows = row(), h.cols = col(), h.nnz = nnz();
+        io::write_file(path, h, ptr.data(), idx.data(), val.data(), checksum);
+    }
+
+    /*!
+     * @brief A view of the sparse matrix in a mapped file, without copying it.
+     * @param[in] file : a mapped file holding a sparse matrix of T, which must outlive the view
+     * @param[in] check : check the pointers and indices first, see io::MatrixFile::well_formed()
+     * @note materialize() makes an owned SparseMat. Unless checked here or when the file was
+     *       opened with verify, its arrays are trusted: a corrupted file makes get(), spmv()
+     *       and materialize() read out of bounds.
+     * @exception invalid_argument : the file holds a dense matrix or another element type
+     * @exception runtime_error : check is set and the pointers or indices are broken
+     */
+    template<class T>
+    SparseView<T> SparseMat<T>::mapped(const io::MatrixFile &file, bool check) {
+        if (file.kind() == io::Kind::Dense) throw invalid_argument("The file does not hold a sparse matrix!");
+        if (file.elem() != io::elem_type<T>()) throw invalid_argument("The element type of the file does not match!");
+        if (check && !file.well_formed()) throw runtime_error("Corrupted sparse matrix file!");
+        return SparseView<T>(file.rows(), file.cols(), file.kind() == io::Kind::Csr ? Format::CSR : Format::CSC,
+                             file.outer_ptr(), file.inner_index(), static_cast<const T *>(file.values()));
+    }
+
+    /*!
+     * @brief View the compressed arrays of a row x col matrix.
+     * @param[in] ptr : outer() + 1 offsets into idx and val
+     * @note A CSR view partitions its rows for spmv() once, here.
+     */
+    template<class T>
+    SparseView<T>::SparseView(long long row, long long col, Format f, const long long *ptr, const int *idx,
+                              const T *val):Mat(row, col), fmt(f), ptr(ptr), idx(idx), val(val) {
+        if (f == Format::CSR) plan = kernel::spmv_plan(row, ptr);
+    }
+
+    template<class T>
+    Format SparseView<T>::format() const {
+        return fmt;
+    }
+
+    template<class T>
+    long long SparseView<T>::nnz() const {
+        return ptr[fmt == Format::CSR ? row() : col()];
+    }
+
+    template<class T>
+    const long long *SparseView<T>::outer_ptr() const {
+        return ptr;
+    }
+
+    template<class T>
+    const int *SparseView<T>::inner_index() const {
+        return idx;
+    }
+
+    template<class T>
+    const T *SparseView<T>::values() const {
+        return val;
+    }
+
+    /*!
+     * @brief The same as the implementation of SparseMat.
+     */
+    template<class T>
+    T SparseView<T>::get(long long i, long long j) const {
+        if (i <= 0 || j <= 0 || i > row() || j > col()) throw out_of_range("Row or column be out of range!");
+        long long o = fmt == Format::CSR ? i - 1 : j - 1;
+        int in = (int) (fmt == Format::CSR ? j - 1 : i - 1);
+        const int *first = idx + ptr[o], *last = idx + ptr[o + 1], *it = std::lower_bound(first, last, in);
+        return it != last && *it == in ? val[it - idx] : T();
+    }
+
+    /*!
+     * @brief The same as the implementation of SparseMat.
+     */
+    template<class T>
+    void SparseView<T>::spmv(const T *x, T *y, T alpha, T beta) const {
+        if (fmt == Format::CSR) kernel::spmv_csr(plan, ptr, idx, val, x, y, alpha, beta);
+        else kernel::spmv_csc(row(), col(), ptr, idx, val, x, y, alpha, beta);
+    }
+
+    /*!
+     * @brief Copy the viewed matrix into an owned SparseMat of the same layout.
+     * @exception length_error : row or col is larger than MAX_ROW_SPARSE or MAX_COL_SPARSE
+     */
+    template<class T>
+    SparseMat<T> SparseView<T>::materialize() const {
+        SparseMat<T> res((int) std::min(row(), (long long) INT_MAX), (int) std::min(col(), (long long) INT_MAX), fmt);
+        long long outer = fmt == Format::CSR ? row() : col();
+        res.ptr.assign(ptr, ptr + outer + 1);
+        res.idx.assign(idx, idx + nnz());
+        res.val.assign(val, val + nnz());
+        return res;
+    }
 }
 
 /*!
@@ -1378,10 +2843,8 @@ namespace sparse {
  * @return a dense matrix
  */
 template<class T>
-dense::DenseMat<T> SparseToDense(sparse::SparseMat<T> d) {
-    dense::DenseMat<T> res(d.row(), d.col());
-    for (int i = 0; i < d.data_t.size(); i++)res.set(d.data_t[i].x, d.data_t[i].y, d.data_t[i].v);
-    return res;
+dense::DenseMat<T> SparseToDense(const sparse::SparseMat<T> &d) {
+    return dense::DenseMat<T>(d);
 }
 
 
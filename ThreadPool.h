@@ -0,0 +1,230 @@
+//
+// A library-owned work-stealing thread pool shared by the matrix kernels.
+//
+
+#ifndef CPP_PROJECT_THREADPOOL_H
+#define CPP_PROJECT_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * @brief A namespace storing the thread pool used by parallel matrix operations. \n
+ */
+namespace parallel {
+    /*!
+     * @brief A work-stealing thread pool.
+     * @note Every worker owns a deque: it pops its own tasks from the back and steals
+     *       from the front of the others. A thread waiting in parallel_for() keeps
+     *       running queued tasks, so nested parallel calls cannot deadlock.
+     */
+    class ThreadPool {
+    private:
+        struct Queue {
+            std::mutex m;
+            std::deque<std::function<void()> > tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue> > queues;
+        std::vector<std::thread> workers;
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<long long> pending{0};
+        std::atomic<unsigned> next{0};
+        bool stop = false;
+        unsigned nThreads = 1;
+        long long serialBelow = 1 << 22;
+
+        static int &worker_id() {
+            thread_local int id = -1;
+            return id;
+        }
+
+        void start(unsigned n);
+
+        void shutdown();
+
+        void push(std::function<void()> task);
+
+        bool try_run(int self);
+
+        void worker_loop(int id);
+
+        ThreadPool() { start(std::thread::hardware_concurrency()); }
+
+    public:
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool() { shutdown(); }
+
+        static ThreadPool &instance();
+
+        void set_threads(unsigned n);
+
+        unsigned threads() const;
+
+        void set_serial_threshold(long long work);
+
+        long long serial_threshold() const;
+
+        template<class F>
+        void parallel_for(long long tasks, long long work, F &&f);
+    };
+
+    /*!
+     * @brief Get the process-wide pool, started with one thread per hardware thread.
+     */
+    inline ThreadPool &ThreadPool::instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    inline void ThreadPool::start(unsigned n) {
+        nThreads = n == 0 ? 1 : n;
+        stop = false;
+        queues.clear();
+        for (unsigned i = 0; i < nThreads; i++) queues.emplace_back(new Queue());
+        // The calling thread is the last participant, so only n - 1 workers are spawned.
+        for (unsigned i = 0; i + 1 < nThreads; i++) workers.emplace_back(&ThreadPool::worker_loop, this, (int) i);
+    }
+
+    inline void ThreadPool::shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers) t.join();
+        workers.clear();
+    }
+
+    /*!
+     * @brief Set the number of threads taking part in parallel operations.
+     * @param[in] n : total thread count including the caller, 0 means hardware concurrency
+     * @note Must not be called while a parallel operation is running.
+     */
+    inline void ThreadPool::set_threads(unsigned n) {
+        if (n == 0) n = std::thread::hardware_concurrency();
+        if (n == 0) n = 1;
+        if (n == nThreads) return;
+        shutdown();
+        start(n);
+    }
+
+    inline unsigned ThreadPool::threads() const {
+        return nThreads;
+    }
+
+    /*!
+     * @brief Operations whose estimated work is below this value run serially.
+     * @param[in] work : threshold in estimated floating-point operations
+     */
+    inline void ThreadPool::set_serial_threshold(long long work) {
+        serialBelow = work;
+    }
+
+    inline long long ThreadPool::serial_threshold() const {
+        return serialBelow;
+    }
+
+    inline void ThreadPool::push(std::function<void()> task) {
+        int self = worker_id();
+        unsigned q = self >= 0 ? (unsigned) self : next++ % nThreads;
+        {
+            std::lock_guard<std::mutex> lock(queues[q]->m);
+            queues[q]->tasks.push_back(std::move(task));
+        }
+        pending++;
+        // Lock before notifying so a worker between its check and its wait cannot miss this task.
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_one();
+    }
+
+    /*!
+     * @brief Run one queued task: the own queue first, otherwise steal.
+     * @param[in] self : index of the own queue, -1 for a thread outside the pool
+     * @return whether a task was run
+     */
+    inline bool ThreadPool::try_run(int self) {
+        std::function<void()> task;
+        if (self >= 0) {
+            std::lock_guard<std::mutex> lock(queues[self]->m);
+            if (!queues[self]->tasks.empty()) {
+                task = std::move(queues[self]->tasks.back());
+                queues[self]->tasks.pop_back();
+            }
+        }
+        for (unsigned i = 1; !task && i <= nThreads; i++) {
+            unsigned victim = (unsigned) (self + i) % nThreads;
+            std::lock_guard<std::mutex> lock(queues[victim]->m);
+            if (!queues[victim]->tasks.empty()) {
+                task = std::move(queues[victim]->tasks.front());
+                queues[victim]->tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        pending--;
+        task();
+        return true;
+    }
+
+    inline void ThreadPool::worker_loop(int id) {
+        worker_id() = id;
+        while (true) {
+            if (try_run(id)) continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stop || pending > 0; });
+            if (stop) return;
+        }
+    }
+
+    /*!
+     * @brief Run f(0) ... f(tasks - 1) on the pool and wait for all of them.
+     * @param[in] tasks : number of independent tasks
+     * @param[in] work : estimated total work, compared with serial_threshold()
+     * @param[in] f : the task body, called with the task index
+     * @note The first exception thrown by a task is rethrown to the caller.
+     */
+    template<class F>
+    void ThreadPool::parallel_for(long long tasks, long long work, F &&f) {
+        if (tasks <= 0) return;
+        if (tasks == 1 || nThreads == 1 || work < serialBelow) {
+            for (long long i = 0; i < tasks; i++) f(i);
+            return;
+        }
+        std::atomic<long long> left(tasks);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        for (long long i = 1; i < tasks; i++)
+            push([&, i] {
+                try {
+                    f(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) error = std::current_exception();
+                }
+                left--;
+            });
+        try {
+            f(0);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) error = std::current_exception();
+        }
+        left--;
+        while (left > 0)
+            if (!try_run(worker_id())) std::this_thread::yield();
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+#endif //CPP_PROJECT_THREADPOOL_H
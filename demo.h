@@ -137,6 +137,39 @@ namespace demo {
         cout << "\n";
     }
 
+    /*!
+     * @brief Time an n*n double gemm for 1, 2, 4 ... threads and print GFLOP/s and speedup.
+     * @param[in] n : matrix size
+     * @param[in] maxThreads : largest thread count to try, 0 means hardware concurrency
+     */
+    void gemm_benchmark(int n = 1024, unsigned maxThreads = 0) {
+        using namespace std::chrono;
+        parallel::ThreadPool &pool = parallel::ThreadPool::instance();
+        unsigned oldThreads = pool.threads();
+        if (maxThreads == 0) maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        vector<double> A((size_t) n * n), B((size_t) n * n), C((size_t) n * n);
+        for (size_t i = 0; i < A.size(); i++) A[i] = (double) (rand() % 100) / 10 - 5, B[i] = A[i] / 2;
+        double base = 0;
+        for (unsigned t = 1;; t = std::min(t * 2, maxThreads)) {
+            pool.set_threads(t);
+            kernel::gemm<double>(n, n, n, 1, A.data(), n, B.data(), n, 0, C.data(), n);
+            int reps = 0;
+            auto start = steady_clock::now();
+            double sec;
+            do {
+                kernel::gemm<double>(n, n, n, 1, A.data(), n, B.data(), n, 0, C.data(), n);
+                reps++;
+                sec = duration<double>(steady_clock::now() - start).count();
+            } while (sec < 1.0);
+            double gflops = 2.0 * n * n * n * reps / sec / 1e9;
+            if (t == 1) base = gflops;
+            cout << "threads=" << setw(3) << t << "  " << setw(8) << gflops << " GFLOP/s  speedup="
+                 << gflops / base << endl;
+            if (t == maxThreads) break;
+        }
+        pool.set_threads(oldThreads);
+    }
+
     void start_demo() {
         srand((unsigned) time(nullptr));
         using namespace dense;
@@ -227,6 +260,10 @@ namespace demo {
         for(int i = 0; i < d0.col(); i++) cout << res[i] << "   ";
         cout<<endl;
         cout << "Eigenvector of double matrix=\n"<<d0.eigenvectors(res)<<endl;
+        DenseMat<double> d1(4, 4);
+        for (int i = 1; i <= 4; i++) d1.set(i, i, i < 4 ? 2 : 5);
+        d1.eigenvalues(res);
+        cout << "Eigenvector of a matrix with a repeated eigenvalue=\n"<<d1.eigenvectors(res)<<endl;
 
         //6. reshape and slicing
         DenseMat<int> B = intArr(3,4);